@@ -13,8 +13,13 @@ Arizona State University
 #ifndef MG_H_INCLUDED
 #define MG_H_INCLUDED
 
+#include <stddef.h>
+
 #define MAXSTRINGLENGTH 1024
 
+// Byte alignment of PGMImage pixel buffers and of the start of every row
+#define PGMALIGNMENT 64
+
 // NULL not standard on all systems, define is necessary
 #ifndef NULL
 #define NULL 0
@@ -30,9 +35,16 @@ typedef struct PGMHeader {
   int numGrayscaleDigits;
 } PGMHeader;
 
+// Pixels are stored in one contiguous buffer, row y starts at pixels + y*stride.
+// stride is at least header.width and is padded to PGMALIGNMENT for allocated images.
+// mapBase/mapLength are set when pixels is a read-only view into a memory mapped file
+// (see mapPGM), they are NULL/0 for heap allocated images.
 typedef struct PGMImage {
   PGMHeader header;
-  unsigned char** image;
+  int stride;
+  unsigned char* pixels;
+  void* mapBase;
+  size_t mapLength;
 } PGMImage;
 
 typedef enum PGMHeaderPhase {
@@ -43,4 +55,13 @@ typedef enum PGMHeaderPhase {
   READ_DONE
 } PGMHeaderPhase;
 
+// Incremental header parser state, fed one byte at a time by feedPGMHeaderByte
+typedef struct PGMHeaderParser {
+  PGMHeaderPhase phase;
+  int typeBytes;
+  int inComment;
+  int value;
+  int digits;
+} PGMHeaderParser;
+
 #endif // MG_H_INCLUDED
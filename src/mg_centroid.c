@@ -13,73 +13,549 @@ Arizona State University
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <math.h>
 #include "mg_centroid.h"
 #include "mg.h"
 
 /**
-  *@brief Create memory to store centroid coordinates.
+  *@brief Prepare an empty centroid table.
   *
   *INPUTS
-  *@param numCents : Number of centroids to create
-  *@param k        : Length of the distances array of each centroid
+  *@param cents : Table to be initialized.
+  *
+  *OUTPUTS
+  *none
+  */
+void initCentroidTable(CentroidTable *cents)
+{
+    memset(cents, 0, sizeof(CentroidTable));
+}
+
+/**
+  *@brief Size a centroid table for numCents centroids and k clusters.  Memory is only allocated
+  *          when the table is smaller than requested, otherwise the existing buffers are reused.
+  *          The distance matrix is not touched, see reserveDistances.
+  *
+  *INPUTS
+  *@param cents    : Table to be sized.
+  *@param numCents : Number of centroids.
+  *@param k        : Number of clusters.
+  *
+  *OUTPUTS
+  *@param 1 on success, -2 if memory could not be allocated.
   */
-Centroid* createCents(int numCents,int k)
+int reserveCentroids(CentroidTable *cents,int numCents,int k)
 {
-    int i=0;
-    Centroid *cents = NULL;
+    int capacity=0;
+    double *x, *y, *clusterDist;
+    int *kGroup;
 
-    // malloc_createCents() cents, free in test_run.c
-    cents = malloc(numCents*(sizeof(Centroid)));
+    if(numCents > cents->capacity)
+    {
+        capacity = cents->capacity > 0 ? cents->capacity : 256;
+        while(capacity < numCents)
+        {
+            capacity *= 2;
+        }
+        // realloc_reserveCentroids x, y, kGroup, clusterDist free in freeCentroidTable
+        x = realloc(cents->x, capacity * sizeof(double));
+        if(x != NULL)
+            cents->x = x;
+        y = realloc(cents->y, capacity * sizeof(double));
+        if(y != NULL)
+            cents->y = y;
+        kGroup = realloc(cents->kGroup, capacity * sizeof(int));
+        if(kGroup != NULL)
+            cents->kGroup = kGroup;
+        clusterDist = realloc(cents->clusterDist, capacity * sizeof(double));
+        if(clusterDist != NULL)
+            cents->clusterDist = clusterDist;
+        if(x == NULL || y == NULL || kGroup == NULL || clusterDist == NULL)
+            return -2;
+        cents->capacity = capacity;
+    }
+
+    cents->count = numCents;
+    cents->k = k;
+    return 1;
+}
+
+/**
+  *@brief Size the count x k distance matrix of a centroid table already sized by reserveCentroids.
+  *
+  *INPUTS
+  *@param cents : Table to be sized.
+  *
+  *OUTPUTS
+  *@param 1 on success, -2 if memory could not be allocated.
+  */
+int reserveDistances(CentroidTable *cents)
+{
+    size_t numDistances = (size_t)cents->count * (cents->k > 0 ? cents->k : 0);
+    double *distances;
 
-    for(i = 0; i<numCents; i++)
+    if(numDistances > cents->distanceCapacity)
     {
-        // malloc_createCents() cents[].distances, free in test_run.c
-        cents[i].distances = malloc(sizeof(double)*k);
+        // realloc_reserveDistances distances free in freeCentroidTable
+        distances = realloc(cents->distances, numDistances * sizeof(double));
+        if(distances == NULL)
+            return -2;
+        cents->distances = distances;
+        cents->distanceCapacity = numDistances;
     }
+    return 1;
+}
 
-    return cents;
+/**
+  *@brief Free the buffers of a centroid table.
+  *
+  *INPUTS
+  *@param cents : Table to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeCentroidTable(CentroidTable *cents)
+{
+    free(cents->x);
+    free(cents->y);
+    free(cents->kGroup);
+    free(cents->clusterDist);
+    free(cents->distances);
+    initCentroidTable(cents);
+}
+/**
+  *@brief Prepare an empty spatial grid.  Buffers are allocated by buildSpatialGrid and reused
+  *          when the grid is rebuilt.
+  *
+  *INPUTS
+  *@param grid : Grid to be initialized.
+  *
+  *OUTPUTS
+  *none
+  */
+void initSpatialGrid(SpatialGrid *grid)
+{
+    memset(grid, 0, sizeof(SpatialGrid));
 }
 
 /**
-  *@brief Detect shift between two lists of centroid coordinates
+  *@brief Free the buffers of a spatial grid.
   *
   *INPUTS
-  *@param centList1    : Centroid coordinate list from first image
-  *@param centList1Len : Number of centroid coordinates in the first list
-  *@param centList2    : Centroid coordinate list from the second image
-  *@param centList2Len : Number of centroids in the second list
+  *@param grid : Grid to be released.
   *
   *OUTPUTS
-  *@param Shift list containing x and y shift
+  *none
+  */
+void freeSpatialGrid(SpatialGrid *grid)
+{
+    free(grid->cellStart);
+    free(grid->items);
+    initSpatialGrid(grid);
+}
+
+/**
+  *@brief Grid cell of a point, clamped to the grid.
   */
-Shift* detectShift(Centroid *centList1,int centList1Len,Centroid *centList2,int centList2Len)
+static int gridCell(const SpatialGrid *grid,double x,double y)
 {
-    int i=0, smallCent=0;
-    double diffX=0.0, diffY=0.0;
+    int col = (int)((x - grid->minX) / grid->cellSize);
+    int row = (int)((y - grid->minY) / grid->cellSize);
+
+    if(col >= grid->cols)
+        col = grid->cols - 1;
+    if(row >= grid->rows)
+        row = grid->rows - 1;
+    return row * grid->cols + col;
+}
+
+/**
+  *@brief Bucket a list of points into a uniform grid with a counting sort.  The cell size is
+  *          enlarged when needed so the grid never has more than about four cells per point,
+  *          which keeps building and memory O(numPoints) however sparse the points are.
+  *
+  *INPUTS
+  *@param grid      : Grid to be (re)built.
+  *@param x         : x coordinates of the points, must stay valid while the grid is queried.
+  *@param y         : y coordinates of the points, must stay valid while the grid is queried.
+  *@param numPoints : Number of points.
+  *@param cellSize  : Requested cell size in pixels, normally the search radius.
+  *
+  *OUTPUTS
+  *@param 1 on success, -2 if memory could not be allocated.
+  */
+int buildSpatialGrid(SpatialGrid *grid,const double *x,const double *y,int numPoints,double cellSize)
+{
+    int i=0, cell=0, numCells=0;
+    int *buffer;
+    double maxX=0.0, maxY=0.0, maxCells=0.0;
+
+    grid->x = x;
+    grid->y = y;
+    grid->cols = 0;
+    grid->rows = 0;
+    if(numPoints <= 0)
+        return 1;
+
+    grid->minX = maxX = x[0];
+    grid->minY = maxY = y[0];
+    for(i=1; i<numPoints; i++)
+    {
+        if(x[i] < grid->minX)
+            grid->minX = x[i];
+        if(x[i] > maxX)
+            maxX = x[i];
+        if(y[i] < grid->minY)
+            grid->minY = y[i];
+        if(y[i] > maxY)
+            maxY = y[i];
+    }
+
+    if(cellSize < 1.0)
+        cellSize = 1.0;
+    maxCells = 4.0 * numPoints + 16.0;
+    while(((maxX - grid->minX) / cellSize + 1.0) * ((maxY - grid->minY) / cellSize + 1.0) > maxCells)
+    {
+        cellSize *= 2.0;
+    }
+    grid->cellSize = cellSize;
+    grid->cols = (int)((maxX - grid->minX) / cellSize) + 1;
+    grid->rows = (int)((maxY - grid->minY) / cellSize) + 1;
+    numCells = grid->cols * grid->rows;
+
+    if(numCells + 1 > grid->cellCapacity)
+    {
+        // realloc_buildSpatialGrid cellStart free in freeSpatialGrid
+        buffer = realloc(grid->cellStart, (numCells + 1) * sizeof(int));
+        if(buffer == NULL)
+            return -2;
+        grid->cellStart = buffer;
+        grid->cellCapacity = numCells + 1;
+    }
+    if(numPoints > grid->itemCapacity)
+    {
+        // realloc_buildSpatialGrid items free in freeSpatialGrid
+        buffer = realloc(grid->items, numPoints * sizeof(int));
+        if(buffer == NULL)
+            return -2;
+        grid->items = buffer;
+        grid->itemCapacity = numPoints;
+    }
+
+    // Count the points of every cell, turn the counts into cell ends and fill the cells back to
+    // front, which leaves cellStart[c] at the start of cell c and the points of a cell in order.
+    memset(grid->cellStart, 0, (numCells + 1) * sizeof(int));
+    for(i=0; i<numPoints; i++)
+    {
+        grid->cellStart[gridCell(grid, x[i], y[i])]++;
+    }
+    for(cell=1; cell<=numCells; cell++)
+    {
+        grid->cellStart[cell] += grid->cellStart[cell-1];
+    }
+    for(i=numPoints-1; i>=0; i--)
+    {
+        grid->items[--grid->cellStart[gridCell(grid, x[i], y[i])]] = i;
+    }
+
+    return 1;
+}
+
+/**
+  *@brief Find the indexed centroid nearest to a point within a search radius.  Ties are resolved
+  *          to the lowest index.
+  *
+  *INPUTS
+  *@param grid   : Grid built over the candidate centroids.
+  *@param x      : x coordinate of the query point.
+  *@param y      : y coordinate of the query point.
+  *@param radius : Search radius, candidates further away are ignored.
+  *@param skip   : Candidates with a nonzero entry are ignored, may be NULL.
+  *
+  *OUTPUTS
+  *@param distSq : Squared distance to the nearest candidate, may be NULL.
+  *@param Index of the nearest candidate, -1 if there is none within the radius.
+  */
+int nearestInGrid(const SpatialGrid *grid,double x,double y,double radius,const unsigned char *skip,double *distSq)
+{
+    int col=0, row=0, col0=0, col1=0, row0=0, row1=0, i=0, cell=0, index=0, best=-1;
+    double dx=0.0, dy=0.0, d=0.0, bestDist=radius*radius;
+
+    if(grid->cols == 0)
+        return -1;
+
+    col0 = (int)floor((x - radius - grid->minX) / grid->cellSize);
+    col1 = (int)floor((x + radius - grid->minX) / grid->cellSize);
+    row0 = (int)floor((y - radius - grid->minY) / grid->cellSize);
+    row1 = (int)floor((y + radius - grid->minY) / grid->cellSize);
+    if(col0 < 0)
+        col0 = 0;
+    if(row0 < 0)
+        row0 = 0;
+    if(col1 >= grid->cols)
+        col1 = grid->cols - 1;
+    if(row1 >= grid->rows)
+        row1 = grid->rows - 1;
+
+    for(row=row0; row<=row1; row++)
+    {
+        for(col=col0; col<=col1; col++)
+        {
+            cell = row * grid->cols + col;
+            for(i=grid->cellStart[cell]; i<grid->cellStart[cell+1]; i++)
+            {
+                index = grid->items[i];
+                if(skip != NULL && skip[index])
+                    continue;
+                dx = grid->x[index] - x;
+                dy = grid->y[index] - y;
+                d = dx*dx + dy*dy;
+                if(d < bestDist || (d == bestDist && (best < 0 || index < best)))
+                {
+                    bestDist = d;
+                    best = index;
+                }
+            }
+        }
+    }
+
+    if(distSq != NULL && best >= 0)
+        *distSq = bestDist;
+    return best;
+}
+
+/**
+  *@brief Free the per-particle arrays of a ShiftMatch filled by detectShift.
+  *
+  *INPUTS
+  *@param match : Match to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeShiftMatch(ShiftMatch *match)
+{
+    free(match->partner);
+    free(match->displacement);
+    match->partner = NULL;
+    match->displacement = NULL;
+}
+
+/**
+  *@brief Prepare an empty shift detection workspace.
+  *
+  *INPUTS
+  *@param detector : Workspace to be initialized.
+  *
+  *OUTPUTS
+  *none
+  */
+void initShiftDetector(ShiftDetector *detector)
+{
+    initSpatialGrid(&detector->grid1);
+    initSpatialGrid(&detector->grid2);
+}
+
+/**
+  *@brief Free the grids of a shift detection workspace.
+  *
+  *INPUTS
+  *@param detector : Workspace to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeShiftDetector(ShiftDetector *detector)
+{
+    freeSpatialGrid(&detector->grid1);
+    freeSpatialGrid(&detector->grid2);
+}
+
+/**
+  *@brief Detect shift between two lists of centroid coordinates.  A particle of the first frame
+  *          is matched to its nearest neighbour in the second frame when the two are mutual
+  *          nearest neighbours no more than gateRadius apart.  Both lists are indexed in uniform
+  *          grids with gateRadius cells, so matching takes O(n) expected time.
+  *
+  *INPUTS
+  *@param detector   : Workspace reused across frames.
+  *@param centList1  : Centroids from the first image
+  *@param centList2  : Centroids from the second image
+  *@param gateRadius : Largest displacement accepted for a match, in pixels
+  *
+  *OUTPUTS
+  *@param match : Per-particle matches and displacements and the match rate, may be NULL.
+  *               Free with freeShiftMatch.
+  *@param Mean x and y shift of the matched particles, 0 if nothing matched
+  */
+Shift* detectShift(ShiftDetector *detector,const CentroidTable *centList1,const CentroidTable *centList2,double gateRadius,ShiftMatch *match)
+{
+    int i=0, j=0, numMatched=0;
+    double diffX=0.0, diffY=0.0, sumX=0.0, sumY=0.0;
+    int *partner = NULL;
+    Shift *displacement = NULL;
     Shift *shift;
 
-    if(centList1Len <= centList2Len)
-        smallCent = centList1Len;
-    else
-        smallCent = centList2Len;
+    if(buildSpatialGrid(&detector->grid1, centList1->x, centList1->y, centList1->count, gateRadius) != 1 ||
+       buildSpatialGrid(&detector->grid2, centList2->x, centList2->y, centList2->count, gateRadius) != 1)
+    {
+        printf("Error: Cannot allocate shift detection memory.  Quitting program.");
+        exit(0);
+    }
+
+    if(match != NULL && centList1->count > 0)
+    {
+        // malloc_detectShift match arrays free in freeShiftMatch
+        partner = malloc(centList1->count * sizeof(int));
+        displacement = malloc(centList1->count * sizeof(Shift));
+        if(partner == NULL || displacement == NULL)
+        {
+            printf("Error: Cannot allocate shift detection memory.  Quitting program.");
+            exit(0);
+        }
+    }
+
+    for(i=0; i<centList1->count; i++)
+    {
+        j = nearestInGrid(&detector->grid2, centList1->x[i], centList1->y[i], gateRadius, NULL, NULL);
+        if(j >= 0 && nearestInGrid(&detector->grid1, centList2->x[j], centList2->y[j], gateRadius, NULL, NULL) != i)
+            j = -1;
 
-    //printf("\nSmallest amount of centroids between two images: %d\n",smallCent);
+        diffX = 0.0;
+        diffY = 0.0;
+        if(j >= 0)
+        {
+            diffX = centList2->x[j] - centList1->x[i];
+            diffY = centList2->y[j] - centList1->y[i];
+            sumX += diffX;
+            sumY += diffY;
+            numMatched++;
+        }
+        if(partner != NULL)
+        {
+            partner[i] = j;
+            displacement[i].x = diffX;
+            displacement[i].y = diffY;
+        }
+    }
 
     // Malloc_detectShift Shift* free in test_run.c
     shift = malloc(sizeof(Shift));
+    shift->x = numMatched > 0 ? sumX / numMatched : 0.0;
+    shift->y = numMatched > 0 ? sumY / numMatched : 0.0;
 
-    for(i=0; i<smallCent; i++)
+    if(match != NULL)
     {
-        diffX = centList2[i].x - centList1[i].x;
-        diffY = centList2[i].y - centList1[i].y;
+        match->numParticles = centList1->count;
+        match->numMatched = numMatched;
+        match->matchRate = centList1->count > 0 ? (double)numMatched / centList1->count : 0.0;
+        match->mean = *shift;
+        match->partner = partner;
+        match->displacement = displacement;
     }
 
-    shift->x = diffX / smallCent;
-    shift->y = diffY / smallCent;
+    return shift;
 
-    //printf("\nShift X: %f \nShift Y: %f\n",shift[1].x,shift[1].y);
+}
 
-    return shift;
 
+/**
+  *@brief Prepare an empty nearest neighbour density workspace.
+  *
+  *INPUTS
+  *@param density : Workspace to be initialized.
+  *
+  *OUTPUTS
+  *none
+  */
+void initNeighbourDensity(NeighbourDensity *density)
+{
+    initSpatialGrid(&density->grid);
+    density->skipCapacity = 0;
+    density->skip = NULL;
+}
+
+/**
+  *@brief Free the buffers of a nearest neighbour density workspace.
+  *
+  *INPUTS
+  *@param density : Workspace to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeNeighbourDensity(NeighbourDensity *density)
+{
+    freeSpatialGrid(&density->grid);
+    free(density->skip);
+    initNeighbourDensity(density);
 }
 
+/**
+  *@brief Particle density of a frame as the mean distance from every centroid to its nearest
+  *          neighbour.  Centroids are binned in a uniform grid of about one centroid per cell and
+  *          each neighbour search starts in the cells around its centroid, doubling the radius
+  *          until a neighbour is found, so a frame costs O(number of centroids) expected time.
+  *          A fast alternative to clustering the frame with kmeans for calcClusterDensity.
+  *
+  *INPUTS
+  *@param density : Workspace reused across frames.
+  *@param cents   : Centroids of the frame.
+  *
+  *OUTPUTS
+  *@param Mean nearest neighbour distance in pixels, 0 for fewer than two centroids.
+  */
+double calcNeighbourDensity(NeighbourDensity *density,const CentroidTable *cents)
+{
+    int i=0, numCents=cents->count;
+    double minX=0.0, minY=0.0, maxX=0.0, maxY=0.0, radius=0.0, distSq=0.0, sum=0.0;
+    unsigned char *skip;
+
+    if(numCents < 2)
+        return 0.0;
+
+    if(numCents > density->skipCapacity)
+    {
+        // realloc_calcNeighbourDensity skip free in freeNeighbourDensity
+        skip = realloc(density->skip, numCents * sizeof(unsigned char));
+        if(skip == NULL)
+        {
+            printf("Error: Cannot allocate density memory.  Quitting program.");
+            exit(0);
+        }
+        density->skip = skip;
+        density->skipCapacity = numCents;
+    }
+    memset(density->skip, 0, numCents);
+
+    minX = maxX = cents->x[0];
+    minY = maxY = cents->y[0];
+    for(i=1; i<numCents; i++)
+    {
+        minX = cents->x[i] < minX ? cents->x[i] : minX;
+        maxX = cents->x[i] > maxX ? cents->x[i] : maxX;
+        minY = cents->y[i] < minY ? cents->y[i] : minY;
+        maxY = cents->y[i] > maxY ? cents->y[i] : maxY;
+    }
+    if(buildSpatialGrid(&density->grid, cents->x, cents->y, numCents,
+                        sqrt((maxX - minX) * (maxY - minY) / numCents)) != 1)
+    {
+        printf("Error: Cannot allocate density memory.  Quitting program.");
+        exit(0);
+    }
+
+    for(i=0; i<numCents; i++)
+    {
+        density->skip[i] = 1;
+        radius = density->grid.cellSize;
+        while(nearestInGrid(&density->grid, cents->x[i], cents->y[i], radius, density->skip, &distSq) < 0)
+        {
+            radius *= 2.0;
+        }
+        density->skip[i] = 0;
+        sum += sqrt(distSq);
+    }
+
+    return sum / numCents;
+}
@@ -13,16 +13,32 @@ Arizona State University
 #ifndef CENTROID_H_INCLUDED
 #define CENTROID_H_INCLUDED
 
-typedef struct Centroid {
-    int x;
-    int y;
-    int kGroup;
+#include <stddef.h>
+
+// Particle centroids of one frame and their k-means clustering, stored as parallel arrays.
+// kGroup[i] is the cluster of centroid i and clusterDist[i] its distance to that cluster's center.
+// distances is an optional count x k row-major matrix, reserved with reserveDistances for the
+// exhaustive k-means, CENTDIST(t, i, c) is the distance from centroid i to cluster center c.
+// Buffers only grow, so a table reused across frames stops allocating once it has seen the
+// largest frame.
+typedef struct CentroidTable {
+    int count;
+    int k;
+    int capacity;
+    size_t distanceCapacity;
+    double *x;
+    double *y;
+    int *kGroup;
+    double *clusterDist;
     double *distances;
-}Centroid;
+}CentroidTable;
+
+#define CENTDIST(t, i, c) ((t)->distances[(size_t)(i)*(t)->k + (c)])
 
+// K-means cluster center
 typedef struct RandomCentroid{
-    int x;
-    int y;
+    double x;
+    double y;
 }RandomCentroid;
 
 typedef struct Shift{
@@ -30,7 +46,72 @@ typedef struct Shift{
     double y;
 }Shift;
 
-Centroid* createCents(int numCents,int k);
-Shift* detectShift(Centroid *cents1,int numCent1,Centroid *cents2,int numCent2);
+// Uniform grid over a list of centroids for nearest neighbour queries.  Point indices are
+// stored sorted by cell, cell c holds items[cellStart[c]] to items[cellStart[c+1]-1].
+typedef struct SpatialGrid{
+    const double *x;
+    const double *y;
+    double minX;
+    double minY;
+    double cellSize;
+    int cols;
+    int rows;
+    int cellCapacity;
+    int *cellStart;
+    int itemCapacity;
+    int *items;
+}SpatialGrid;
+
+// Particle density scalar of a frame.  DENSITY_KMEANS is the mean distance of every centroid to
+// its k-means cluster center, DENSITY_NEAREST_NEIGHBOUR the mean distance of every centroid to
+// its nearest neighbour, found without clustering.
+typedef enum DensityMode{
+    DENSITY_KMEANS,
+    DENSITY_NEAREST_NEIGHBOUR
+}DensityMode;
+
+// Workspace of calcNeighbourDensity, reused across frames.  skip marks the centroid whose
+// neighbour is being searched for.
+typedef struct NeighbourDensity{
+    SpatialGrid grid;
+    int skipCapacity;
+    unsigned char *skip;
+}NeighbourDensity;
+
+// Workspace of detectShift, reused across frames.  grid1 and grid2 index the first and second
+// list of centroids.
+typedef struct ShiftDetector{
+    SpatialGrid grid1;
+    SpatialGrid grid2;
+}ShiftDetector;
+
+// Frame to frame correspondence found by detectShift
+//   partner      : index in the second list matched to each particle of the first list, -1 if none
+//   displacement : position in the second frame minus position in the first, 0 if unmatched
+//   matchRate    : numMatched / numParticles
+typedef struct ShiftMatch{
+    int numParticles;
+    int numMatched;
+    double matchRate;
+    Shift mean;
+    int *partner;
+    Shift *displacement;
+}ShiftMatch;
+
+void initCentroidTable(CentroidTable *cents);
+int reserveCentroids(CentroidTable *cents,int numCents,int k);
+int reserveDistances(CentroidTable *cents);
+void freeCentroidTable(CentroidTable *cents);
+void initSpatialGrid(SpatialGrid *grid);
+int buildSpatialGrid(SpatialGrid *grid,const double *x,const double *y,int numPoints,double cellSize);
+int nearestInGrid(const SpatialGrid *grid,double x,double y,double radius,const unsigned char *skip,double *distSq);
+void freeSpatialGrid(SpatialGrid *grid);
+void freeShiftMatch(ShiftMatch *match);
+void initShiftDetector(ShiftDetector *detector);
+void freeShiftDetector(ShiftDetector *detector);
+Shift* detectShift(ShiftDetector *detector,const CentroidTable *cents1,const CentroidTable *cents2,double gateRadius,ShiftMatch *match);
+void initNeighbourDensity(NeighbourDensity *density);
+void freeNeighbourDensity(NeighbourDensity *density);
+double calcNeighbourDensity(NeighbourDensity *density,const CentroidTable *cents);
 
 #endif // CENTROID_H_INCLUDED
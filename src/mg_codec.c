@@ -0,0 +1,947 @@
+/*
+Primary accretion detection algorithm.
+
+Lossless image codec and downlink packetizer.  Pixels are predicted from their left, upper
+and upper-left neighbours with the median edge detector (MED) of LOCO-I and the residuals are
+Rice coded in blocks, each block with its own Rice parameter.  Delta packets may instead
+predict a block from the same pixels of the previous image.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "mg.h"
+#include "mg_image.h"
+#include "mg_simd.h"
+#include "mg_codec.h"
+
+// Residuals are mapped to 0-255 and Rice coded, unary prefixes of CODEC_RICE_LIMIT zeros escape
+// to the raw mapped residual.  The Rice parameter of a block of CODEC_BLOCK_SIZE residuals is
+// floor(log2) of their mean, at most CODEC_MAX_RICE_PARAMETER, and leads the block in
+// CODEC_PARAMETER_BITS bits.  In delta packets a mode bit precedes it, set when the block is
+// predicted from the reference image.
+#define CODEC_BLOCK_SIZE 16
+#define CODEC_RICE_LIMIT 16
+#define CODEC_PARAMETER_BITS 3
+#define CODEC_MAX_RICE_PARAMETER 7
+#define CODEC_MODE_BITS 1
+#define CODEC_DELTA_BLOCK (1 << CODEC_PARAMETER_BITS)
+
+// A block that does not fit is rolled back after being written, at most its worst case size
+// plus the eight bytes putBits always stores
+#define CODEC_SPILL ((CODEC_MODE_BITS + CODEC_PARAMETER_BITS + CODEC_BLOCK_SIZE * (CODEC_RICE_LIMIT + 8) + 7) / 8 + 8)
+
+#define CODEC_CRC_OFFSET 32
+
+static int crcTableReady = 0;
+static unsigned short crcTable[4][256];
+
+// Most significant bit first bit packing
+typedef struct BitWriter{
+    unsigned char *out;
+    unsigned long long acc;
+    int bits;
+}BitWriter;
+
+typedef struct BitReader{
+    const unsigned char *in;
+    int length;
+    int pos;
+    unsigned long long acc;
+    int bits;
+}BitReader;
+
+/**
+  *@brief Fill the CRC-16/CCITT tables, polynomial 0x1021, on first use.  crcTable[n][x] is the
+  *          CRC contribution of byte x followed by n zero bytes, so four bytes are folded in per
+  *          step instead of one.
+  */
+static void buildCRCTable(void){
+
+    int i=0, j=0;
+    unsigned int crc=0;
+
+    if(crcTableReady)
+        return;
+
+    for(i = 0; i < 256; i++){
+        crc = (unsigned int)i << 8;
+        for(j = 0; j < 8; j++){
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        crcTable[0][i] = (unsigned short)(crc & 0xFFFF);
+    }
+    for(j = 1; j < 4; j++){
+        for(i = 0; i < 256; i++){
+            crc = crcTable[j-1][i];
+            crcTable[j][i] = (unsigned short)(((crc << 8) ^ crcTable[0][crc >> 8]) & 0xFFFF);
+        }
+    }
+    crcTableReady = 1;
+}
+
+static unsigned int crc16(const unsigned char *data, int length, unsigned int crc){
+
+    int i=0;
+
+    for(; i + 4 <= length; i += 4){
+        crc = crcTable[3][(crc >> 8) ^ data[i]] ^ crcTable[2][(crc & 0xFF) ^ data[i+1]] ^
+              crcTable[1][data[i+2]] ^ crcTable[0][data[i+3]];
+    }
+    for(; i < length; i++){
+        crc = ((crc << 8) ^ crcTable[0][((crc >> 8) ^ data[i]) & 0xFF]) & 0xFFFF;
+    }
+    return crc;
+}
+
+/**
+  *@brief CRC of a packet's header and payload, taken with the CRC field zero.
+  */
+static unsigned int packetCRC(const unsigned char *packet, int payload){
+
+    static const unsigned char zero[2] = {0, 0};
+    unsigned int crc = 0;
+
+    buildCRCTable();
+    crc = crc16(packet, CODEC_CRC_OFFSET, 0xFFFF);
+    crc = crc16(zero, 2, crc);
+    return crc16(packet + CODEC_HEADER_SIZE, payload, crc);
+}
+
+/**
+  *@brief CRC-16/CCITT, as used by the packet headers, of any block of bytes.
+  *
+  *INPUTS
+  *@param data   : Bytes to be checked.
+  *@param length : Number of bytes.
+  *
+  *OUTPUTS
+  *@param CRC of the bytes.
+  */
+unsigned int codecCRC(const unsigned char *data, int length){
+
+    buildCRCTable();
+    return crc16(data, length, 0xFFFF);
+}
+
+static void put16(unsigned char *p, int value){
+
+    p[0] = (unsigned char)(value >> 8);
+    p[1] = (unsigned char)value;
+}
+
+static void put32(unsigned char *p, int value){
+
+    put16(p, (int)((unsigned int)value >> 16));
+    put16(p + 2, value & 0xFFFF);
+}
+
+static int get16(const unsigned char *p){
+
+    return (p[0] << 8) | p[1];
+}
+
+static int get32(const unsigned char *p){
+
+    return (int)(((unsigned int)get16(p) << 16) | (unsigned int)get16(p + 2));
+}
+
+/**
+  *@brief Append count bits, at most 56.  Every call stores the eight bytes at out and advances
+  *          past the whole bytes written, which avoids an unpredictable branch per pixel and lets
+  *          the compiler merge the stores into one.
+  */
+static void putBits(BitWriter *w, unsigned long long value, int count){
+
+    unsigned long long word = 0;
+
+    w->acc = (w->acc << count) | value;
+    w->bits += count;
+    word = w->acc << (64 - w->bits);
+    w->out[0] = (unsigned char)(word >> 56);
+    w->out[1] = (unsigned char)(word >> 48);
+    w->out[2] = (unsigned char)(word >> 40);
+    w->out[3] = (unsigned char)(word >> 32);
+    w->out[4] = (unsigned char)(word >> 24);
+    w->out[5] = (unsigned char)(word >> 16);
+    w->out[6] = (unsigned char)(word >> 8);
+    w->out[7] = (unsigned char)word;
+    w->out += w->bits >> 3;
+    w->bits &= 7;
+}
+
+static void flushBits(BitWriter *w){
+
+    while(w->bits >= 8){
+        w->bits -= 8;
+        *w->out++ = (unsigned char)(w->acc >> w->bits);
+    }
+    if(w->bits > 0){
+        *w->out++ = (unsigned char)(w->acc << (8 - w->bits));
+        w->bits = 0;
+    }
+}
+
+/**
+  *@brief Make at least 57 bits available, reading zeros past the end of the payload.
+  */
+static void fillBits(BitReader *r){
+
+    while(r->bits <= 56){
+        if(r->pos < r->length)
+            r->acc |= (unsigned long long)r->in[r->pos] << (56 - r->bits);
+        r->pos++;
+        r->bits += 8;
+    }
+}
+
+/**
+  *@brief Read the count bits leading a block, its mode and Rice parameter.
+  */
+static int readParameter(BitReader *r, int count){
+
+    int k = 0;
+
+    fillBits(r);
+    k = (int)(r->acc >> (64 - count));
+    r->acc <<= count;
+    r->bits -= count;
+    return k;
+}
+
+/**
+  *@brief Read one Rice coded residual.
+  *
+  *INPUTS
+  *@param r : Reader positioned at the code.
+  *@param k : Rice parameter of the block.
+  *
+  *OUTPUTS
+  *@param Mapped residual, above 255 if the code is damaged.
+  */
+static unsigned int readResidual(BitReader *r, int k){
+
+    int q = 0;
+    unsigned int m = 0;
+
+    fillBits(r);
+    while(q < CODEC_RICE_LIMIT && !(r->acc >> 63)){
+        r->acc <<= 1;
+        q++;
+    }
+    if(q == CODEC_RICE_LIMIT){
+        m = (unsigned int)(r->acc >> 56);
+        r->acc <<= 8;
+        r->bits -= CODEC_RICE_LIMIT + 8;
+        return m;
+    }
+
+    r->acc <<= 1;
+    m = (unsigned int)q << k;
+    if(k > 0){
+        m |= (unsigned int)(r->acc >> (64 - k));
+        r->acc <<= k;
+    }
+    r->bits -= q + 1 + k;
+    return m;
+}
+
+/**
+  *@brief Median edge detector.  Picks the smaller or larger of the left and upper neighbours
+  *          across an edge and the planar estimate a + b - c elsewhere.  Written as selects so
+  *          the compiler can avoid branching on noisy pixels.
+  */
+static int medPredict(int a, int b, int c){
+
+    int mx = a > b ? a : b;
+    int mn = a > b ? b : a;
+    int p = a + b - c;
+
+    p = c <= mn ? mx : p;
+    p = c >= mx ? mn : p;
+    return p;
+}
+
+/**
+  *@brief Prediction error modulo 256, mapped from 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+  */
+static unsigned int mapResidual(int value, int predicted){
+
+    int e = ((value - predicted + 128) & 0xFF) - 128;
+
+    return (2 * (unsigned int)e) ^ (0u - (unsigned int)(e < 0));
+}
+
+/**
+  *@brief Pixel value from its prediction and mapped residual, the inverse of mapResidual.
+  */
+static int unmapResidual(unsigned int m, int predicted){
+
+    if(m & 1)
+        return (predicted - (int)((m + 1) >> 1)) & 0xFF;
+    return (predicted + (int)(m >> 1)) & 0xFF;
+}
+
+/**
+  *@brief Mapped residuals of a row, predicted only from pixels of the packet.  Pixels of the
+  *          packet's first row are predicted from their left neighbour, as are those of the second
+  *          row up to the packet's first column.  The first pixel of a row is predicted from its
+  *          upper neighbour, or as 0 if that precedes the packet.
+  *
+  *INPUTS
+  *@param image       : Image being coded.
+  *@param y           : Row to be predicted.
+  *@param x           : First column to be predicted.
+  *@param firstRow    : Row of the packet's first pixel.
+  *@param firstColumn : Column of the packet's first pixel.
+  *
+  *OUTPUTS
+  *@param mapped : Mapped residuals of columns x to width-1.
+  */
+static void predictPacketRow(const PGMImage *image, int y, int x, int firstRow, int firstColumn, unsigned char *mapped){
+
+    int j=0, width = image->header.width;
+    const unsigned char *row = PGMROW(image, y);
+    const unsigned char *up = PGMROW(image, y > 0 ? y - 1 : 0);
+
+    if(y == firstRow){
+        mapped[x] = (unsigned char)mapResidual(row[x], 0);
+        for(j = x + 1; j < width; j++){
+            mapped[j] = (unsigned char)mapResidual(row[j], row[j-1]);
+        }
+    }
+    else if(y == firstRow + 1 && firstColumn > 0){
+        mapped[0] = (unsigned char)mapResidual(row[0], 0);
+        for(j = 1; j <= firstColumn; j++){
+            mapped[j] = (unsigned char)mapResidual(row[j], row[j-1]);
+        }
+        predictRow(row + firstColumn, up + firstColumn, width - firstColumn, mapped + firstColumn);
+    }
+    else {
+        mapped[0] = (unsigned char)mapResidual(row[0], up[0]);
+        predictRow(row, up, width, mapped);
+    }
+}
+
+/**
+  *@brief Rice code of a mapped residual, or the escape if its quotient reaches CODEC_RICE_LIMIT.
+  *          Selects rather than branches, escapes are rare but unpredictable.
+  *
+  *INPUTS
+  *@param m : Mapped residual.
+  *@param k : Rice parameter.
+  *
+  *OUTPUTS
+  *@param count : Length of the code in bits, at most CODEC_RICE_LIMIT + 8.
+  *@param Code bits.
+  */
+static unsigned int riceCode(unsigned int m, int k, int *count){
+
+    unsigned int q = m >> k;
+    int escape = q >= CODEC_RICE_LIMIT;
+
+    *count = escape ? CODEC_RICE_LIMIT + 8 : (int)q + 1 + k;
+    return escape ? m : (1u << k) | (m & ((1u << k) - 1));
+}
+
+/**
+  *@brief Rice parameter of a block of mapped residuals, k = floor(log2(mean)).
+  */
+static int riceParameter(const unsigned char *mapped, int n){
+
+    int j=0, k=0, sum=0;
+
+    for(j = 0; j < n; j++){
+        sum += mapped[j];
+    }
+    // Counted rather than searched, the loop exit would be mispredicted on most blocks
+    for(j = 1; j <= CODEC_MAX_RICE_PARAMETER; j++){
+        k += (n << j) <= sum;
+    }
+    return k;
+}
+
+/**
+  *@brief Size in bits of a block's Rice codes, not counting escapes.
+  */
+static int riceBits(const unsigned char *mapped, int n, int k){
+
+    int j=0, bits = n * (k + 1);
+
+    for(j = 0; j < n; j++){
+        bits += mapped[j] >> k;
+    }
+    return bits;
+}
+
+/**
+  *@brief Rice code a block of mapped residuals.  Codes are written in pairs, which halves the
+  *          serial work on the bit writer.
+  *
+  *INPUTS
+  *@param w        : Bit writer.
+  *@param mapped   : Mapped residuals of the block.
+  *@param n        : Number of residuals.
+  *@param k        : Rice parameter.
+  *@param lead     : Mode and parameter bits leading the block.
+  *@param leadBits : Number of lead bits.
+  *
+  *OUTPUTS
+  *none
+  */
+static void encodeBlock(BitWriter *w, const unsigned char *mapped, int n, int k, unsigned int lead, int leadBits){
+
+    int j=0, count1=0, count2=0;
+    unsigned int code1=0, code2=0;
+
+    for(j = 0; j < n; j += 2){
+        code1 = riceCode(mapped[j], k, &count1);
+        if(j == 0){
+            // The lead bits go with the first pair
+            code1 |= lead << count1;
+            count1 += leadBits;
+        }
+        code2 = 0;
+        count2 = 0;
+        if(j + 1 < n)
+            code2 = riceCode(mapped[j+1], k, &count2);
+        putBits(w, ((unsigned long long)code1 << count2) | code2, count1 + count2);
+    }
+}
+
+/**
+  *@brief View of a rectangle of an image as an image of its own, sharing the pixels.
+  */
+static void rectView(const PGMImage *image, const CodecRect *rect, PGMImage *tile){
+
+    tile->header = image->header;
+    tile->header.width = rect->width;
+    tile->header.height = rect->height;
+    tile->stride = image->stride;
+    tile->pixels = image->pixels + (size_t)rect->y * image->stride + rect->x;
+    tile->mapBase = NULL;
+    tile->mapLength = 0;
+}
+
+/**
+  *@brief Check that the rectangles lie inside the image and give the raster index, in the
+  *          concatenation of the rectangles, at which each one starts.
+  *
+  *INPUTS
+  *@param image    : 8-bit image.
+  *@param rects    : Rectangles of the image.
+  *@param numRects : Number of rectangles.
+  *
+  *OUTPUTS
+  *@param starts : numRects + 1 entries, the last one the total number of pixels.
+  *@param 1 if the rectangles are valid, 0 otherwise.
+  */
+static int rectStarts(const PGMImage *image, const CodecRect *rects, int numRects, long long *starts){
+
+    int i=0;
+
+    starts[0] = 0;
+    for(i = 0; i < numRects; i++){
+        if(rects[i].x < 0 || rects[i].y < 0 || rects[i].width <= 0 || rects[i].height <= 0 ||
+           rects[i].width > image->header.width - rects[i].x || rects[i].height > image->header.height - rects[i].y)
+            return 0;
+        starts[i+1] = starts[i] + (long long)rects[i].width * rects[i].height;
+    }
+    return starts[numRects] <= INT_MAX;
+}
+
+/**
+  *@brief Code consecutive pixels into one packet payload until the last rectangle ends or the
+  *          next block does not fit.  A run reaching the end of a rectangle carries on with the
+  *          next one, whose prediction restarts as at the top of an image.  Each row is predicted
+  *          in one pass and Rice coded in a second one.  With a reference, every block is coded
+  *          from whichever of the spatial and reference residuals takes fewer bits.  The block
+  *          that does not fit is rolled back and may have written CODEC_SPILL bytes past the
+  *          payload.
+  *
+  *INPUTS
+  *@param stream    : Stream providing the row buffers.
+  *@param tiles     : Views of the rectangles being coded.
+  *@param reference : Views of the same rectangles of the reference image, NULL for none.
+  *@param numTiles  : Number of rectangles.
+  *@param tile      : Rectangle holding the first pixel of the packet.
+  *@param first     : Raster index of the first pixel of the packet within that rectangle.
+  *@param payload   : Payload of the packet.
+  *@param capacity  : Payload capacity in bytes.
+  *
+  *OUTPUTS
+  *@param payloadBytes : Number of payload bytes used.
+  *@param Number of pixels coded.
+  */
+static int encodeRun(PacketStream *stream, const PGMImage *tiles, const PGMImage *reference, int numTiles, int tile,
+                     int first, unsigned char *payload, int capacity, int *payloadBytes){
+
+    int width = tiles[tile].header.width, height = tiles[tile].header.height;
+    int x = first % width, y = first / width;
+    int firstRow = y, firstColumn = x, n=0, k=0, kd=0, pixels=0, full=0;
+    int leadBits = reference != NULL ? CODEC_MODE_BITS + CODEC_PARAMETER_BITS : CODEC_PARAMETER_BITS;
+    unsigned int lead=0;
+    long long capacityBits = (long long)capacity * 8;
+    unsigned char *mapped = stream->mapped;
+    unsigned char *delta = stream->mapped + stream->rowCapacity;
+    unsigned char *block;
+    BitWriter w, saved;
+
+    w.out = payload;
+    w.acc = 0;
+    w.bits = 0;
+
+    while(!full){
+        if(y == height){
+            if(++tile == numTiles)
+                break;
+            width = tiles[tile].header.width;
+            height = tiles[tile].header.height;
+            x = y = firstRow = firstColumn = 0;
+        }
+        predictPacketRow(&tiles[tile], y, x, firstRow, firstColumn, mapped);
+        if(reference != NULL)
+            deltaRow(PGMROW(&tiles[tile], y) + x, PGMROW(&reference[tile], y) + x, width - x, delta + x);
+        for(; x < width; x += n){
+            n = width - x < CODEC_BLOCK_SIZE ? width - x : CODEC_BLOCK_SIZE;
+            saved = w;
+            block = mapped + x;
+            k = riceParameter(block, n);
+            lead = (unsigned int)k;
+            if(reference != NULL){
+                kd = riceParameter(delta + x, n);
+                if(riceBits(delta + x, n, kd) < riceBits(block, n, k)){
+                    block = delta + x;
+                    k = kd;
+                    lead = CODEC_DELTA_BLOCK | (unsigned int)kd;
+                }
+            }
+            // A single call site keeps the bit writer inlined
+            encodeBlock(&w, block, n, k, lead, leadBits);
+            if((long long)(w.out - payload) * 8 + w.bits > capacityBits){
+                w = saved;
+                full = 1;
+                break;
+            }
+            pixels += n;
+        }
+        if(x == width){
+            x = 0;
+            y++;
+        }
+    }
+
+    flushBits(&w);
+    *payloadBytes = (int)(w.out - payload);
+    return pixels;
+}
+
+/**
+  *@brief Prepare an empty packet stream.
+  *
+  *INPUTS
+  *@param stream     : Stream to be initialized.
+  *@param packetSize : Size of every packet, CODEC_MIN_PACKET_SIZE to CODEC_MAX_PACKET_SIZE bytes.
+  *
+  *OUTPUTS
+  *none
+  */
+void initPacketStream(PacketStream *stream, int packetSize){
+
+    if(packetSize < CODEC_MIN_PACKET_SIZE)
+        packetSize = CODEC_MIN_PACKET_SIZE;
+    if(packetSize > CODEC_MAX_PACKET_SIZE)
+        packetSize = CODEC_MAX_PACKET_SIZE;
+    stream->packetSize = packetSize;
+    stream->numPackets = 0;
+    stream->capacity = 0;
+    stream->data = NULL;
+    stream->rowCapacity = 0;
+    stream->mapped = NULL;
+}
+
+void freePacketStream(PacketStream *stream){
+
+    free(stream->data);
+    free(stream->mapped);
+    initPacketStream(stream, stream->packetSize);
+}
+
+/**
+  *@brief Code rectangles of an image into packets, see encodeRects.  With a reference image the
+  *          packets are delta packets.
+  */
+static int encodeStream(PacketStream *stream, const PGMImage *image, const PGMImage *reference,
+                        const CodecRect *rects, int numRects, int imageNumber){
+
+    int i=0, tile=0, first=0, local=0, pixels=0, payload=0, total=0, count=0, maxWidth=1;
+    int width = image->header.width, height = image->header.height;
+    size_t needed = 0, capacity = 0;
+    unsigned char *packet, *grown;
+
+    stream->numPackets = 0;
+    if(PGMIS16BIT(image) || width <= 0 || height <= 0 || width > 65535 || height > 65535 || numRects < 0)
+        return -1;
+
+    PGMImage tiles[numRects > 0 ? numRects : 1];
+    PGMImage referenceTiles[numRects > 0 ? numRects : 1];
+    long long starts[numRects + 1];
+
+    if(!rectStarts(image, rects, numRects, starts))
+        return -1;
+    total = (int)starts[numRects];
+    for(i = 0; i < numRects; i++){
+        rectView(image, &rects[i], &tiles[i]);
+        if(reference != NULL)
+            rectView(reference, &rects[i], &referenceTiles[i]);
+        maxWidth = rects[i].width > maxWidth ? rects[i].width : maxWidth;
+    }
+
+    if(maxWidth > stream->rowCapacity){
+        // malloc_encodeStream mapped free in freePacketStream
+        free(stream->mapped);
+        stream->mapped = malloc(2 * (size_t)maxWidth);
+        if(stream->mapped == NULL){
+            printf("Error: Cannot allocate packet memory.  Quitting program.");
+            exit(0);
+        }
+        stream->rowCapacity = maxWidth;
+    }
+
+    while(first < total){
+        needed = (size_t)(count + 1) * stream->packetSize + CODEC_SPILL;
+        if(needed > stream->capacity){
+            capacity = stream->capacity > 0 ? stream->capacity : (size_t)stream->packetSize * 16;
+            while(capacity < needed){
+                capacity *= 2;
+            }
+            // realloc_encodeStream data free in freePacketStream
+            grown = realloc(stream->data, capacity);
+            if(grown == NULL){
+                printf("Error: Cannot allocate packet memory.  Quitting program.");
+                exit(0);
+            }
+            stream->data = grown;
+            stream->capacity = capacity;
+        }
+
+        packet = stream->data + (size_t)count * stream->packetSize;
+        pixels = encodeRun(stream, tiles, reference != NULL ? referenceTiles : NULL, numRects, tile, local,
+                           packet + CODEC_HEADER_SIZE, stream->packetSize - CODEC_HEADER_SIZE, &payload);
+        memset(packet + CODEC_HEADER_SIZE + payload, 0, stream->packetSize - CODEC_HEADER_SIZE - payload);
+
+        packet[0] = 'M';
+        packet[1] = reference != NULL ? 'D' : 'G';
+        packet[2] = CODEC_VERSION;
+        packet[3] = (unsigned char)image->header.grayscale;
+        put16(packet + 4, stream->packetSize);
+        put32(packet + 6, imageNumber);
+        put32(packet + 10, count);
+        put16(packet + 18, width);
+        put16(packet + 20, height);
+        put32(packet + 22, first);
+        put32(packet + 26, pixels);
+        put16(packet + 30, payload);
+
+        first += pixels;
+        while(tile < numRects && first >= starts[tile+1]){
+            tile++;
+        }
+        local = tile < numRects ? first - (int)starts[tile] : 0;
+        count++;
+    }
+
+    // The packet count is known once the image is coded
+    for(i = 0; i < count; i++){
+        packet = stream->data + (size_t)i * stream->packetSize;
+        put32(packet + 14, count);
+        put16(packet + CODEC_CRC_OFFSET, 0);
+        put16(packet + CODEC_CRC_OFFSET, (int)packetCRC(packet, get16(packet + 30)));
+    }
+
+    stream->numPackets = count;
+    return count;
+}
+
+/**
+  *@brief Losslessly code an 8-bit image into fixed size downlink packets.  Each packet holds
+  *          as many consecutive pixels as fit and is decodable on its own.
+  *
+  *INPUTS
+  *@param stream      : Stream receiving the packets, replacing its previous contents.
+  *@param image       : Image to be coded.
+  *@param imageNumber : Image number written to every packet header.
+  *
+  *OUTPUTS
+  *@param Number of packets, -1 if the image is not an 8-bit image of at most 65535x65535 pixels.
+  */
+int encodePackets(PacketStream *stream, const PGMImage *image, int imageNumber){
+
+    CodecRect frame;
+
+    frame.x = 0;
+    frame.y = 0;
+    frame.width = image->header.width;
+    frame.height = image->header.height;
+    return encodeRects(stream, image, &frame, 1, imageNumber);
+}
+
+/**
+  *@brief Losslessly code rectangles of an 8-bit image into fixed size downlink packets.  The
+  *          rectangles are coded one after the other as a single run of pixels, so a packet may
+  *          span several of them and only the last packet is padded.  Each packet is decodable
+  *          on its own given the same rectangles.  Packet headers carry the size of the whole
+  *          image, first pixel and pixel counts index the concatenated rectangles.
+  *
+  *INPUTS
+  *@param stream      : Stream receiving the packets, replacing its previous contents.
+  *@param image       : Image holding the rectangles.
+  *@param rects       : Rectangles to be coded, inside the image.
+  *@param numRects    : Number of rectangles, 0 codes no packet.
+  *@param imageNumber : Image number written to every packet header.
+  *
+  *OUTPUTS
+  *@param Number of packets, -1 if the image is not an 8-bit image of at most 65535x65535 pixels
+  *          or a rectangle lies outside it.
+  */
+int encodeRects(PacketStream *stream, const PGMImage *image, const CodecRect *rects, int numRects, int imageNumber){
+
+    return encodeStream(stream, image, NULL, rects, numRects, imageNumber);
+}
+
+/**
+  *@brief Losslessly code an 8-bit image into delta packets against the image before it.  Each
+  *          block of pixels is predicted either within the image, as by encodePackets, or from
+  *          the same pixels of the reference, whichever codes smaller.  A packet is decodable on
+  *          its own once the reference has been rebuilt.
+  *
+  *INPUTS
+  *@param stream      : Stream receiving the packets, replacing its previous contents.
+  *@param image       : Image to be coded.
+  *@param reference   : Image imageNumber - 1, of the same size.
+  *@param imageNumber : Image number written to every packet header.
+  *
+  *OUTPUTS
+  *@param Number of packets, -1 if the images are not 8-bit images of the same size of at most
+  *          65535x65535 pixels.
+  */
+int encodeDelta(PacketStream *stream, const PGMImage *image, const PGMImage *reference, int imageNumber){
+
+    CodecRect frame;
+
+    stream->numPackets = 0;
+    if(PGMIS16BIT(reference) || reference->header.width != image->header.width ||
+       reference->header.height != image->header.height)
+        return -1;
+    frame.x = 0;
+    frame.y = 0;
+    frame.width = image->header.width;
+    frame.height = image->header.height;
+    return encodeStream(stream, image, reference, &frame, 1, imageNumber);
+}
+
+/**
+  *@brief Parse and check the header of a packet.
+  *
+  *INPUTS
+  *@param packet : Packet bytes.
+  *@param length : Number of bytes available at packet.
+  *
+  *OUTPUTS
+  *@param header : Header fields.
+  *@param 1 if the packet is complete and its CRC matches, 0 otherwise.
+  */
+int readPacketHeader(const unsigned char *packet, int length, PacketHeader *header){
+
+    if(length < CODEC_HEADER_SIZE || packet[0] != 'M' || (packet[1] != 'G' && packet[1] != 'D') ||
+       packet[2] != CODEC_VERSION)
+        return 0;
+
+    header->delta = packet[1] == 'D';
+    header->maxval = packet[3];
+    header->packetSize = get16(packet + 4);
+    header->image = get32(packet + 6);
+    header->index = get32(packet + 10);
+    header->count = get32(packet + 14);
+    header->width = get16(packet + 18);
+    header->height = get16(packet + 20);
+    header->first = get32(packet + 22);
+    header->pixels = get32(packet + 26);
+    header->payload = get16(packet + 30);
+
+    if(header->packetSize < CODEC_MIN_PACKET_SIZE || header->packetSize > length ||
+       header->payload > header->packetSize - CODEC_HEADER_SIZE ||
+       header->index < 0 || header->index >= header->count)
+        return 0;
+    return packetCRC(packet, header->payload) == (unsigned int)get16(packet + CODEC_CRC_OFFSET);
+}
+
+/**
+  *@brief Decode one packet coded by encodeStream, a delta packet if and only if reference is set.
+  */
+static int decodeStream(const unsigned char *packet, int length, PGMImage *image, const PGMImage *reference,
+                        const CodecRect *rects, int numRects){
+
+    int i=0, j=0, n=0, k=0, x=0, y=0, p=0, width=0, height=0, end=0, tile=0;
+    int firstRow=0, firstColumn=0, leftOnly=0, damaged=0, leadBits=0, fromReference=0;
+    unsigned int m=0;
+    unsigned char *row, *up;
+    const unsigned char *ref = NULL;
+    PacketHeader header;
+    BitReader r;
+
+    if(readPacketHeader(packet, length, &header) != 1)
+        return 0;
+    if(PGMIS16BIT(image) || header.width != image->header.width || header.height != image->header.height ||
+       numRects <= 0 || header.delta != (reference != NULL))
+        return 0;
+
+    PGMImage tiles[numRects];
+    PGMImage referenceTiles[numRects];
+    long long starts[numRects + 1];
+
+    if(!rectStarts(image, rects, numRects, starts) || header.first < 0 || header.pixels < 0 ||
+       (long long)header.first + header.pixels > starts[numRects])
+        return 0;
+    for(tile = 0; tile < numRects; tile++){
+        rectView(image, &rects[tile], &tiles[tile]);
+        if(reference != NULL)
+            rectView(reference, &rects[tile], &referenceTiles[tile]);
+    }
+    leadBits = header.delta ? CODEC_MODE_BITS + CODEC_PARAMETER_BITS : CODEC_PARAMETER_BITS;
+
+    r.in = packet + CODEC_HEADER_SIZE;
+    r.length = header.payload;
+    r.pos = 0;
+    r.acc = 0;
+    r.bits = 0;
+
+    tile = 0;
+    while(starts[tile+1] <= header.first && tile < numRects - 1){
+        tile++;
+    }
+    width = rects[tile].width;
+    height = rects[tile].height;
+    i = header.first - (int)starts[tile];
+    end = i + header.pixels;
+    x = firstColumn = i % width;
+    y = firstRow = i / width;
+    while(i < end){
+        if(y == height){
+            // Carry on with the next rectangle, end is kept relative to the current one
+            end -= width * height;
+            i = 0;
+            tile++;
+            width = rects[tile].width;
+            height = rects[tile].height;
+            x = y = firstRow = firstColumn = 0;
+        }
+        row = PGMROW(&tiles[tile], y);
+        up = PGMROW(&tiles[tile], y > 0 ? y - 1 : 0);
+        if(reference != NULL)
+            ref = PGMROW(&referenceTiles[tile], y);
+        // Blocks as in encodeRun, predictions as in predictPacketRow and deltaRow
+        for(; x < width && i < end; x += n, i += n){
+            n = width - x < CODEC_BLOCK_SIZE ? width - x : CODEC_BLOCK_SIZE;
+            n = end - i < n ? end - i : n;
+            k = readParameter(&r, leadBits);
+            fromReference = k & CODEC_DELTA_BLOCK;
+            k &= CODEC_DELTA_BLOCK - 1;
+            for(j = x; j < x + n; j++){
+                leftOnly = y == firstRow || (y == firstRow + 1 && firstColumn > 0 && j <= firstColumn);
+                if(fromReference)
+                    p = ref[j];
+                else if(leftOnly)
+                    p = (j == 0 || (y == firstRow && j == firstColumn)) ? 0 : row[j-1];
+                else if(j == 0)
+                    p = up[0];
+                else
+                    p = medPredict(row[j-1], up[j], up[j-1]);
+                m = readResidual(&r, k);
+                damaged |= m > 255;
+                row[j] = (unsigned char)unmapResidual(m, p);
+            }
+        }
+        if(x == width){
+            x = 0;
+            y++;
+        }
+    }
+
+    // Reading past the payload means the packet was damaged
+    return !damaged && (long long)r.pos * 8 - r.bits <= (long long)header.payload * 8;
+}
+
+/**
+  *@brief Decode the pixels of one packet into an image.
+  *
+  *INPUTS
+  *@param packet : Packet bytes.
+  *@param length : Number of bytes available at packet.
+  *@param image  : 8-bit image of the packet's width and height receiving the pixels.
+  *
+  *OUTPUTS
+  *@param 1 if the packet was decoded, 0 if it is damaged or does not belong to the image.
+  */
+int decodePacket(const unsigned char *packet, int length, PGMImage *image){
+
+    CodecRect frame;
+
+    frame.x = 0;
+    frame.y = 0;
+    frame.width = image->header.width;
+    frame.height = image->header.height;
+    return decodeRects(packet, length, image, &frame, 1);
+}
+
+/**
+  *@brief Decode the pixels of one packet coded by encodeRects into the rectangles of an image.
+  *
+  *INPUTS
+  *@param packet   : Packet bytes.
+  *@param length   : Number of bytes available at packet.
+  *@param image    : 8-bit image of the packet's width and height receiving the pixels.
+  *@param rects    : Rectangles the packets were coded from.
+  *@param numRects : Number of rectangles.
+  *
+  *OUTPUTS
+  *@param 1 if the packet was decoded, 0 if it is damaged or does not belong to the image.
+  */
+int decodeRects(const unsigned char *packet, int length, PGMImage *image, const CodecRect *rects, int numRects){
+
+    return decodeStream(packet, length, image, NULL, rects, numRects);
+}
+
+/**
+  *@brief Decode the pixels of one delta packet into an image.
+  *
+  *INPUTS
+  *@param packet    : Packet bytes.
+  *@param length    : Number of bytes available at packet.
+  *@param image     : 8-bit image of the packet's width and height receiving the pixels.
+  *@param reference : Rebuilt image before it, of the same size.
+  *
+  *OUTPUTS
+  *@param 1 if the packet was decoded, 0 if it is damaged, not a delta packet or does not belong
+  *          to the image.
+  */
+int decodeDelta(const unsigned char *packet, int length, PGMImage *image, const PGMImage *reference){
+
+    CodecRect frame;
+
+    if(PGMIS16BIT(reference) || reference->header.width != image->header.width ||
+       reference->header.height != image->header.height)
+        return 0;
+    frame.x = 0;
+    frame.y = 0;
+    frame.width = image->header.width;
+    frame.height = image->header.height;
+    return decodeStream(packet, length, image, reference, &frame, 1);
+}
@@ -0,0 +1,85 @@
+/*
+Primary accretion detection algorithm.
+
+Lossless image codec and downlink packetizer.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#ifndef MG_CODEC_H_INCLUDED
+#define MG_CODEC_H_INCLUDED
+
+#include "mg.h"
+
+// Every downlink packet is packetSize bytes long: a CODEC_HEADER_SIZE byte header, the coded
+// residuals of a run of consecutive pixels in raster order, then zero padding.  The residuals of
+// each row are coded in blocks of up to 16 pixels, each a 3-bit Rice parameter and the codes.  Packets are
+// decoded independently of each other, a lost packet only loses its own pixels.  Delta packets
+// (sync 'M' 'D', see encodeDelta) lead every block with a mode bit and may predict it from the
+// same pixels of image number - 1, they decode once that image is rebuilt.  encodeRects
+// codes rectangles of an image as one run of their pixels, rectangle after rectangle, raster
+// indices then count the pixels of that run.  Multi-byte header fields are big endian.
+//    0 : sync, 'M' 'G' or 'M' 'D'       18 : width
+//    2 : CODEC_VERSION                  20 : height
+//    3 : maxval                         22 : first pixel, raster index (4 bytes)
+//    4 : packet size                    26 : number of pixels (4 bytes)
+//    6 : image number (4 bytes)         30 : payload bytes
+//   10 : packet index (4 bytes)         32 : CRC-16/CCITT of header and payload, computed with
+//   14 : packets in the image (4 bytes)      this field zero
+#define CODEC_HEADER_SIZE 34
+#define CODEC_VERSION 2
+#define CODEC_MIN_PACKET_SIZE 128
+#define CODEC_MAX_PACKET_SIZE 65535
+#define CODEC_DEFAULT_PACKET_SIZE 1024
+
+// Header fields of one packet
+typedef struct PacketHeader{
+    int delta;
+    int maxval;
+    int packetSize;
+    int image;
+    int index;
+    int count;
+    int width;
+    int height;
+    int first;
+    int pixels;
+    int payload;
+}PacketHeader;
+
+// Rectangle of an image coded by encodeRects
+typedef struct CodecRect{
+    int x;
+    int y;
+    int width;
+    int height;
+}CodecRect;
+
+// Packets of one coded image, numPackets * packetSize bytes, and the spatial and reference
+// residuals of the row being coded, rowCapacity bytes each.  Buffers only grow, so a stream reused across images stops
+// allocating once it has held the largest one.
+typedef struct PacketStream{
+    int packetSize;
+    int numPackets;
+    size_t capacity;
+    unsigned char *data;
+    int rowCapacity;
+    unsigned char *mapped;
+}PacketStream;
+
+void initPacketStream(PacketStream *stream,int packetSize);
+void freePacketStream(PacketStream *stream);
+int encodePackets(PacketStream *stream,const PGMImage *image,int imageNumber);
+int encodeRects(PacketStream *stream,const PGMImage *image,const CodecRect *rects,int numRects,int imageNumber);
+int encodeDelta(PacketStream *stream,const PGMImage *image,const PGMImage *reference,int imageNumber);
+int readPacketHeader(const unsigned char *packet,int length,PacketHeader *header);
+int decodePacket(const unsigned char *packet,int length,PGMImage *image);
+int decodeRects(const unsigned char *packet,int length,PGMImage *image,const CodecRect *rects,int numRects);
+int decodeDelta(const unsigned char *packet,int length,PGMImage *image,const PGMImage *reference);
+unsigned int codecCRC(const unsigned char *data,int length);
+
+#endif // MG_CODEC_H_INCLUDED
@@ -18,71 +18,269 @@ Arizona State University
 #include "mg_conncomp.h"
 #include "mg_centroid.h"
 #include "mg_image.h"
+#include "mg_simd.h"
 
-static int SearchDirection[8][2] = {{0,1},{1,1},{1,0},{1,-1},{0,-1},{-1,-1},{-1,0},{-1,1}};
-static unsigned char **bitmap;
-static int **labelmap;
+static const int SearchDirection[8][2] = {{0,1},{1,1},{1,0},{1,-1},{0,-1},{-1,-1},{-1,0},{-1,1}};
+
+// Workspace access, both maps are stored row-major with the width of the current frame
+#define BITMAP(ctx, y, x)   ((ctx)->bitmap[(size_t)(y)*(ctx)->width + (x)])
+#define LABELMAP(ctx, y, x) ((ctx)->labelmap[(size_t)(y)*(ctx)->width + (x)])
+
+static int reserveLabels(LabelContext* ctx, int numLabels);
+static void collectComponents(LabelContext* ctx, int numLabels, CentroidTable* cents, int* ccCount, int* k);
+
+/**
+  *@brief Prepare a labeling context for use.  The workspace is allocated on first use and
+  *          reused for every following frame of the same or smaller size.
+  *
+  *INPUTS
+  *@param ctx  : Labeling context to be initialized.
+  *@param mode : Labeling algorithm used by ConnectedComponentLabeling.
+  *
+  *OUTPUTS
+  *none
+  */
+void initLabelContext(LabelContext* ctx, LabelerMode mode)
+{
+	ctx->mode = mode;
+	ctx->width = 0;
+	ctx->height = 0;
+	ctx->capacity = 0;
+	ctx->bitmap = NULL;
+	ctx->labelmap = NULL;
+	ctx->labelCapacity = 0;
+	ctx->lastLabelCount = 0;
+	ctx->parent = NULL;
+	ctx->sums = NULL;
+	ctx->componentOf = NULL;
+	ctx->runCapacity = 0;
+	ctx->prevRuns = NULL;
+	ctx->curRuns = NULL;
+	ctx->frameRunCount = 0;
+	ctx->frameRunCapacity = 0;
+	ctx->frameRuns = NULL;
+	ctx->components.count = 0;
+	ctx->components.capacity = 0;
+	ctx->components.items = NULL;
+}
+
+/**
+  *@brief Free the workspace owned by a labeling context.
+  *
+  *INPUTS
+  *@param ctx : Labeling context to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeLabelContext(LabelContext* ctx)
+{
+	free(ctx->bitmap);
+	free(ctx->labelmap);
+	free(ctx->parent);
+	free(ctx->sums);
+	free(ctx->componentOf);
+	free(ctx->prevRuns);
+	free(ctx->curRuns);
+	free(ctx->frameRuns);
+	free(ctx->components.items);
+	initLabelContext(ctx, ctx->mode);
+}
 
 /**
   *@brief Validate data in a PGMImage is ready for connected components analysis and
-  *          allocate necessary memory.
+  *          prepare the context workspace.  Memory is only allocated when the frame is larger
+  *          than any frame previously labeled with this context.
   *
   *INPUTS
+  *@param ctx     : Labeling context owning the workspace.
   *@param image   : PGMImage structure to be analyzed.
   *@param pwidth  : Width of the image.
   *@param pheight : Height of the image.
   *
   *OUTPUTS
-  *none
+  *@param 1 on success, -2 if the workspace could not be allocated.
   */
-int validatePGM(PGMImage* image, int *pwidth, int *pheight)
+int validatePGM(LabelContext* ctx, PGMImage* image, int *pwidth, int *pheight)
 {
-	int i=0, x=0, y=0;
+	int x=0, y=0;
+	size_t numPix=0;
+	unsigned char* bitmapRow;
 
 	*pwidth = image->header.width;
 	*pheight = image->header.height;
-	// malloc_validatePGM bitmap free in mg_conncompo.c
-	bitmap   = malloc(*pheight * sizeof(unsigned char*));
-	// malloc_validatePGM labelmap free in mg_conncompo.c
-	labelmap = malloc(*pheight * sizeof(int*));
+	numPix = (size_t)(*pwidth) * (*pheight);
 
-  if(bitmap == NULL|| labelmap == NULL)
+	if(numPix > ctx->capacity)
 	{
-		return -2;
+		free(ctx->bitmap);
+		free(ctx->labelmap);
+		// malloc_validatePGM bitmap free in freeLabelContext
+		ctx->bitmap   = malloc(numPix * sizeof(unsigned char));
+		// malloc_validatePGM labelmap free in freeLabelContext
+		ctx->labelmap = malloc(numPix * sizeof(int));
+
+		if(ctx->bitmap == NULL || ctx->labelmap == NULL)
+		{
+			free(ctx->bitmap);
+			free(ctx->labelmap);
+			ctx->bitmap = NULL;
+			ctx->labelmap = NULL;
+			ctx->capacity = 0;
+			return -2;
+		}
+		ctx->capacity = numPix;
 	}
+	ctx->width = *pwidth;
+	ctx->height = *pheight;
 
-	for(y = 0; y < *pheight; y++)
-	{
-	    // malloc_validatePGM bitmap[] free in mg_conncompo.c
-		bitmap[y]   = malloc(*pwidth * sizeof(unsigned char));
-		// malloc_validatePGM labelmap[] free in mg_conncompo.c
-		labelmap[y] = malloc(*pwidth * sizeof(int));
-
-        if(bitmap[y] == NULL || labelmap[y] == NULL)
-        {
-            return -2;
-        }
-
-		memset(bitmap[y], 0, *pwidth);
-		memset(labelmap[y], 0, *pwidth * sizeof(int));
-	}
+	memset(ctx->labelmap, 0, numPix * sizeof(int));
 
+	// The one pixel border stays background so tracing never leaves the frame
+	memset(ctx->bitmap, 0, *pwidth);
+	memset(ctx->bitmap + (size_t)(*pheight - 1) * (*pwidth), 0, *pwidth);
 	for(y = 1; y <= *pheight - 2; y++)
 	{
+		bitmapRow = &BITMAP(ctx, y, 0);
+		bitmapRow[0] = 0;
+		bitmapRow[*pwidth - 1] = 0;
 		for(x = 1; x <= *pwidth - 2; x++)
 		{
-			i = image->image[y][x];
-			bitmap[y][x] = (unsigned char)i;
+			bitmapRow[x] = (unsigned char)PGMSAMPLE(image, y, x);
 		}
 	}
 
 	return 1;
 }
 
+/**
+  *@brief Start the running statistics of a new label at its seed pixel.
+  *
+  *INPUTS
+  *@param sums : Statistics of the label.
+  *@param x    : Seed pixel column.
+  *@param y    : Seed pixel row.
+  *
+  *OUTPUTS
+  *none
+  */
+static void initSums(ComponentSums* sums, int x, int y)
+{
+	memset(sums, 0, sizeof(ComponentSums));
+	sums->minX = sums->maxX = sums->seedX = x;
+	sums->minY = sums->maxY = sums->seedY = y;
+}
+
+/**
+  *@brief Add the pixels [start, end] of row y to the running statistics of a label.  Sums over the
+  *          run are evaluated in closed form, so a run costs the same as a single pixel.
+  *
+  *INPUTS
+  *@param sums  : Statistics of the label.
+  *@param start : First column of the run.
+  *@param end   : Last column of the run.
+  *@param y     : Row of the run.
+  *
+  *OUTPUTS
+  *none
+  */
+static void addRun(ComponentSums* sums, int start, int end, int y)
+{
+	long long n = end - start + 1;
+	long long sx = (long long)(start + end) * n / 2;
+	long long sxx = ((long long)end * (end + 1) * (2 * end + 1) -
+	                 (long long)(start - 1) * start * (2 * start - 1)) / 6;
+
+	sums->area += n;
+	sums->sumX += sx;
+	sums->sumY += n * y;
+	sums->sumXX += sxx;
+	sums->sumYY += n * y * y;
+	sums->sumXY += sx * y;
+	if(start < sums->minX)
+		sums->minX = start;
+	if(end > sums->maxX)
+		sums->maxX = end;
+	if(y < sums->minY)
+		sums->minY = y;
+	if(y > sums->maxY)
+		sums->maxY = y;
+}
+
+/**
+  *@brief Merge the statistics of one label into another.  The seed of dst is kept.
+  *
+  *INPUTS
+  *@param dst : Statistics receiving src.
+  *@param src : Statistics to be merged.
+  *
+  *OUTPUTS
+  *none
+  */
+static void mergeSums(ComponentSums* dst, const ComponentSums* src)
+{
+	dst->area += src->area;
+	dst->sumX += src->sumX;
+	dst->sumY += src->sumY;
+	dst->sumXX += src->sumXX;
+	dst->sumYY += src->sumYY;
+	dst->sumXY += src->sumXY;
+	if(src->minX < dst->minX)
+		dst->minX = src->minX;
+	if(src->maxX > dst->maxX)
+		dst->maxX = src->maxX;
+	if(src->minY < dst->minY)
+		dst->minY = src->minY;
+	if(src->maxY > dst->maxY)
+		dst->maxY = src->maxY;
+}
+
+/**
+  *@brief Append a run of a label to the run list of the frame and add it to the label's statistics.
+  *
+  *INPUTS
+  *@param ctx   : Labeling context of the frame.
+  *@param label : Label of the run.
+  *@param start : First column of the run.
+  *@param end   : Last column of the run.
+  *@param y     : Row of the run.
+  *
+  *OUTPUTS
+  *none
+  */
+static void recordRun(LabelContext* ctx, int label, int start, int end, int y)
+{
+	int capacity = 0;
+	LabelRun* runs;
+	LabelRun* run;
+
+	if(ctx->frameRunCount == ctx->frameRunCapacity)
+	{
+		capacity = ctx->frameRunCapacity > 0 ? ctx->frameRunCapacity * 2 : 1024;
+		// realloc_recordRun frameRuns free in freeLabelContext
+		runs = realloc(ctx->frameRuns, capacity * sizeof(LabelRun));
+		if(runs == NULL)
+		{
+			printf("Error: Cannot allocate run list memory.  Quitting program.");
+			exit(0);
+		}
+		ctx->frameRuns = runs;
+		ctx->frameRunCapacity = capacity;
+	}
+
+	run = &ctx->frameRuns[ctx->frameRunCount++];
+	run->start = start;
+	run->end = end;
+	run->row = y;
+	run->label = label;
+	addRun(&ctx->sums[label], start, end, y);
+}
+
 /**
   *@brief Supporting function to trace connected component flood fill.
   *
   *INPUTS
+  *@param ctx              : Labeling context of the frame being traced.
   *@param               cy : Height of the image.
   *@param               cx : Width of the image.
   *@param tracingDirection : Direction to trace fill.
@@ -90,7 +288,7 @@ int validatePGM(PGMImage* image, int *pwidth, int *pheight)
   *OUTPUTS
   *none
   */
-void Tracer(int *cy, int *cx, int *tracingdirection)
+void Tracer(LabelContext* ctx, int *cy, int *cx, int *tracingdirection)
 {
 	int i, y, x;
 
@@ -99,9 +297,9 @@ void Tracer(int *cy, int *cx, int *tracingdirection)
 		y = *cy + SearchDirection[*tracingdirection][0];
 		x = *cx + SearchDirection[*tracingdirection][1];
 
-		if(bitmap[y][x] == 0)
+		if(BITMAP(ctx, y, x) == 0)
 		{
-			labelmap[y][x] = -1;
+			LABELMAP(ctx, y, x) = -1;
 			*tracingdirection = (*tracingdirection + 1) % 8;
 		}
 		else
@@ -117,6 +315,7 @@ void Tracer(int *cy, int *cx, int *tracingdirection)
   *@brief Connected component contour tracing. Aspect of connected component flood fill.
   *
   *INPUTS
+  *@param ctx              : Labeling context of the frame being traced.
   *@param cy               : Height of the image.
   *@param cx               : Width of the image.
   *@param labelindex       : Fill flag for pixel.
@@ -125,12 +324,12 @@ void Tracer(int *cy, int *cx, int *tracingdirection)
   *OUTPUTS
   *none
   */
-void ContourTracing(int cy, int cx, int labelindex, int tracingdirection)
+void ContourTracing(LabelContext* ctx, int cy, int cx, int labelindex, int tracingdirection)
 {
 	char tracingstopflag = 0, SearchAgain = 1;
 	int fx=0, fy=0, sx = cx, sy = cy;
 
-	Tracer(&cy, &cx, &tracingdirection);
+	Tracer(ctx, &cy, &cx, &tracingdirection);
 
 	if(cx != sx || cy != sy)
 	{
@@ -140,8 +339,8 @@ void ContourTracing(int cy, int cx, int labelindex, int tracingdirection)
 		while(SearchAgain)
 		{
 			tracingdirection = (tracingdirection + 6) % 8;
-			labelmap[cy][cx] = labelindex;
-			Tracer(&cy, &cx, &tracingdirection);
+			LABELMAP(ctx, cy, cx) = labelindex;
+			Tracer(ctx, &cy, &cx, &tracingdirection);
 
 			if(cx == sx && cy == sy)
 			{
@@ -163,98 +362,513 @@ void ContourTracing(int cy, int cx, int labelindex, int tracingdirection)
 }
 
 /**
-  *@brief Connected Components analysis. Determines number of discrete objects in the image.  Determines
-  *         and returns centroid coordinates for each connected component.
+  *@brief Connected Components analysis by contour tracing. Determines number of discrete objects in
+  *         the image.  Area, centroid, bounding box and moments of each component are accumulated
+  *         during the labeling scan and stored in ctx->components.
   *
   *INPUTS
+  *@param ctx   : Labeling context providing the workspace.  Contexts are independent, so
+  *               frames labeled with different contexts can be processed concurrently.
   *@param image : PGMImage structure containing the file to be analyzed.
   *@param k     : Number of clusters
   *
   *OUTPUTS
+  *@param cents    : Centroid of every component, sized for k clusters.
   *@param ccCount  : Number of connected components detected.
   *
   *@pre PGMImage must contain black and white image.
   *
   */
-Centroid* ConnectedComponentLabeling(PGMImage* image,int* ccCount, int* k)
+void ContourTracingLabeling(LabelContext* ctx, PGMImage* image, CentroidTable* cents, int* ccCount, int* k)
 {
 	int height=0, width=0, cx=0, cy=0;
 	int tracingdirection=0, ConnectedComponentsCount=0;
-	int labelindex=0, i=0, count=0;
-	Centroid pointbuff[500];
-    Centroid *cents;
+	int labelindex=0, runStart=0;
 
-	if(validatePGM(image, &width, &height) != 1)
+	// Statistics are kept in the context's label arrays (label i at index i), which persist across
+	// frames and are pre-sized from the previous frame's count
+	if(validatePGM(ctx, image, &width, &height) != 1 ||
+	   reserveLabels(ctx, ctx->lastLabelCount + ctx->lastLabelCount / 4) != 1)
 	{
 		printf("Error: Cannot validate PGM structure of allocate memory.  Quitting program.");
 		exit(0);
 	}
+	ctx->frameRunCount = 0;
 
 	for(cy = 1; cy < height - 1; cy++)
 	{
 		for(cx = 1, labelindex = 0; cx < width - 1; cx++)
 		{
-			if(bitmap[cy][cx] == BLACKPIX)
+			if(BITMAP(ctx, cy, cx) == BLACKPIX)
 			{
 				if(labelindex != 0)
 				{
-					labelmap[cy][cx] = labelindex;
+					LABELMAP(ctx, cy, cx) = labelindex;
 				}
 				else
 				{
-					labelindex = labelmap[cy][cx];
+					labelindex = LABELMAP(ctx, cy, cx);
 
 					if(labelindex == 0)
 					{
 						labelindex = ++ConnectedComponentsCount;
 						tracingdirection = 0;
-						ContourTracing(cy, cx, labelindex, tracingdirection);
-						labelmap[cy][cx] = labelindex;
-						pointbuff[count].x = cx;
-						pointbuff[count].y = cy;
-						count++;
-						if(count >= 500){
-                            printf("Error: Too many connected components identified.  Exiting program.");
-                            exit(0);
+						ContourTracing(ctx, cy, cx, labelindex, tracingdirection);
+						LABELMAP(ctx, cy, cx) = labelindex;
+						if(reserveLabels(ctx, labelindex) != 1)
+						{
+							printf("Error: Cannot allocate component memory.  Quitting program.");
+							exit(0);
 						}
+						ctx->parent[labelindex] = labelindex;
+						initSums(&ctx->sums[labelindex], cx, cy);
 					}
+					runStart = cx;
 				}
 			}
 			// White pixel & pre-pixel has been labeled
 			else if(labelindex != 0)
 			{
-				if(labelmap[cy][cx] == 0)
+				if(LABELMAP(ctx, cy, cx) == 0)
 				{
 					tracingdirection = 1;
 					// Internal contour
-					ContourTracing(cy, cx - 1, labelindex, tracingdirection);
+					ContourTracing(ctx, cy, cx - 1, labelindex, tracingdirection);
 				}
+				recordRun(ctx, labelindex, runStart, cx - 1, cy);
 				labelindex = 0;
 			}
 		}
+		// Run reaching the border column
+		if(labelindex != 0)
+		{
+			recordRun(ctx, labelindex, runStart, width - 2, cy);
+		}
 	}
 
-    *ccCount = ConnectedComponentsCount;
-    *k = sqrt(*ccCount/2);
+	collectComponents(ctx, ConnectedComponentsCount, cents, ccCount, k);
+}
 
-    cents = createCents(ConnectedComponentsCount,*k);
-    for(i=0; i<ConnectedComponentsCount; i++){
-        cents[i].x = pointbuff[i].x;
-        cents[i].y = pointbuff[i].y;
-    }
+/**
+  *@brief Make room for at least numLabels labels (plus the unused label 0).  Capacity grows
+  *          geometrically and is kept across frames, so once the context has seen the densest
+  *          frames no further reallocation happens, however many components a frame holds.
+  *
+  *INPUTS
+  *@param ctx       : Labeling context owning the union-find arrays.
+  *@param numLabels : Number of labels required.
+  *
+  *OUTPUTS
+  *@param 1 on success, -2 if memory could not be allocated.
+  */
+static int reserveLabels(LabelContext* ctx, int numLabels)
+{
+	int newCapacity = 0;
+	int *parent, *componentOf;
+	ComponentSums* sums;
 
-  for(i = 0; i < height; i++) {
-    free(bitmap[i]);
-    bitmap[i] = NULL;
-    free(labelmap[i]);
-    labelmap[i] = NULL;
-  }
-  free(bitmap);
-  free(labelmap);
-  bitmap = NULL;
-  labelmap = NULL;
+	if(numLabels < ctx->labelCapacity)
+	{
+		return 1;
+	}
+
+	newCapacity = ctx->labelCapacity > 0 ? ctx->labelCapacity : 256;
+	while(newCapacity <= numLabels)
+	{
+		newCapacity *= 2;
+	}
+
+	// realloc_reserveLabels free in freeLabelContext
+	parent = realloc(ctx->parent, newCapacity * sizeof(int));
+	if(parent != NULL)
+		ctx->parent = parent;
+	sums = realloc(ctx->sums, newCapacity * sizeof(ComponentSums));
+	if(sums != NULL)
+		ctx->sums = sums;
+	componentOf = realloc(ctx->componentOf, newCapacity * sizeof(int));
+	if(componentOf != NULL)
+		ctx->componentOf = componentOf;
+
+	if(parent == NULL || sums == NULL || componentOf == NULL)
+	{
+		return -2;
+	}
+	ctx->labelCapacity = newCapacity;
+	return 1;
+}
+
+/**
+  *@brief Union-find root lookup with path halving.
+  *
+  *INPUTS
+  *@param parent : Union-find forest.
+  *@param label  : Label to be resolved.
+  *
+  *OUTPUTS
+  *@param Root label of the set containing label.
+  */
+static int findRoot(int* parent, int label)
+{
+	while(parent[label] != label)
+	{
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+/**
+  *@brief Merge the sets of two labels.  The smaller root always wins, so the root of every set is
+  *          the label of the set's first run in raster order.  The statistics of the losing root are
+  *          merged into the winner.
+  *
+  *INPUTS
+  *@param ctx : Labeling context owning the union-find forest.
+  *@param a   : First label.
+  *@param b   : Second label.
+  *
+  *OUTPUTS
+  *@param Root label of the merged set.
+  */
+static int unionLabels(LabelContext* ctx, int a, int b)
+{
+	int tmp=0;
+
+	a = findRoot(ctx->parent, a);
+	b = findRoot(ctx->parent, b);
+	if(a == b)
+	{
+		return a;
+	}
+	if(b < a)
+	{
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+	ctx->parent[b] = a;
+	mergeSums(&ctx->sums[a], &ctx->sums[b]);
+	return a;
+}
+/**
+  *@brief Connected Components analysis by run-length union-find.  Scans the binary image directly,
+  *         one row at a time, extracts runs of BLACKPIX pixels and merges each run with the
+  *         8-connected runs of the previous row.  No copy of the image and no label image are
+  *         needed.  Uses the same one pixel border and 8-connectivity as ContourTracingLabeling and
+  *         returns the same components in the same order with the same statistics, which are
+  *         accumulated per run and merged whenever two labels are united.
+  *
+  *INPUTS
+  *@param ctx   : Labeling context providing the workspace.
+  *@param image : PGMImage structure containing the file to be analyzed.
+  *@param k     : Number of clusters
+  *
+  *OUTPUTS
+  *@param cents    : Centroid of every component, sized for k clusters.
+  *@param ccCount  : Number of connected components detected.
+  *
+  *@pre PGMImage must contain black and white image.
+  *
+  */
+void RunLengthLabeling(LabelContext* ctx, PGMImage* image, CentroidTable* cents, int* ccCount, int* k)
+{
+	int height=0, width=0, x=0, y=0, p=0, q=0;
+	int start=0, label=0, numLabels=0, prevCount=0, curCount=0;
+	const unsigned char* row = NULL;
+	const unsigned short* row16 = NULL;
+	LabelRun* swap;
+
+	width = image->header.width;
+	height = image->header.height;
+
+	// A row holds at most one run per two pixels
+	if(width / 2 + 1 > ctx->runCapacity)
+	{
+		free(ctx->prevRuns);
+		free(ctx->curRuns);
+		ctx->runCapacity = width / 2 + 1;
+		// malloc_RunLengthLabeling runs free in freeLabelContext
+		ctx->prevRuns = malloc(ctx->runCapacity * sizeof(LabelRun));
+		ctx->curRuns = malloc(ctx->runCapacity * sizeof(LabelRun));
+		if(ctx->prevRuns == NULL || ctx->curRuns == NULL)
+		{
+			printf("Error: Cannot allocate run labeling memory.  Quitting program.");
+			exit(0);
+		}
+	}
+	if(reserveLabels(ctx, ctx->lastLabelCount + ctx->lastLabelCount / 4) != 1)
+	{
+		printf("Error: Cannot allocate run labeling memory.  Quitting program.");
+		exit(0);
+	}
+	ctx->frameRunCount = 0;
+
+	for(y = 1; y < height - 1; y++)
+	{
+		if(PGMIS16BIT(image))
+			row16 = PGMROW16(image, y);
+		else
+			row = PGMROW(image, y);
+
+		curCount = 0;
+		p = 0;
+		x = 1;
+		while(x < width - 1)
+		{
+			if((row16 != NULL ? row16[x] : row[x]) != BLACKPIX)
+			{
+				x++;
+				continue;
+			}
+			start = x;
+			while(x < width - 1 && (row16 != NULL ? row16[x] : row[x]) == BLACKPIX)
+			{
+				x++;
+			}
+
+			// Runs of the previous row touching [start-1, x] are 8-connected to this run
+			label = 0;
+			while(p < prevCount && ctx->prevRuns[p].end < start - 1)
+			{
+				p++;
+			}
+			for(q = p; q < prevCount && ctx->prevRuns[q].start <= x; q++)
+			{
+				if(label == 0)
+					label = findRoot(ctx->parent, ctx->prevRuns[q].label);
+				else
+					label = unionLabels(ctx, label, ctx->prevRuns[q].label);
+			}
+
+			if(label == 0)
+			{
+				label = ++numLabels;
+				if(reserveLabels(ctx, numLabels) != 1)
+				{
+					printf("Error: Cannot allocate run labeling memory.  Quitting program.");
+					exit(0);
+				}
+				ctx->parent[label] = label;
+				initSums(&ctx->sums[label], start, y);
+			}
+			recordRun(ctx, label, start, x - 1, y);
+
+			ctx->curRuns[curCount].start = start;
+			ctx->curRuns[curCount].end = x - 1;
+			ctx->curRuns[curCount].row = y;
+			ctx->curRuns[curCount].label = label;
+			curCount++;
+		}
+
+		swap = ctx->prevRuns;
+		ctx->prevRuns = ctx->curRuns;
+		ctx->curRuns = swap;
+		prevCount = curCount;
+	}
+
+	collectComponents(ctx, numLabels, cents, ccCount, k);
+}
 
-  return cents;
+/**
+  *@brief Build the component table of a labeled frame from the statistics of every root label and
+  *          fill the centroid table with the component centroids.
+  *
+  *INPUTS
+  *@param ctx       : Labeling context holding the statistics of the frame.
+  *@param numLabels : Number of labels used while labeling the frame.
+  *
+  *OUTPUTS
+  *@param cents   : Centroid of every component, sized for k clusters.
+  *@param ccCount : Number of connected components.
+  *@param k       : Number of clusters.
+  */
+static void collectComponents(LabelContext* ctx, int numLabels, CentroidTable* cents, int* ccCount, int* k)
+{
+	int i=0, count=0, capacity=0;
+	double area=0.0;
+	const ComponentSums* sums;
+	Component* c;
+	Component* items;
+
+	ctx->lastLabelCount = numLabels;
+
+	// Every root is the first run of its component, so roots in label order are the
+	// components in raster order of their first pixel.
+	for(i = 1; i <= numLabels; i++)
+	{
+		if(ctx->parent[i] == i)
+			count++;
+	}
+
+	if(count > ctx->components.capacity)
+	{
+		capacity = ctx->components.capacity > 0 ? ctx->components.capacity : 256;
+		while(capacity < count)
+		{
+			capacity *= 2;
+		}
+		// realloc_collectComponents components free in freeLabelContext
+		items = realloc(ctx->components.items, capacity * sizeof(Component));
+		if(items == NULL)
+		{
+			printf("Error: Cannot allocate component table memory.  Quitting program.");
+			exit(0);
+		}
+		ctx->components.items = items;
+		ctx->components.capacity = capacity;
+	}
+	ctx->components.count = count;
+
+	*ccCount = count;
+	*k = sqrt(*ccCount/2);
+
+	if(reserveCentroids(cents, count, *k) != 1)
+	{
+		printf("Error: Cannot allocate centroid memory.  Quitting program.");
+		exit(0);
+	}
+	count = 0;
+	for(i = 1; i <= numLabels; i++)
+	{
+		if(ctx->parent[i] != i)
+		{
+			// The root of a set is its smallest label and has been numbered already
+			ctx->componentOf[i] = ctx->componentOf[findRoot(ctx->parent, i)];
+			continue;
+		}
+		ctx->componentOf[i] = count;
+
+		sums = &ctx->sums[i];
+		c = &ctx->components.items[count];
+		area = (double)sums->area;
+		c->area = (int)sums->area;
+		c->x = sums->sumX / area;
+		c->y = sums->sumY / area;
+		c->minX = sums->minX;
+		c->minY = sums->minY;
+		c->maxX = sums->maxX;
+		c->maxY = sums->maxY;
+		c->mxx = sums->sumXX / area - c->x * c->x;
+		c->myy = sums->sumYY / area - c->y * c->y;
+		c->mxy = sums->sumXY / area - c->x * c->y;
+		c->seedX = sums->seedX;
+		c->seedY = sums->seedY;
+		c->weight = 0.0;
+		c->wx = c->x;
+		c->wy = c->y;
+
+		cents->x[count] = c->x;
+		cents->y[count] = c->y;
+		count++;
+	}
+}
+
+/**
+  *@brief Connected Components analysis with the algorithm selected in the labeling context.
+  *
+  *INPUTS
+  *@param ctx   : Labeling context, ctx->mode selects contour tracing or run-length union-find.
+  *@param image : PGMImage structure containing the file to be analyzed.
+  *@param k     : Number of clusters
+  *
+  *OUTPUTS
+  *@param cents    : Centroid of every component, sized for k clusters.
+  *@param ccCount  : Number of connected components detected.
+  *
+  *@pre PGMImage must contain black and white image.
+  *
+  */
+void ConnectedComponentLabeling(LabelContext* ctx, PGMImage* image, CentroidTable* cents, int* ccCount, int* k)
+{
+	if(ctx->mode == LABELER_RUN_UNION_FIND)
+	{
+		RunLengthLabeling(ctx, image, cents, ccCount, k);
+		return;
+	}
+	ContourTracingLabeling(ctx, image, cents, ccCount, k);
+}
+
+/**
+  *@brief Refine the centroids of the last frame labeled with a context to intensity weighted
+  *          sub-pixel positions.  Only the pixels of each component are read from the grayscale
+  *          frame, one row segment at a time from the run list of the frame, and every segment is
+  *          summed with the momentRow SIMD kernel.  Components are darker than the background, a
+  *          pixel of value p weighs thresholdVal + 1 - p.
+  *
+  *INPUTS
+  *@param ctx          : Labeling context holding the component table of the frame.
+  *@param original     : Grayscale frame the binary image was thresholded from.
+  *@param thresholdVal : Threshold the binary image was created with.
+  *@param cents        : Centroids filled by ConnectedComponentLabeling for the frame.
+  *
+  *OUTPUTS
+  *@param cents : Centroids moved to the intensity weighted positions, also stored in the wx, wy
+  *               and weight fields of ctx->components.
+  */
+void refineCentroids(LabelContext* ctx, PGMImage* original, int thresholdVal, CentroidTable* cents)
+{
+	int i=0, j=0, n=0, sample=0;
+	long long level = (long long)thresholdVal + 1, weight=0, weightIndex=0;
+	const LabelRun* run;
+	Component* c;
+	RowMoments moments;
+
+	for(i = 0; i < ctx->components.count; i++)
+	{
+		c = &ctx->components.items[i];
+		c->weight = 0.0;
+		c->wx = 0.0;
+		c->wy = 0.0;
+	}
+
+	for(i = 0; i < ctx->frameRunCount; i++)
+	{
+		run = &ctx->frameRuns[i];
+		c = &ctx->components.items[ctx->componentOf[run->label]];
+		n = run->end - run->start + 1;
+
+		moments.sum = 0;
+		moments.sumIndex = 0;
+		if(PGMIS16BIT(original))
+		{
+			for(j = 0; j < n; j++)
+			{
+				sample = PGMSAMPLE(original, run->row, run->start + j);
+				moments.sum += sample;
+				moments.sumIndex += (long long)j * sample;
+			}
+		}
+		else
+		{
+			momentRow(PGMROW(original, run->row) + run->start, n, &moments);
+		}
+
+		// Weights of the segment and their first moment relative to the segment start
+		weight = level * n - moments.sum;
+		weightIndex = level * ((long long)n * (n - 1) / 2) - moments.sumIndex;
+
+		c->weight += (double)weight;
+		c->wx += (double)weight * run->start + (double)weightIndex;
+		c->wy += (double)weight * run->row;
+	}
+
+	for(i = 0; i < ctx->components.count; i++)
+	{
+		c = &ctx->components.items[i];
+		if(c->weight > 0.0)
+		{
+			c->wx /= c->weight;
+			c->wy /= c->weight;
+		}
+		else
+		{
+			// Original brighter than the threshold, keep the geometric centroid
+			c->wx = c->x;
+			c->wy = c->y;
+		}
+		cents->x[i] = c->wx;
+		cents->y[i] = c->wy;
+	}
 }
 
 /**
@@ -262,21 +876,20 @@ Centroid* ConnectedComponentLabeling(PGMImage* image,int* ccCount, int* k)
   *        components.
   *
   * INPUTS
-  * @param ccCount  : Length of the centroid array
-  * @param centList : Array of connected component centroids
+  * @param centList : Connected component centroids with their k-means clustering
   *
   * OUTPUT
   * @param The sum of the distances divided by the count of the connected components
   */
-double calcClusterDensity(int ccCount, const Centroid* centList) {
+double calcClusterDensity(const CentroidTable* centList) {
 
   int i=0;
   double distance=0.0, distanceSum=0.0;
 
-  for(i=0; i<ccCount; i++){
-    distanceSum += centList[i].distances[centList[i].kGroup];
+  for(i=0; i<centList->count; i++){
+    distanceSum += centList->clusterDist[i];
   }
-  distance = distanceSum / ccCount;
+  distance = distanceSum / centList->count;
 
   return distance;
 }
@@ -13,12 +13,117 @@ Arizona State University
 #ifndef MG_CONNCOMP_H_INCLUDED
 #define MG_CONNCOMP_H_INCLUDED
 
+#include "mg.h"
 #include "mg_centroid.h"
 
-int validatePGM(PGMImage* image, int *pwidth, int *pheight);
-void Tracer(int *cy, int *cx, int *tracingdirection);
-void ContourTracing(int cy, int cx, int labelindex, int tracingdirection);
-Centroid* ConnectedComponentLabeling(PGMImage* image,int* ccCount, int* k);
-double calcClusterDensity(int ccCount, const Centroid* centList);
+typedef enum LabelerMode {
+  LABELER_CONTOUR_TRACING,
+  LABELER_RUN_UNION_FIND
+} LabelerMode;
+
+typedef enum CentroidMode {
+  CENTROID_GEOMETRIC,
+  CENTROID_INTENSITY_WEIGHTED
+} CentroidMode;
+
+// Horizontal run of foreground pixels [start, end] in one row and its provisional label
+typedef struct LabelRun {
+  int start;
+  int end;
+  int row;
+  int label;
+} LabelRun;
+
+// Running sums of one label, accumulated while the frame is scanned.  Run labeling merges the
+// sums of two labels when their sets are united, so the root always holds the whole component.
+typedef struct ComponentSums {
+  long long area;
+  long long sumX;
+  long long sumY;
+  long long sumXX;
+  long long sumYY;
+  long long sumXY;
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+  int seedX;
+  int seedY;
+} ComponentSums;
+
+// Statistics of one connected component
+//   area                   : number of pixels
+//   x, y                   : centroid (mean pixel position)
+//   minX/minY/maxX/maxY    : inclusive bounding box
+//   mxx, myy, mxy          : central second order moments, normalised by area
+//   seedX, seedY           : first pixel of the component in raster order
+//   weight                 : summed intensity weight, 0 until refineCentroids has run
+//   wx, wy                 : intensity weighted centroid, equal to x, y until refineCentroids has run
+typedef struct Component {
+  int area;
+  double x;
+  double y;
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+  double mxx;
+  double myy;
+  double mxy;
+  int seedX;
+  int seedY;
+  double weight;
+  double wx;
+  double wy;
+} Component;
+
+// Components of the last frame labeled with a context, in raster order of their seed pixel.
+// The table belongs to the context and is overwritten by the next frame.
+typedef struct ComponentTable {
+  int count;
+  int capacity;
+  Component* items;
+} ComponentTable;
+
+// Workspace for labeling one frame at a time.  Each thread labeling frames needs its own
+// context, a context is reused across frames so its buffers are only allocated once.
+//   bitmap/labelmap       : contour tracing workspace
+//   parent/sums           : labels and their running statistics (union-find forest for run
+//                           labeling), grown on demand, lastLabelCount pre-sizes them for the next frame
+//   componentOf           : index in the component table of every label's component
+//   prevRuns/curRuns      : run labeling runs of the previous and the current row
+//   frameRuns             : every run of the last frame labeled, used to revisit component pixels
+//   components            : component table of the last frame labeled
+typedef struct LabelContext {
+  LabelerMode mode;
+  int width;
+  int height;
+  size_t capacity;
+  unsigned char* bitmap;
+  int* labelmap;
+  int labelCapacity;
+  int lastLabelCount;
+  int* parent;
+  ComponentSums* sums;
+  int* componentOf;
+  int runCapacity;
+  LabelRun* prevRuns;
+  LabelRun* curRuns;
+  int frameRunCount;
+  int frameRunCapacity;
+  LabelRun* frameRuns;
+  ComponentTable components;
+} LabelContext;
+
+void initLabelContext(LabelContext* ctx, LabelerMode mode);
+void freeLabelContext(LabelContext* ctx);
+int validatePGM(LabelContext* ctx, PGMImage* image, int *pwidth, int *pheight);
+void Tracer(LabelContext* ctx, int *cy, int *cx, int *tracingdirection);
+void ContourTracing(LabelContext* ctx, int cy, int cx, int labelindex, int tracingdirection);
+void ContourTracingLabeling(LabelContext* ctx, PGMImage* image, CentroidTable* cents, int* ccCount, int* k);
+void RunLengthLabeling(LabelContext* ctx, PGMImage* image, CentroidTable* cents, int* ccCount, int* k);
+void ConnectedComponentLabeling(LabelContext* ctx, PGMImage* image, CentroidTable* cents, int* ccCount, int* k);
+void refineCentroids(LabelContext* ctx, PGMImage* original, int thresholdVal, CentroidTable* cents);
+double calcClusterDensity(const CentroidTable* centList);
 
 #endif // MG_CONNCOMP_H_INCLUDED
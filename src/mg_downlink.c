@@ -13,20 +13,342 @@ Arizona State University
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <stdbool.h>
 #include "mg_centroid.h"
 #include "mg.h"
 #include "mg_image.h"
+#include "mg_transfer.h"
+#include "mg_codec.h"
+#include "mg_roi.h"
+#include "mg_downlink.h"
 
 extern char sourceImageDir[];
 extern char downlinkDir[];
 
+// Indexed max-heap of image indices ordered by score, ties going to the lower image index.
+// pos[i] is the heap slot of image i, -1 when image i is not in the heap.
+typedef struct ScoreHeap {
+    int count;
+    int* heap;
+    int* pos;
+    const double* score;
+} ScoreHeap;
+
+/**
+  *@brief True if image a ranks above image b.
+  */
+static bool heapAbove(const ScoreHeap* h, int a, int b){
+
+    return h->score[a] > h->score[b] || (h->score[a] == h->score[b] && a < b);
+}
+
+/**
+  *@brief Place image in heap slot, keeping its position up to date.
+  */
+static void heapPlace(ScoreHeap* h, int slot, int image){
+
+    h->heap[slot] = image;
+    h->pos[image] = slot;
+}
+
+/**
+  *@brief Move the image in slot towards the root until its parent ranks above it.
+  */
+static void heapSiftUp(ScoreHeap* h, int slot){
+
+    int image = h->heap[slot], parent = 0;
+
+    while(slot > 0){
+        parent = (slot - 1) / 2;
+        if(!heapAbove(h, image, h->heap[parent]))
+            break;
+        heapPlace(h, slot, h->heap[parent]);
+        slot = parent;
+    }
+    heapPlace(h, slot, image);
+}
+
 /**
-  *@brief Downlink image by moving from *\data\camera_data\* to *\data\downlink\* folder.
+  *@brief Move the image in slot towards the leaves until it ranks above both children.
+  */
+static void heapSiftDown(ScoreHeap* h, int slot){
+
+    int image = h->heap[slot], child = 0;
+
+    while((child = 2 * slot + 1) < h->count){
+        if(child + 1 < h->count && heapAbove(h, h->heap[child + 1], h->heap[child]))
+            child++;
+        if(!heapAbove(h, h->heap[child], image))
+            break;
+        heapPlace(h, slot, h->heap[child]);
+        slot = child;
+    }
+    heapPlace(h, slot, image);
+}
+
+/**
+  *@brief Take an image out of the heap in O(log n), if it is still in it.
+  */
+static void heapRemove(ScoreHeap* h, int image){
+
+    int slot = h->pos[image], last = 0;
+
+    if(slot < 0)
+        return;
+    h->pos[image] = -1;
+    h->count--;
+    if(slot == h->count)
+        return;
+
+    last = h->heap[h->count];
+    heapPlace(h, slot, last);
+    heapSiftUp(h, slot);
+    heapSiftDown(h, h->pos[last]);
+}
+
+/**
+  *@brief Stage an image packetized for downlink, as delta packets when a reference is given.
+  *          Images encodePackets or encodeDelta cannot code are left to the caller.
   *
   *INPUTS
-  *@param image      : Image structure to be copied.
-  *@param path       : Original path of the image to be copied.
+  *@param stage     : Downlink staging state.
+  *@param source    : Path of the image.
+  *@param reference : Path of image number - 1, NULL to code the image on its own.
+  *@param dest      : Path of the packet file.
+  *@param number    : Image number written to the packet headers.
+  *
+  *OUTPUTS
+  *@param bytes : Size of the packet file in bytes.
+  *@param 1 if the packet file was written, 0 if the image cannot be packetized.
+  */
+static int stagePackets(DownlinkStage* stage,char* source,char* reference,const char* dest,int number,long long* bytes){
+
+    int numPackets=0;
+    size_t size=0;
+    FILE* file;
+    PGMImage image, previous;
+
+    mapPGM(source,&image);
+    if(reference != NULL){
+        mapPGM(reference,&previous);
+        numPackets = encodeDelta(&stage->packets,&image,&previous,number);
+        freePGMImage(&previous);
+    }
+    else{
+        numPackets = encodePackets(&stage->packets,&image,number);
+    }
+    freePGMImage(&image);
+    if(numPackets < 0)
+        return 0;
+
+    size = (size_t)numPackets * stage->packets.packetSize;
+    file = fopen(dest, "wb");
+    if(file == NULL || fwrite(stage->packets.data, 1, size, file) != size || fclose(file) != 0){
+        printf("Error: Cannot write packets to %s\n",dest);
+        exit(0);
+    }
+    *bytes = (long long)size;
+    return 1;
+}
+
+/**
+  *@brief Stage the regions of interest of an image for downlink, a reconstruction header followed
+  *          by the packets of the regions.  A frame without regions is sent as the header alone.
+  *          Images encodeRects cannot code are left to the caller.
+  *
+  *INPUTS
+  *@param stage  : Downlink staging state.
+  *@param source : Path of the image.
+  *@param dest   : Path of the region file.
+  *@param number : Image number written to the packet headers.
+  *@param roi    : Regions of the image.
+  *
+  *OUTPUTS
+  *@param bytes : Size of the region file in bytes.
+  *@param 1 if the region file was written, 0 if the image cannot be packetized.
+  */
+static int stageRegions(DownlinkStage* stage,char* source,const char* dest,int number,const FrameRoi* roi,long long* bytes){
+
+    int numRects=0, numPackets=0, headerSize=0;
+    size_t size=0;
+    unsigned char header[ROI_HEADER_SIZE(ROI_MAX_RECTS)];
+    CodecRect rects[ROI_MAX_RECTS];
+    FILE* file;
+    PGMImage image;
+
+    mapPGM(source,&image);
+    numRects = roiCodecRects(roi,rects);
+    if(image.header.width != roi->width || image.header.height != roi->height)
+        numPackets = -1;
+    else
+        numPackets = encodeRects(&stage->packets,&image,rects,numRects,number);
+    freePGMImage(&image);
+    if(numPackets < 0)
+        return 0;
+
+    headerSize = writeRoiHeader(roi,header);
+    size = (size_t)numPackets * stage->packets.packetSize;
+    file = fopen(dest, "wb");
+    if(file == NULL || fwrite(header, 1, headerSize, file) != (size_t)headerSize ||
+       fwrite(stage->packets.data, 1, size, file) != size || fclose(file) != 0){
+        printf("Error: Cannot write regions to %s\n",dest);
+        exit(0);
+    }
+    *bytes = (long long)headerSize + (long long)size;
+    return 1;
+}
+
+/**
+  *@brief Open the downlink folder's manifest.csv and prepare the packet stream.
+  *
+  *INPUTS
+  *@param format     : Whether images are staged as downlink packets, cropped to their regions
+  *                    of interest, as delta packets or as they are.
+  *@param mode       : How unpacketized images are staged, see transferFile.
+  *@param packetSize : Size of the downlink packets in bytes.
+  *@param rois       : Regions of interest of every image of the data set, used by downlinkImage
+  *                    for DOWNLINK_ROI.  May be NULL when images are staged with stageImage.
+  *
+  *OUTPUTS
+  *@param stage : Downlink staging state.
+  */
+void openDownlinkStage(DownlinkStage* stage,DownlinkFormat format,TransferMode mode,int packetSize,const FrameRoi* rois){
+
+    char path[MAXSTRINGLENGTH];
+
+    sprintf(path, "%smanifest.csv", downlinkDir);
+    stage->format = format;
+    stage->transfer = mode;
+    stage->rois = rois;
+    stage->count = 0;
+    stage->hook = NULL;
+    stage->hookContext = NULL;
+    initPacketStream(&stage->packets, packetSize);
+    stage->manifest = fopen(path, "w");
+    if(stage->manifest == NULL){
+        printf("Error opening file for write: %s\n",path);
+        exit(0);
+    }
+    fprintf(stage->manifest, "order,image,reason,score,bytes,method\n");
+}
+
+/**
+  *@brief Prepare a stage that hands every image to a hook instead of staging it, for replaying
+  *          the downlink selection without touching the downlink folder.
+  *
+  *INPUTS
+  *@param hook    : Called by stageImage for every image, returns its size in bytes.
+  *@param context : Passed to hook.
+  *
+  *OUTPUTS
+  *@param stage : Downlink staging state.
+  */
+void openHookedStage(DownlinkStage* stage,StageHook hook,void* context){
+
+    stage->format = DOWNLINK_RAW;
+    stage->transfer = TRANSFER_COPY;
+    stage->manifest = NULL;
+    stage->rois = NULL;
+    stage->count = 0;
+    stage->hook = hook;
+    stage->hookContext = context;
+    initPacketStream(&stage->packets, CODEC_DEFAULT_PACKET_SIZE);
+}
+
+void closeDownlinkStage(DownlinkStage* stage){
+
+    if(stage->manifest != NULL)
+        fclose(stage->manifest);
+    stage->manifest = NULL;
+    freePacketStream(&stage->packets);
+}
+
+/**
+  *@brief Downlink score of an image from its cluster distance and the acceleration measured
+  *          across it and its two neighbours.
+  *
+  *INPUTS
+  *@param weights      : Classifier weights.  Change based on training data.
+  *@param kDistance    : K-means cluster mean point to center distance of the image.
+  *@param acceleration : Acceleration across the image and its neighbours.
+  *
+  *OUTPUTS
+  *@param Score of the image.
+  */
+double frameScore(const ScoreWeights* weights,double kDistance,const Shift* acceleration){
+
+    return (kDistance*weights->c1)+((acceleration->x + acceleration->y)*weights->c2);
+}
+
+/**
+  *@brief Stage image number from *\data\camera_data\* in the *\data\downlink\* folder.
+  *          DOWNLINK_PACKETS writes the image's downlink packets, DOWNLINK_ROI those of its regions
+  *          of interest only.  DOWNLINK_DELTA writes delta packets against the image before it if
+  *          that one is already staged.  DOWNLINK_RAW and images the codec does not handle transfer
+  *          the file as is, without decoding.  Each image is recorded in the manifest.
+  *
+  *INPUTS
+  *@param stage          : Downlink staging state.
+  *@param reason         : Why the image is sent, recorded in the manifest.
+  *@param number         : Number of the image.
+  *@param score          : Score of the image, recorded in the manifest.
+  *@param previousStaged : Whether image number - 1 was staged before this one.
+  *@param roi            : Regions of the image, only used by DOWNLINK_ROI.
+  *
+  *OUTPUTS
+  *@param Size of the staged image in bytes.
+  */
+long long stageImage(DownlinkStage* stage,const char* reason,int number,double score,bool previousStaged,const FrameRoi* roi){
+
+    char source[MAXSTRINGLENGTH], dest[MAXSTRINGLENGTH], reference[MAXSTRINGLENGTH];
+    const char* method = NULL;
+    long long bytes=0;
+    TransferMethod transfer;
+
+    if(stage->hook != NULL){
+        stage->count++;
+        return stage->hook(stage->hookContext,reason,number,score,previousStaged);
+    }
+
+    sprintf(source, "%s%03d.pgm", sourceImageDir,number);
+    if(stage->format == DOWNLINK_DELTA && previousStaged){
+        sprintf(reference, "%s%03d.pgm", sourceImageDir,number-1);
+        sprintf(dest, "%s%03d.pkt", downlinkDir,number);
+        if(stagePackets(stage,source,reference,dest,number,&bytes))
+            method = "delta";
+    }
+    if(method == NULL && (stage->format == DOWNLINK_PACKETS || stage->format == DOWNLINK_DELTA)){
+        sprintf(dest, "%s%03d.pkt", downlinkDir,number);
+        if(stagePackets(stage,source,NULL,dest,number,&bytes))
+            method = "packets";
+    }
+    else if(stage->format == DOWNLINK_ROI){
+        sprintf(dest, "%s%03d.roi", downlinkDir,number);
+        if(stageRegions(stage,source,dest,number,roi,&bytes))
+            method = "roi";
+    }
+    if(method == NULL){
+        sprintf(dest, "%s%03d.pgm", downlinkDir,number);
+        transfer = transferFile(source,dest,stage->transfer,&bytes);
+        if(transfer == TRANSFER_FAILED){
+            printf("Error: Cannot stage %s for downlink in %s\n",source,dest);
+            exit(0);
+        }
+        method = transferMethodName(transfer);
+    }
+    stage->count++;
+    fprintf(stage->manifest, "%d,%d,%s,%0.5f,%lld,%s\n", stage->count, number, reason, score, bytes, method);
+
+    return bytes;
+}
+
+/**
+  *@brief Downlink an image of the data set with stageImage and mark it as sent.
+  *
+  *INPUTS
+  *@param stage      : Downlink staging state.
+  *@param reason     : Why the image is sent, recorded in the manifest.
   *@param index      : Index of image in the data set.
   *@param downlinked : Array containing info on which images have been downlinked.
   *@param score      : Score of each image.  Influences downlink order.
@@ -34,114 +356,340 @@ extern char downlinkDir[];
   *
   *OUTPUTS
   *@param downlinkCount : Number of images currently downlinked from the data set.
+  *@param Size of the staged image in bytes.
   */
-void downlinkImage(PGMImage* image, char* path,int index,int* downlinkCount,bool downlinked[],double score[],int startImg){
+long long downlinkImage(DownlinkStage* stage,const char* reason,int index,int* downlinkCount,bool downlinked[],double score[],int startImg){
+
+    long long bytes=0;
 
-    sprintf(path, "%s%03d.pgm", sourceImageDir,startImg+index);
-    readPGM(path,image);
-    sprintf(path, "%s%03d.pgm", downlinkDir,startImg+index);
-    writePGM(path,image);
+    bytes = stageImage(stage,reason,startImg+index,score[index],index > 0 && downlinked[index-1],
+                       stage->format == DOWNLINK_ROI ? &stage->rois[index] : NULL);
     downlinked[index] = true;
     (*downlinkCount)++;
     score[index] = 0.0;
-    freePGMImage(image);
+
+    return bytes;
+}
+/**
+  *@brief Choose the images of a downlink and the order they are staged in.  The first and last
+  *          images are always sent, the others in descending score order together with their
+  *          neighbours.  Scores are kept in an indexed max-heap, so picking the next image and
+  *          dropping the ones already chosen cost O(log n) each and the selection ends after at
+  *          most numImages picks.
+  *
+  *INPUTS
+  *@param score           : Score of each image, only images scoring above zero are chosen for it.
+  *@param numImages       : Number of images in the data set.
+  *@param images2Downlink : Number of images after which no more picks are made.  The neighbours
+  *                         of the last pick may go over it.
+  *
+  *OUTPUTS
+  *@param picks : Chosen images in staging order, numImages entries.
+  *@param Number of chosen images.
+  */
+int selectDownlink(const double* score,int numImages,int images2Downlink,DownlinkPick* picks){
+
+    int i=0,index=0,count=0;
+    bool* downlinked;
+    ScoreHeap heap;
+
+    if(numImages < 1)
+        return 0;
+
+    // malloc_selectDownlink downlinked, heap free at the end of selectDownlink
+    downlinked = malloc(numImages * sizeof(bool));
+    heap.heap = malloc(numImages * sizeof(int));
+    heap.pos = malloc(numImages * sizeof(int));
+    if(downlinked == NULL || heap.heap == NULL || heap.pos == NULL){
+        printf("Error: Cannot allocate downlink queue memory.  Quitting program.");
+        exit(0);
+    }
+
+    for(i = 0; i < numImages; i++) {
+      downlinked[i] = false;
+      heap.pos[i] = -1;
+    }
+
+    picks[count].index = 0;
+    picks[count++].reason = "first";
+    downlinked[0] = true;
+    if(numImages > 1){
+        picks[count].index = numImages-1;
+        picks[count++].reason = "last";
+        downlinked[numImages-1] = true;
+    }
+
+    // Heap of the images still to choose from, built bottom up in O(n).  The first and last
+    // images are already chosen.
+    heap.score = score;
+    heap.count = 0;
+    for(i=1; i<(numImages-1); i++){
+        heapPlace(&heap, heap.count++, i);
+    }
+    for(i = heap.count/2 - 1; i >= 0; i--){
+        heapSiftDown(&heap, i);
+    }
+
+    // Only images scoring above zero are worth sending.  Every pick leaves the heap, so the
+    // loop runs at most numImages-2 times.
+    while((count < images2Downlink) && (heap.count > 0) && (score[heap.heap[0]] > 0.0)){
+
+        // Picks are never the first or last image, so both neighbours exist
+        index = heap.heap[0];
+
+        for(i = index-1; i <= index+1; i++){
+            if(downlinked[i] == false){
+                picks[count].index = i;
+                picks[count++].reason = i == index ? "score" : "neighbour";
+                downlinked[i] = true;
+                heapRemove(&heap, i);
+            }
+        }
+    }
+
+    free(downlinked);
+    free(heap.heap);
+    free(heap.pos);
+    return count;
 }
 
 /**
   *@brief Select images for file transfer (representative spacecraft downlink)
-  *        based on cluster distance and frame acceleration.
+  *        based on cluster distance and frame acceleration, see selectDownlink.  Every staged
+  *        image is listed in manifest.csv in the downlink folder, in the order it was staged.
   *
   *INPUTS
   *@param downlinkPercentage : Percentage (0-100) of the data set to be transfered.
-  *@param acceleration       : Array containing acceleration data
+  *@param weights            : Classifier weights of the score, see frameScore.
+  *@param acceleration       : Array containing acceleration data, numImages-2 entries.  Entry i-1
+  *                            is measured across images i-1, i and i+1.
   *@param kDistances         : K-means cluster mean point to center distance.
+  *@param rois               : Regions of interest of every image, only used by DOWNLINK_ROI.
   *@param startImg           : Value of the first image in the data set.
   *@param numImages          : Value containing the total number of images in the data set.
+  *@param format             : Whether images are staged as downlink packets, cropped to their
+  *                            regions of interest, as delta packets or as they are.
+  *@param mode               : How unpacketized images are staged, see transferFile.
+  *@param packetSize         : Size of the downlink packets in bytes.
   *
   *OUTPUTS
   *none
   */
-void downlinkData(int downlinkPercentage,Shift* acceleration,double* kDistances,int startImg,int numImages){
+void downlinkData(int downlinkPercentage,const ScoreWeights* weights,Shift* acceleration,double* kDistances,const FrameRoi* rois,int startImg,int numImages,DownlinkFormat format,TransferMode mode,int packetSize){
 
-    int i=0,index=0,maxTries=0;
+    int i=0,numPicks=0;
     int downlinkCount=0, images2Downlink=0;
-    int endImg = (startImg + numImages - 1);
-    double score[numImages];
-    double maxScore=0.0;
-    char path[MAXSTRINGLENGTH];
-    bool downlinked[numImages];
-    PGMImage image;
+    long long bytes=0;
+    double* score;
+    bool* downlinked;
+    DownlinkPick* picks;
+    DownlinkStage stage;
+
+    if(numImages < 1)
+        return;
+
+    // malloc_downlinkData score, downlinked, picks free at the end of downlinkData
+    score = malloc(numImages * sizeof(double));
+    downlinked = malloc(numImages * sizeof(bool));
+    picks = malloc(numImages * sizeof(DownlinkPick));
+    if(score == NULL || downlinked == NULL || picks == NULL){
+        printf("Error: Cannot allocate downlink queue memory.  Quitting program.");
+        exit(0);
+    }
 
     for(i = 0; i < numImages; i++) {
       downlinked[i] = false;
+      score[i] = 0.0;
     }
 
-    //Classifiers.  Change weight based on training data.
-    double c1=0.5,c2=0.5;
-
     images2Downlink = (numImages * (downlinkPercentage * .01));
 
-    //Print the first image.
-    sprintf(path, "%s%03d.pgm", sourceImageDir,startImg);
-    readPGM(path,&image);
-    sprintf(path, "%s%03d.pgm", downlinkDir,startImg);
-    writePGM(path,&image);
-    downlinked[0] = true;
-    score[0] = 0.0;
-    downlinkCount++;
-    freePGMImage(&image);
-
-    //Print the last image.
-    sprintf(path, "%s%03d.pgm", sourceImageDir,endImg);
-    readPGM(path,&image);
-    sprintf(path, "%s%03d.pgm", downlinkDir,endImg);
-    writePGM(path,&image);
-    downlinked[numImages-1] = true;
-    score[numImages-1] = 0.0;
-    downlinkCount++;
-    freePGMImage(&image);
-
     // Score each image pair based on trained classifiers
     // Skip the first and last indices because those represent the first and
-    // last image which were already downlinked above.
+    // last image which are always downlinked.
     for(i=1; i<(numImages-1); i++){
-        score[i] = (kDistances[i]*c1)+((acceleration[i].x + acceleration[i].y)*c2);
+        score[i] = frameScore(weights,kDistances[i],&acceleration[i-1]);
         printf("Score %d     : %0.5f\n", i, score[i]);
         printf("kDistances   : %0.5f\n", kDistances[i]);
-        printf("acceleration : (%0.5f,%0.5f)\n", acceleration[i].x, acceleration[i].y);
+        printf("acceleration : (%0.5f,%0.5f)\n", acceleration[i-1].x, acceleration[i-1].y);
     }
 
-    while((downlinkCount < images2Downlink) && (maxTries < 1000)){
+    numPicks = selectDownlink(score,numImages,images2Downlink,picks);
 
-        maxScore = 0.0;
-        for(i=1; i<(numImages-1); i++){
-            if(score[i] > maxScore){
-                maxScore = score[i];
-                index = i;
-            }
-        }
-        maxTries++;
+    openDownlinkStage(&stage,format,mode,packetSize,rois);
+    for(i = 0; i < numPicks; i++){
+        bytes += downlinkImage(&stage,picks[i].reason,picks[i].index,&downlinkCount,downlinked,score,startImg);
+    }
+    closeDownlinkStage(&stage);
+    printf("Downlinked %d images, %lld bytes, manifest %smanifest.csv\n",downlinkCount,bytes,downlinkDir);
 
-        if(downlinked[index-1] == false){
-            downlinkImage(&image,path,index-1,&downlinkCount,downlinked,score,startImg);
-        }
+    free(score);
+    free(downlinked);
+    free(picks);
+}
 
-        if(downlinked[index] == false){
-            downlinkImage(&image,path,index,&downlinkCount,downlinked,score,startImg);
-        }
+/**
+  *@brief Size of an image staged on its own in the given format.  DOWNLINK_DELTA is sized as
+  *          DOWNLINK_PACKETS, delta packets depend on which image is staged before it.  Images
+  *          staged as files are sized as binary PGM files.
+  *
+  *INPUTS
+  *@param packets : Packet stream reused across images.
+  *@param format  : Downlink format.
+  *@param image   : Image to be sized.
+  *@param roi     : Regions of the image, only used by DOWNLINK_ROI.
+  *@param number  : Image number written to the packet headers.
+  *
+  *OUTPUTS
+  *@param Size of the staged image in bytes.
+  */
+long long downlinkSize(PacketStream* packets,DownlinkFormat format,const PGMImage* image,const FrameRoi* roi,int number){
+
+    int numPackets=-1, numRects=0;
+    char header[MAXSTRINGLENGTH];
+    CodecRect rects[ROI_MAX_RECTS];
+
+    if(format == DOWNLINK_PACKETS || format == DOWNLINK_DELTA){
+        numPackets = encodePackets(packets,image,number);
+        if(numPackets >= 0)
+            return (long long)numPackets * packets->packetSize;
+    }
+    else if(format == DOWNLINK_ROI && image->header.width == roi->width && image->header.height == roi->height){
+        numRects = roiCodecRects(roi,rects);
+        numPackets = encodeRects(packets,image,rects,numRects,number);
+        if(numPackets >= 0)
+            return ROI_HEADER_SIZE(numRects) + (long long)numPackets * packets->packetSize;
+    }
+
+    sprintf(header, "P5\n%d %d\n%d\n", image->header.width, image->header.height, image->header.grayscale);
+    return (long long)strlen(header) +
+           (long long)image->header.width * image->header.height * PGMBYTESPERPIXEL(image);
+}
+
+/**
+  *@brief Write the scoring inputs and the downlink size of every image, for replaying the
+  *          downlink selection offline.  The first and last images have no acceleration and are
+  *          written with zero.
+  *
+  *INPUTS
+  *@param path         : File to be written.
+  *@param kDistances   : K-means cluster mean point to center distance of every image.
+  *@param acceleration : numImages-2 entries, entry i-1 measured across images i-1, i and i+1.
+  *@param sizes        : Size of every image staged on its own, see downlinkSize.
+  *@param startImg     : Number of the first image in the data set.
+  *@param numImages    : Number of images in the data set.
+  *
+  *OUTPUTS
+  *none
+  */
+void writeScores(const char* path,const double* kDistances,const Shift* acceleration,const long long* sizes,int startImg,int numImages){
 
-        if(downlinked[index+1] == false){
-            downlinkImage(&image,path,index+1,&downlinkCount,downlinked,score,startImg);
+    int i=0;
+    double x=0.0, y=0.0;
+    FILE* file;
+
+    file = fopen(path, "w");
+    if(file == NULL){
+        printf("Error opening file for write: %s\n",path);
+        exit(0);
+    }
+    fprintf(file, "image,kDistance,accelerationX,accelerationY,bytes\n");
+    for(i = 0; i < numImages; i++){
+        x = 0.0;
+        y = 0.0;
+        if(i > 0 && i < numImages-1){
+            x = acceleration[i-1].x;
+            y = acceleration[i-1].y;
         }
-        printf("\ndownlinkCount : %d\n",downlinkCount);
+        fprintf(file, "%d,%.17g,%.17g,%.17g,%lld\n", startImg+i, kDistances[i], x, y, sizes[i]);
     }
+    fclose(file);
+}
 
-    /*
-    for(i = 0; i < images2Downlink; i++) {
-      printf("Img %d downlinked: %d\n", i, downlinked[i]);
+/**
+  *@brief Read the scoring inputs writeScores wrote.
+  *
+  *INPUTS
+  *@param path : File to be read.
+  *
+  *OUTPUTS
+  *@param kDistances   : Allocated array of the cluster distance of every image, free after use.
+  *@param acceleration : Allocated array of the acceleration across every image but the first and
+  *                      last one, entry i-1 for image i, free after use.
+  *@param sizes        : Allocated array of the downlink size of every image, free after use.
+  *@param startImg     : Number of the first image.
+  *@param Number of images, -1 if the file cannot be read or images are missing.
+  */
+int readScores(const char* path,double** kDistances,Shift** acceleration,long long** sizes,int* startImg){
+
+    int count=0, capacity=0, number=0;
+    long long bytes=0;
+    double distance=0.0, x=0.0, y=0.0;
+    char line[MAXSTRINGLENGTH];
+    double* distances=NULL;
+    Shift* shifts=NULL;
+    long long* lengths=NULL;
+    void* grown;
+    FILE* file;
+
+    *kDistances = NULL;
+    *acceleration = NULL;
+    *sizes = NULL;
+    file = fopen(path, "r");
+    if(file == NULL || fgets(line, sizeof(line), file) == NULL || strncmp(line, "image,", 6) != 0){
+        if(file != NULL)
+            fclose(file);
+        return -1;
     }
-    */
 
-    maxTries = 0;
-}
+    while(fgets(line, sizeof(line), file) != NULL){
+        if(sscanf(line, "%d,%lf,%lf,%lf,%lld", &number, &distance, &x, &y, &bytes) != 5 || bytes < 0 ||
+           (count > 0 && number != *startImg + count)){
+            count = -1;
+            break;
+        }
+        if(count == 0)
+            *startImg = number;
+        if(count == capacity){
+            capacity = capacity > 0 ? 2 * capacity : 256;
+            grown = realloc(distances, capacity * sizeof(double));
+            if(grown == NULL){
+                count = -1;
+                break;
+            }
+            distances = grown;
+            grown = realloc(shifts, capacity * sizeof(Shift));
+            if(grown == NULL){
+                count = -1;
+                break;
+            }
+            shifts = grown;
+            grown = realloc(lengths, capacity * sizeof(long long));
+            if(grown == NULL){
+                count = -1;
+                break;
+            }
+            lengths = grown;
+        }
+        distances[count] = distance;
+        lengths[count] = bytes;
+        // The acceleration across image i is entry i-1, the first image has none
+        if(count > 0){
+            shifts[count-1].x = x;
+            shifts[count-1].y = y;
+        }
+        count++;
+    }
+    fclose(file);
 
+    if(count <= 0){
+        free(distances);
+        free(shifts);
+        free(lengths);
+        return -1;
+    }
+    *kDistances = distances;
+    *acceleration = shifts;
+    *sizes = lengths;
+    return count;
+}
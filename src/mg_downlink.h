@@ -13,7 +13,71 @@ Arizona State University
 #ifndef MG_DOWNLINK_H_INCLUDED
 #define MG_DOWNLINK_H_INCLUDED
 
-void downlinkImage(PGMImage* image, char* path,int index,int* downlinkCount,bool downlinked[],double score[],int startImg);
-void downlinkData(int downlinkPercentage,Shift* acceleration,double* kDistances,int startImg,int numImages);
+#include <stdio.h>
+#include <stdbool.h>
+#include "mg_centroid.h"
+#include "mg_transfer.h"
+#include "mg_codec.h"
+#include "mg_roi.h"
+
+// Form of the staged images.  DOWNLINK_PACKETS codes every image losslessly into fixed size
+// packets, written as NNN.pkt (see encodePackets).  DOWNLINK_ROI codes only the regions of
+// interest of every image, written as NNN.roi: a reconstruction header followed by the packets
+// of the regions (see writeRoiHeader and encodeRects).  DOWNLINK_DELTA codes an image whose
+// predecessor was staged before it as delta packets against that image (see encodeDelta), the
+// first image of every run as DOWNLINK_PACKETS does, both written as NNN.pkt.  DOWNLINK_RAW
+// stages the PGM files themselves.
+typedef enum DownlinkFormat{
+    DOWNLINK_RAW,
+    DOWNLINK_PACKETS,
+    DOWNLINK_ROI,
+    DOWNLINK_DELTA
+}DownlinkFormat;
+
+// Weights of the cluster distance and the acceleration in the downlink score, see frameScore
+#define SCORE_DEFAULT_C1 0.5
+#define SCORE_DEFAULT_C2 0.5
+
+typedef struct ScoreWeights{
+    double c1;
+    double c2;
+}ScoreWeights;
+
+// Image chosen by selectDownlink, index in the data set and why it is sent
+typedef struct DownlinkPick{
+    int index;
+    const char* reason;
+}DownlinkPick;
+
+// Takes the place of staging an image, see openHookedStage.  Returns the size of the image in
+// bytes.
+typedef long long (*StageHook)(void* context,const char* reason,int number,double score,bool previousStaged);
+
+// Staging state shared by the images of one downlink.  The packet stream is reused for every
+// image, rois holds the regions of every image of the data set for DOWNLINK_ROI when the images
+// are selected by downlinkData.  count is the number of images staged so far.  A stage with a
+// hook writes nothing and has no manifest, every image goes to the hook instead.
+typedef struct DownlinkStage{
+    DownlinkFormat format;
+    TransferMode transfer;
+    FILE* manifest;
+    PacketStream packets;
+    const FrameRoi* rois;
+    int count;
+    StageHook hook;
+    void* hookContext;
+}DownlinkStage;
+
+void openDownlinkStage(DownlinkStage* stage,DownlinkFormat format,TransferMode mode,int packetSize,const FrameRoi* rois);
+void openHookedStage(DownlinkStage* stage,StageHook hook,void* context);
+void closeDownlinkStage(DownlinkStage* stage);
+double frameScore(const ScoreWeights* weights,double kDistance,const Shift* acceleration);
+int selectDownlink(const double* score,int numImages,int images2Downlink,DownlinkPick* picks);
+long long downlinkSize(PacketStream* packets,DownlinkFormat format,const PGMImage* image,const FrameRoi* roi,int number);
+void writeScores(const char* path,const double* kDistances,const Shift* acceleration,const long long* sizes,int startImg,int numImages);
+int readScores(const char* path,double** kDistances,Shift** acceleration,long long** sizes,int* startImg);
+long long stageImage(DownlinkStage* stage,const char* reason,int number,double score,bool previousStaged,const FrameRoi* roi);
+long long downlinkImage(DownlinkStage* stage,const char* reason,int index,int* downlinkCount,bool downlinked[],double score[],int startImg);
+void downlinkData(int downlinkPercentage,const ScoreWeights* weights,Shift* acceleration,double* kDistances,const FrameRoi* rois,int startImg,int numImages,DownlinkFormat format,TransferMode mode,int packetSize);
 
 #endif // MG_DOWNLINK_H_INCLUDED
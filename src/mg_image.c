@@ -10,120 +10,176 @@ Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
 Arizona State University
 */
 
+#ifndef _WIN32
+// posix_memalign, mmap and posix_madvise in strict C modes
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "mg_image.h"
 #include "mg_threshold.h"
+#include "mg_simd.h"
 #include "mg.h"
 
 /**
-  *@brief Dynamically determine number of bytes to read while parsing PGM file.
-  *       LIMITATION: Currently assume all whitespace in header is a single space
-  *                   this is actually not per the PGM spec and needs to be improved.
+  *@brief Check for a PGM header whitespace character (blank, TAB, CR, LF, VT or FF).
   *
   *INPUTS
-  *@param file : File to be parsed
+  *@param c : Character to be checked.
   *
   *OUTPUTS
-  *@param Number of bytes to read
+  *@param 1 if c is whitespace, 0 otherwise.
+  */
+static int isPGMWhitespace(unsigned char c){
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+/**
+  *@brief Reset a PGM header parser before feeding it the first byte of a file.
   *
+  *INPUTS
+  *@param parser : Parser state to be reset.
+  *
+  *OUTPUTS
+  *none
   */
-int bytesToNextSpace(FILE* file) {
+void initPGMHeaderParser(PGMHeaderParser* parser){
+  parser->phase = READ_TYPE;
+  parser->typeBytes = 0;
+  parser->inComment = 0;
+  parser->value = 0;
+  parser->digits = 0;
+}
 
-  unsigned char oneByte;
-  int startPos = ftell(file);
-  int bytes = 0;
+/**
+  *@brief Feed one byte of a PGM file to the header parser.  Accepts P2 (plain) and P5 (raw)
+  *          headers with any amount of whitespace and '#' comments between the fields and a
+  *          maxval of up to 65535.  The header ends at the single whitespace byte following the
+  *          maxval, so the next byte in the file is the first raster byte.
+  *
+  *INPUTS
+  *@param parser : Parser state.
+  *@param header : Header structure to be populated.
+  *@param c      : Next byte of the file.
+  *
+  *OUTPUTS
+  *@param PGMHEADER_MORE while more bytes are needed, PGMHEADER_DONE once the header is
+  *         complete and valid, PGMHEADER_ERROR if the header is malformed.
+  */
+int feedPGMHeaderByte(PGMHeaderParser* parser, PGMHeader* header, unsigned char c){
 
-  fread(&oneByte, sizeof(unsigned char), 1, file);
-  while(oneByte != ' ' && oneByte != '\n') {
-    //printf("%x ", oneByte);
-    fread(&oneByte, sizeof(unsigned char), 1, file);
-    bytes++;
+  switch(parser->phase) {
+  case READ_TYPE:
+    if(parser->typeBytes == 0) {
+      if(c != 'P')
+        return PGMHEADER_ERROR;
+    }
+    else if(c != '2' && c != '5') {
+      return PGMHEADER_ERROR;
+    }
+    header->type[parser->typeBytes++] = c;
+    if(parser->typeBytes == 2)
+      parser->phase = READ_WIDTH;
+    return PGMHEADER_MORE;
+  case READ_WIDTH:
+  case READ_HEIGHT:
+  case READ_GRAYSCALE:
+    if(parser->inComment) {
+      if(c == '\n' || c == '\r')
+        parser->inComment = 0;
+      return PGMHEADER_MORE;
+    }
+    if(c >= '0' && c <= '9') {
+      // Guard against overflow, no valid dimension or maxval gets close to this
+      if(parser->value > 100000000)
+        return PGMHEADER_ERROR;
+      parser->value = parser->value*10 + (c - '0');
+      parser->digits++;
+      return PGMHEADER_MORE;
+    }
+    if(c == '#') {
+      // A comment may only start between fields, never directly after the maxval
+      if(parser->digits > 0 && parser->phase == READ_GRAYSCALE)
+        return PGMHEADER_ERROR;
+      parser->inComment = 1;
+    }
+    else if(!isPGMWhitespace(c)) {
+      return PGMHEADER_ERROR;
+    }
+    if(parser->digits == 0)
+      return PGMHEADER_MORE;
+
+    // Current field complete
+    if(parser->phase == READ_WIDTH) {
+      header->width = parser->value;
+      header->numWidthDigits = parser->digits;
+      parser->phase = READ_HEIGHT;
+    }
+    else if(parser->phase == READ_HEIGHT) {
+      header->height = parser->value;
+      header->numHeightDigits = parser->digits;
+      parser->phase = READ_GRAYSCALE;
+    }
+    else {
+      header->grayscale = parser->value;
+      header->numGrayscaleDigits = parser->digits;
+      parser->phase = READ_DONE;
+    }
+    parser->value = 0;
+    parser->digits = 0;
+    if(parser->phase != READ_DONE)
+      return PGMHEADER_MORE;
+
+    if(header->width <= 0 || header->height <= 0 ||
+       header->grayscale <= 0 || header->grayscale > 65535)
+      return PGMHEADER_ERROR;
+    return PGMHEADER_DONE;
+  case READ_DONE:
+    return PGMHEADER_DONE;
   }
-  // return the file pointer to its original place
-  fseek(file, startPos, SEEK_SET);
-  return bytes;
+
+  return PGMHEADER_ERROR;
 }
 
 /**
   *@brief Parse PGM header functionality.  Utilized for populating PGMImage structure header.
+  *          Reads the header in a single pass without allocating or seeking and leaves the file
+  *          positioned at the first raster byte.
   *
   *INPUTS
   *@param header : Header structure to be populated
   *@param file   : File to be read
   *
   *OUTPUTS
-  *none
+  *@param 0 on success, -1 if the header is malformed or truncated.
   */
-void parsePGMHeader(PGMHeader* header, FILE* file) {
-
-  unsigned char oneByte;
-  unsigned char* tempBuffer;
-  int bytesToRead=0;
-
-  PGMHeaderPhase phase = READ_TYPE;
-  do {
-    switch(phase) {
-    case READ_TYPE:
-      // To read the type, read two bytes
-      fread(header->type, sizeof(unsigned char), 2, file);
-      // Read the space to move to the next section
-      fread(&oneByte, 1, 1, file);
-      //printf("%x ", oneByte);
-      phase = READ_WIDTH;
-      break;
-    case READ_WIDTH:
-      // Find the next space in the header and then read from the current file pointer
-      // to that space
-      bytesToRead = bytesToNextSpace(file);
-      // malloc_tempBuffer free in mg_image.c
-      tempBuffer = malloc(sizeof(unsigned char)*bytesToRead+1);
-      fread(tempBuffer, sizeof(unsigned char), bytesToRead, file);
-      header->width = atoi((char*)tempBuffer);
-      header->numWidthDigits = bytesToRead;
-      printf("Width is %d\n", header->width);
-      free(tempBuffer);
-      tempBuffer = NULL;
-      // Read the space to move to the next section
-      fread(&oneByte, 1, 1, file);
-      phase = READ_HEIGHT;
-      break;
-    case READ_HEIGHT:
-      bytesToRead = bytesToNextSpace(file);
-      // malloc_tempBuffer free in mg_image.c
-      tempBuffer = malloc(sizeof(unsigned char)*bytesToRead+1);
-      fread(tempBuffer, sizeof(unsigned char), bytesToRead, file);
-      header->height = atoi((char*)tempBuffer);
-      header->numHeightDigits = bytesToRead;
-      // Read the space to move to the next section
-      fread(&oneByte, 1, 1, file);
-      printf("Height is %d\n", header->height);
-      free(tempBuffer);
-      tempBuffer = NULL;
-      phase = READ_GRAYSCALE;
-      break;
-    case READ_GRAYSCALE:
-      bytesToRead = bytesToNextSpace(file);
-      // malloc_tempBuffer free in mg_image.c
-      tempBuffer = malloc(sizeof(unsigned char)*bytesToRead+1);
-      fread(tempBuffer, sizeof(unsigned char), bytesToRead, file);
-      header->grayscale = atoi((char*)tempBuffer);
-      header->numGrayscaleDigits = bytesToRead;
-      printf("Grayscale is %d\n\n", header->grayscale);
-      free(tempBuffer);
-      tempBuffer = NULL;
-      phase = READ_DONE;
-      break;
-    case READ_DONE:
-      fread(&oneByte, sizeof(unsigned char), 1, file);
-      break;
-    }
+int parsePGMHeader(PGMHeader* header, FILE* file) {
 
-  } while(oneByte != '\n');
-}
+  int c = 0, status = PGMHEADER_MORE;
+  PGMHeaderParser parser;
 
+  initPGMHeaderParser(&parser);
+  while(status == PGMHEADER_MORE) {
+    c = getc(file);
+    if(c == EOF)
+      return -1;
+    status = feedPGMHeaderByte(&parser, header, (unsigned char)c);
+  }
+
+  return status == PGMHEADER_DONE ? 0 : -1;
+}
  /**
    *@brief PGM read functionality.
    *
@@ -135,27 +191,56 @@ void parsePGMHeader(PGMHeader* header, FILE* file) {
    *none
    */
 void readPGM(char* filename,PGMImage* image){
-  int i=0;
+  int i=0, j=0, value=0, truncated=0;
+  unsigned char* bytes;
+  unsigned short* row16;
   FILE* file = NULL;
   file = fopen(filename, "rb");
 
   if(file != NULL) {
     printf("Opened file %s\n", filename);
-    parsePGMHeader(&(image->header), file);
+    if(parsePGMHeader(&(image->header), file) != 0) {
+      printf("Error: Malformed PGM header: %s\n",filename);
+      exit(0);
+    }
     // After the header is parsed memory can be allocated for the image
 
-    // malloc_readPGM image->image free in test_run.c
-    image->image = malloc(sizeof(unsigned char*)*image->header.height);
-    for(i = 0; i < image->header.height; i++) {
-      // malloc_readPGM image->image[] free in test_run.c
-      image->image[i] = malloc(sizeof(unsigned char)*image->header.width);
-    }
-
-    for(i = 0; i < image->header.height; i++) {
-        fread(image->image[i], sizeof(unsigned char), image->header.width, file);
+    // malloc_readPGM image->pixels free in test_run.c
+    allocatePGMImageArray(image);
+
+    for(i = 0; i < image->header.height && !truncated; i++) {
+      if(image->header.type[1] == '2') {
+        // Plain (ASCII) raster
+        for(j = 0; j < image->header.width && !truncated; j++) {
+          if(fscanf(file, "%d", &value) != 1)
+            truncated = 1;
+          else if(PGMIS16BIT(image))
+            PGMROW16(image, i)[j] = (unsigned short)value;
+          else
+            PGMROW(image, i)[j] = (unsigned char)value;
+        }
+      }
+      else if(PGMIS16BIT(image)) {
+        // Raw 16-bit samples are stored most significant byte first, convert in place
+        row16 = PGMROW16(image, i);
+        bytes = (unsigned char*)row16;
+        if(fread(bytes, 2, image->header.width, file) != (size_t)image->header.width)
+          truncated = 1;
+        for(j = 0; j < image->header.width; j++) {
+          row16[j] = (unsigned short)((bytes[2*j] << 8) | bytes[2*j+1]);
+        }
+      }
+      else if(fread(PGMROW(image, i), sizeof(unsigned char), image->header.width, file) != (size_t)image->header.width) {
+        truncated = 1;
+      }
     }
 
     fclose(file);
+
+    if(truncated) {
+      printf("Error: Truncated PGM raster: %s\n",filename);
+      exit(0);
+    }
   }
   else {
     printf("Error opening file for read: %s\n",filename);
@@ -163,6 +248,145 @@ void readPGM(char* filename,PGMImage* image){
   }
 }
 
+/**
+  *@brief Parse a PGM header held in memory in a single pass without allocating.
+  *
+  *INPUTS
+  *@param header : Header structure to be populated
+  *@param buffer : Start of the file contents
+  *@param length : Number of bytes available in buffer
+  *
+  *OUTPUTS
+  *@param Offset of the first raster byte in buffer, -1 if the header is malformed.
+  */
+int parsePGMHeaderBuffer(PGMHeader* header, const unsigned char* buffer, size_t length){
+
+  size_t pos = 0;
+  int status = PGMHEADER_MORE;
+  PGMHeaderParser parser;
+
+  initPGMHeaderParser(&parser);
+  while(status == PGMHEADER_MORE && pos < length) {
+    status = feedPGMHeaderByte(&parser, header, buffer[pos++]);
+  }
+
+  return status == PGMHEADER_DONE ? (int)pos : -1;
+}
+/**
+  *@brief Map a file read-only into memory.
+  *
+  *INPUTS
+  *@param filename : Path of the file to be mapped.
+  *
+  *OUTPUTS
+  *@param length : Size of the mapping in bytes.
+  *@param Base address of the mapping, NULL on failure.
+  */
+static void* mapFile(char* filename, size_t* length){
+
+  void* base = NULL;
+#ifdef _WIN32
+  HANDLE file, mapping;
+  LARGE_INTEGER size;
+
+  file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                     FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  if(GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping != NULL) {
+      // The view keeps the mapping alive once both handles are closed
+      base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      *length = (size_t)size.QuadPart;
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+#else
+  int fd;
+  struct stat st;
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    return NULL;
+
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED) {
+      base = NULL;
+    }
+    else {
+      *length = (size_t)st.st_size;
+      posix_madvise(base, *length, POSIX_MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+#endif
+  return base;
+}
+
+/**
+  *@brief Release a mapping created by mapFile.
+  *
+  *INPUTS
+  *@param base   : Base address of the mapping.
+  *@param length : Size of the mapping in bytes.
+  *
+  *OUTPUTS
+  *none
+  */
+static void unmapFile(void* base, size_t length){
+#ifdef _WIN32
+  (void)length;
+  UnmapViewOfFile(base);
+#else
+  munmap(base, length);
+#endif
+}
+
+ /**
+   *@brief Zero-copy PGM read functionality.  The file is memory mapped, the header is parsed
+   *          in place and image->pixels points directly at the pixel data in the mapping
+   *          (stride == width), so no pixel is copied or allocated.  The pixels are READ-ONLY.
+   *          Falls back to readPGM when the file cannot be mapped or is not an 8-bit P5 image.
+   *
+   *INPUTS
+   *@param filename :  Read path for the file.
+   *@param image    :  Structure to store read data.  Release with freePGMImage.
+   *
+   *OUTPUTS
+   *none
+   */
+void mapPGM(char* filename,PGMImage* image){
+
+  int offset=0;
+  size_t length=0;
+  unsigned char* base = NULL;
+
+  base = mapFile(filename, &length);
+  if(base == NULL) {
+    readPGM(filename, image);
+    return;
+  }
+
+  offset = parsePGMHeaderBuffer(&(image->header), base, length);
+  // Only raw 8-bit rasters can be used in place, everything else is decoded by readPGM
+  if(offset < 0 || image->header.type[1] != '5' || image->header.grayscale > 255 ||
+     (size_t)image->header.width * image->header.height > length - offset) {
+    unmapFile(base, length);
+    readPGM(filename, image);
+    return;
+  }
+
+  printf("Opened file %s\n", filename);
+  image->stride = image->header.width;
+  image->pixels = base + offset;
+  image->mapBase = base;
+  image->mapLength = length;
+}
+
 /**
   *@brief PGM write functionality.
   *
@@ -175,9 +399,10 @@ void readPGM(char* filename,PGMImage* image){
   */
 void writePGM(char* filename,PGMImage* image){
 
-  int i=0;
+  int i=0, j=0;
   FILE* file = NULL;
   unsigned char* tempBuffer = NULL;
+  const unsigned short* row16;
 
   file = fopen(filename, "wb");
   if(file != NULL) {
@@ -187,36 +412,38 @@ void writePGM(char* filename,PGMImage* image){
     }
     //printf("Printing image\n");
 
-    // Write the type and a space
-    fwrite(image->header.type,sizeof(unsigned char),2,file);
-    fwrite(" ",sizeof(char),1,file);
-
-    // Write the width and a space
-    tempBuffer = malloc(sizeof(unsigned char)*(image->header.numWidthDigits+1));
-    itoa(image->header.width, (char*)tempBuffer, 10);
-    fwrite(tempBuffer, sizeof(unsigned char), image->header.numWidthDigits, file);
-    fwrite(" ",sizeof(char),1,file);
-    free(tempBuffer);
-    tempBuffer = NULL;
+    // Write the type, width, height and grayscale.  The values are formatted here rather than
+    // trusting the num*Digits fields, which go stale once thresholdImage changes the grayscale.
+    fprintf(file, "%c%c %d %d %d\n", image->header.type[0], image->header.type[1],
+            image->header.width, image->header.height, image->header.grayscale);
 
-    // Write the height and a space
-    tempBuffer = malloc(sizeof(unsigned char)*(image->header.numHeightDigits+1));
-    itoa(image->header.height, (char*)tempBuffer, 10);
-    fwrite(tempBuffer, sizeof(unsigned char), image->header.numHeightDigits, file);
-    fwrite(" ",sizeof(char),1,file);
-    free(tempBuffer);
-    tempBuffer = NULL;
-
-    // Write grayscale image data
-    tempBuffer = malloc(sizeof(unsigned char)*(image->header.numGrayscaleDigits+1));
-    itoa(image->header.grayscale, (char*)tempBuffer, 10);
-    fwrite(tempBuffer, sizeof(unsigned char), image->header.numGrayscaleDigits, file);
-    fwrite("\n",sizeof(char),1,file);
-    free(tempBuffer);
-    tempBuffer = NULL;
-
-    for(i = 0; i < image->header.height; i++) {
-        fwrite(image->image[i], sizeof(char), image->header.width, file);
+    if(image->header.type[1] == '2') {
+      // Plain raster, keep lines under the 70 characters the format recommends
+      for(i = 0; i < image->header.height; i++) {
+        for(j = 0; j < image->header.width; j++) {
+          fprintf(file, (j % 10 == 9 || j == image->header.width - 1) ? "%d\n" : "%d ",
+                  PGMSAMPLE(image, i, j));
+        }
+      }
+    }
+    else if(PGMIS16BIT(image)) {
+      // Raw 16-bit samples are written most significant byte first
+      tempBuffer = malloc(sizeof(unsigned char)*2*image->header.width);
+      for(i = 0; i < image->header.height; i++) {
+        row16 = PGMROW16(image, i);
+        for(j = 0; j < image->header.width; j++) {
+          tempBuffer[2*j] = (unsigned char)(row16[j] >> 8);
+          tempBuffer[2*j+1] = (unsigned char)(row16[j] & 0xFF);
+        }
+        fwrite(tempBuffer, sizeof(unsigned char), 2*image->header.width, file);
+      }
+      free(tempBuffer);
+      tempBuffer = NULL;
+    }
+    else {
+      for(i = 0; i < image->header.height; i++) {
+          fwrite(PGMROW(image, i), sizeof(char), image->header.width, file);
+      }
     }
 
     fclose(file);
@@ -226,9 +453,10 @@ void writePGM(char* filename,PGMImage* image){
     exit(0);
   }
 }
-
 /**
-  *@brief 2D Correlation coefficient functionality.
+  *@brief 2D Correlation coefficient functionality.  Sum, sum of squares and cross product of
+  *          both images are gathered in one fused integer pass (SIMD kernels for 8-bit images),
+  *          the mean-centred sums are then derived exactly from them.
   *
   *INPUTS
   *@param image1 :  PGMIMage structure containing the first image to be compared.
@@ -241,10 +469,10 @@ double corr2d(PGMImage* image1, PGMImage* image2){
 
     int image1_height=0, image2_height=0, image1_width=0;
     int image2_width=0,image1_numPix=0, image2_numPix=0,i=0,j=0;
-    unsigned char tmpPix1,tmpPix2;
-    double intPix1=0.0,intPix2=0.0, result=0.0;
-    double numerator=0.0,denominator=0.0,sum1=0.0,sum2=0.0;
-    double image1Mean=0.0, image2Mean=0.0;
+    long long intPix1=0, intPix2=0, numPix=0, mean1=0, mean2=0;
+    long long numerator=0, sum1=0, sum2=0;
+    double result=0.0, denominator=0.0;
+    CorrSums sums = {0, 0, 0, 0, 0};
 
     image1_width = image1->header.width;
     image2_width = image2->header.width;
@@ -261,55 +489,55 @@ double corr2d(PGMImage* image1, PGMImage* image2){
       exit(0);
     }
 
-    for(i = 0; i<image1->header.height; i++){
-      for(j = 0; j<image1->header.width; j++){
-        tmpPix1 = image1->image[i][j];
-        intPix1 = tmpPix1 & 0xFF;
-        tmpPix2 = image2->image[i][j];
-        intPix2 = tmpPix2 & 0xFF;
-        image1Mean += intPix1;
-        image2Mean += intPix2;
+    if(!PGMIS16BIT(image1) && !PGMIS16BIT(image2)){
+      for(i = 0; i < image1_height; i++){
+        corrRow(PGMROW(image1, i), PGMROW(image2, i), image1_width, &sums);
+      }
+    }
+    else{
+      for(i = 0; i < image1_height; i++){
+        for(j = 0; j < image1_width; j++){
+          intPix1 = PGMSAMPLE(image1, i, j);
+          intPix2 = PGMSAMPLE(image2, i, j);
+          sums.sum1 += intPix1;
+          sums.sum2 += intPix2;
+          sums.sumSq1 += intPix1*intPix1;
+          sums.sumSq2 += intPix2*intPix2;
+          sums.sumCross += intPix1*intPix2;
+        }
       }
     }
 
-    image1Mean = round(image1Mean / image1_numPix);
-    image2Mean = round(image2Mean / image2_numPix);
-
-    //printf("Image 1 mean: %f\n", image1Mean);
-    //printf("Image 2 mean: %f\n", image2Mean);
+    mean1 = (long long)round((double)sums.sum1 / image1_numPix);
+    mean2 = (long long)round((double)sums.sum2 / image2_numPix);
+    numPix = image1_numPix;
 
-    for(i = 0; i < image1->header.height; i++){
-      for(j = 0; j < image1->header.width; j++){
-        tmpPix1 = image1->image[i][j];
-        intPix1 = tmpPix1 & 0xFF;
+    //printf("Image 1 mean: %lld\n", mean1);
+    //printf("Image 2 mean: %lld\n", mean2);
 
-        tmpPix2 = image2->image[i][j];
-        intPix2 = tmpPix2 & 0xFF;
+    // Expand sum((p1 - mean1)*(p2 - mean2)) and the squared deviations.  Every term is an
+    // exact integer, so these match a per-pixel accumulation around the rounded means.
+    numerator = sums.sumCross - mean2*sums.sum1 - mean1*sums.sum2 + numPix*mean1*mean2;
+    sum1 = sums.sumSq1 - 2*mean1*sums.sum1 + numPix*mean1*mean1;
+    sum2 = sums.sumSq2 - 2*mean2*sums.sum2 + numPix*mean2*mean2;
 
-        numerator += ((intPix1 - image1Mean) * (intPix2 - image2Mean));
-        sum1 += ((intPix1 - image1Mean)*(intPix1 - image1Mean));
-        sum2 += ((intPix2 - image2Mean)*(intPix2 - image2Mean));
-      }
-    }
-
-    denominator = sqrt(sum1*sum2);
+    denominator = sqrt((double)sum1*(double)sum2);
 
     // Protect against divide by zero for the correlation value
     if(denominator == 0) {
       result = 0;
     }
     else {
-      result = numerator / denominator;
+      result = (double)numerator / denominator;
     }
 
     // Make sure correlation value is always positive
     if(result < 0) {
       result *= -1;
-    }
-
+    }
+
     return result;
 }
-
 /**
   *@brief Copy data from one PGMImage structure to another.
   *
@@ -322,6 +550,7 @@ double corr2d(PGMImage* image1, PGMImage* image2){
   */
 void copyPGM(PGMImage* imageSource, PGMImage* imageDest){
     int i;
+    size_t rowBytes;
     imageDest->header.width = imageSource->header.width;
     imageDest->header.height = imageSource->header.height;
     imageDest->header.grayscale = imageSource->header.grayscale;
@@ -332,11 +561,69 @@ void copyPGM(PGMImage* imageSource, PGMImage* imageDest){
     imageDest->header.numGrayscaleDigits = imageSource->header.numGrayscaleDigits;
 
     allocatePGMImageArray(imageDest);
-    for(i=0; i<imageDest->header.height; i++){
-        memcpy(imageDest->image[i],imageSource->image[i],imageDest->header.width*sizeof(char));
+    if(imageSource->stride == imageDest->stride){
+        // Identical layout, copy the whole frame at once
+        memcpy(imageDest->pixels,imageSource->pixels,(size_t)imageDest->header.height*imageDest->stride);
+    }
+    else{
+        rowBytes = (size_t)imageDest->header.width*PGMBYTESPERPIXEL(imageDest);
+        for(i=0; i<imageDest->header.height; i++){
+            memcpy(PGMROW(imageDest, i),PGMROW(imageSource, i),rowBytes);
+        }
     }
 }
 
+/**
+  *@brief Row stride used for rows of the given size.  Rows are padded so every row
+  *         starts on a PGMALIGNMENT byte boundary.
+  *
+  *INPUTS
+  *@param width : Row size in bytes.
+  *
+  *OUTPUTS
+  *@param Number of bytes between the start of consecutive rows.
+  */
+int alignedStride(int width){
+    return (width + PGMALIGNMENT - 1) / PGMALIGNMENT * PGMALIGNMENT;
+}
+
+/**
+  *@brief Allocate heap memory aligned to PGMALIGNMENT bytes.
+  *
+  *INPUTS
+  *@param size : Number of bytes to allocate.
+  *
+  *OUTPUTS
+  *@param Pointer to the allocated memory, NULL on failure.  Release with alignedFree.
+  */
+void* alignedMalloc(size_t size){
+    void* ptr = NULL;
+#ifdef _WIN32
+    ptr = _aligned_malloc(size, PGMALIGNMENT);
+#else
+    if(posix_memalign(&ptr, PGMALIGNMENT, size) != 0)
+        ptr = NULL;
+#endif
+    return ptr;
+}
+
+/**
+  *@brief Free memory allocated with alignedMalloc.
+  *
+  *INPUTS
+  *@param ptr : Pointer returned by alignedMalloc, may be NULL.
+  *
+  *OUTPUTS
+  *none
+  */
+void alignedFree(void* ptr){
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 
 /**
   *@brief Allocate heap memory for PGMImage structure image.
@@ -348,11 +635,14 @@ void copyPGM(PGMImage* imageSource, PGMImage* imageDest){
   *none
   */
 void allocatePGMImageArray(PGMImage* pgm){
-    int i;
     if(pgm->header.height != 0 && pgm->header.width != 0){
-        pgm->image = malloc(sizeof(unsigned char*)*pgm->header.height);
-        for(i = 0; i < pgm->header.height; i++) {
-          pgm->image[i] = malloc(sizeof(unsigned char)*pgm->header.width);
+        pgm->stride = alignedStride(pgm->header.width*PGMBYTESPERPIXEL(pgm));
+        pgm->pixels = alignedMalloc((size_t)pgm->stride*pgm->header.height);
+        pgm->mapBase = NULL;
+        pgm->mapLength = 0;
+        if(pgm->pixels == NULL){
+            printf("Error: Could not allocate image memory.");
+            exit(0);
         }
     }
     else{
@@ -371,11 +661,7 @@ void allocatePGMImageArray(PGMImage* pgm){
   *none
   */
 void deallocatePGMImageArray(PGMImage* pgm){
-    int i;
-    for(i = 0; i < pgm->header.height; i++) {
-        free(pgm->image[i]);
-        pgm->image[i] = NULL;
-    }
+    freePGMImage(pgm);
 }
 
 /**
@@ -388,16 +674,16 @@ void deallocatePGMImageArray(PGMImage* pgm){
   *none
   */
 void freePGMImage(PGMImage* img) {
-  int i = 0;
-  int height = 0;
   if(img != NULL) {
-    height = img->header.height;
-    for(i = 0; i < height; i++) {
-      free(img->image[i]);
-      img->image[i] = NULL;
+    if(img->mapBase != NULL) {
+      unmapFile(img->mapBase, img->mapLength);
+      img->mapBase = NULL;
+      img->mapLength = 0;
+    }
+    else {
+      alignedFree(img->pixels);
     }
-    free(img->image);
-    img->image = NULL;
+    img->pixels = NULL;
   }
 }
 
@@ -13,17 +13,40 @@ Arizona State University
 #ifndef MG_IMAGE_H_INCLUDED
 #define MG_IMAGE_H_INCLUDED
 
+#include <stdio.h>
 #include "mg.h"
 
 #define BLACKPIX 1
 #define WHITEPIX 0
 
-int bytesToNextSpace(FILE* file);
-void parsePGMHeader(PGMHeader* header, FILE* file);
+// Images with a maxval above 255 hold one native-endian unsigned short per pixel
+#define PGMIS16BIT(pgm)       ((pgm)->header.grayscale > 255)
+#define PGMBYTESPERPIXEL(pgm) (PGMIS16BIT(pgm) ? 2 : 1)
+
+// Row and pixel access into the strided PGMImage pixel buffer
+#define PGMROW(pgm, y)      ((pgm)->pixels + (size_t)(y) * (pgm)->stride)
+#define PGMPIXEL(pgm, y, x) (PGMROW(pgm, y)[x])
+#define PGMROW16(pgm, y)    ((unsigned short*)PGMROW(pgm, y))
+// Pixel value of an 8 or 16-bit image
+#define PGMSAMPLE(pgm, y, x) (PGMIS16BIT(pgm) ? PGMROW16(pgm, y)[x] : PGMROW(pgm, y)[x])
+
+// feedPGMHeaderByte results
+#define PGMHEADER_ERROR -1
+#define PGMHEADER_MORE   0
+#define PGMHEADER_DONE   1
+
+void initPGMHeaderParser(PGMHeaderParser* parser);
+int feedPGMHeaderByte(PGMHeaderParser* parser, PGMHeader* header, unsigned char c);
+int parsePGMHeader(PGMHeader* header, FILE* file);
 double corr2d(PGMImage* image1,PGMImage* image2);
+int parsePGMHeaderBuffer(PGMHeader* header, const unsigned char* buffer, size_t length);
 void readPGM(char* filename,PGMImage* image);
+void mapPGM(char* filename,PGMImage* image);
 void writePGM(char* filename,PGMImage* image);
 void copyPGM(PGMImage* imageSource, PGMImage* imageDest);
+int alignedStride(int width);
+void* alignedMalloc(size_t size);
+void alignedFree(void* ptr);
 void allocatePGMImageArray(PGMImage* pgm);
 void deallocatePGMImageArray(PGMImage* pgm);
 void freePGMImage(PGMImage* img);
@@ -13,13 +13,33 @@ Arizona State University
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
-#include <time.h>
 #include <math.h>
 #include <stdbool.h>
 #include "mg.h"
 #include "mg_kmeans.h"
 #include "mg_centroid.h"
 
+// Iterations before k-means gives up on converging
+#define KMEANS_MAX_ITERATIONS 500
+
+// K-means has converged when no cluster center moves further than this, in pixels
+#define KMEANS_TOLERANCE 1e-3
+
+// Mini-batch k-means: centroids per batch, batches before giving up on converging and the
+// smallest frame it is used on, smaller frames are cheaper to cluster exactly
+#define KMEANS_BATCH_SIZE 1024
+#define KMEANS_BATCH_ITERATIONS 100
+#define KMEANS_BATCH_MIN_CENTROIDS (8 * KMEANS_BATCH_SIZE)
+
+// Mini-batch k-means has converged once its smoothed batch inertia has not improved for this
+// many batches.  The inertia of a batch is averaged over about KMEANS_BATCH_SMOOTHING batches.
+#define KMEANS_BATCH_NO_IMPROVEMENT 10
+#define KMEANS_BATCH_SMOOTHING 10
+
+// Margin, in pixels, by which a Hamerly bound must clear the assigned distance for a centroid to
+// be skipped.  Covers the rounding of the bound updates so ties are still measured exactly.
+#define KMEANS_BOUND_SLACK 1e-9
+
 /**
   *@brief Check to determine if given value exists in a given array.
   *
@@ -55,48 +75,42 @@ bool ValueInArray(int val, int *arr, int arrSize){
   *OUTPUTS
   *@param Return distance between two points.
   */
-double calcDist(int x1,int y1,int x2,int y2){
+double calcDist(double x1,double y1,double x2,double y2){
 
-    float distance;
-    int xDist,yDist,sum;
-    //printf("Values: %d %d %d %d\n",x1,y1,x2,y2);
+    double distance;
+    double xDist,yDist,sum;
+    //printf("Values: %f %f %f %f\n",x1,y1,x2,y2);
     xDist = x2 - x1;
     yDist = y2 - y1;
-    sum = abs((xDist*xDist)+(yDist*yDist));
-    distance = sqrt((float)sum);
+    sum = (xDist*xDist)+(yDist*yDist);
+    distance = sqrt(sum);
 
     return distance;
 }
 
 /**
-  *@brief Determine if two structures containing cluster center coordinates are equivalent.
-  *       Returning true indicates K-Means updating has converged.
+  *@brief Determine if K-Means updating has converged, which it has when no cluster center moved
+  *       more than KMEANS_TOLERANCE.  Centers keep their index between iterations, so each center
+  *       is only compared with its own previous position.
   *
   *@param rCents1 : RandomCentroid structure containing cluster center coordinates.
   *@param rCents2 : RandomCentroid structure containing cluster center coordinates.
   *@param k       : Number of clusters to be compared.
   *
   */
-bool compareCents(RandomCentroid *rCents1,RandomCentroid *rCents2, int k){
+bool compareCents(const RandomCentroid *rCents1,const RandomCentroid *rCents2, int k){
 
-    bool equivilent = false;
-    int i=0, j=0, count = 0;
+    int i=0;
+    double xDist=0.0, yDist=0.0;
 
     for(i = 0; i<k; i++){
-        for(j=0; j<k; j++){
-            if(rCents1[i].x == rCents2[j].x  && rCents1[i].y == rCents2[j].y)
-                count += 1;
-        }
+        xDist = rCents2[i].x - rCents1[i].x;
+        yDist = rCents2[i].y - rCents1[i].y;
+        if(xDist*xDist + yDist*yDist > KMEANS_TOLERANCE*KMEANS_TOLERANCE)
+            return false;
     }
 
-    if(count == k)
-        equivilent = true;
-    else
-        equivilent = false;
-
-    //fputs(equivilent ? "true\n" : "false\n", stdout);
-    return equivilent;
-
+    return true;
 }
 
 /**
@@ -104,138 +118,626 @@ bool compareCents(RandomCentroid *rCents1,RandomCentroid *rCents2, int k){
   *         cluster centers.  Sorted to closest cluster.
   *
   *INPUTS
-  *@param numCent : Number of centroids.
-  *@param k       : Number of clusters.
-  *@param cents   : Array containing centroid data.
+  *@param cents : Centroid table with the distance of every centroid to every cluster center.
   *
   *OUTPUTS
-  *none
+  *@param cents : kGroup of every centroid set to its closest cluster, clusterDist to the distance.
   */
-void sortCentroids(int numCent,int k,Centroid *cents){
+void sortCentroids(CentroidTable *cents){
 
     int minIndex=0, a=0, b=0;
+    const double *row;
 
-    for(a=0; a<numCent; a++){
-        for(b=0; b<k; b++){
-            if(cents[a].distances[b] < cents[a].distances[minIndex])
+    for(a=0; a<cents->count; a++){
+        row = &CENTDIST(cents, a, 0);
+        minIndex = 0;
+        for(b=1; b<cents->k; b++){
+            if(row[b] < row[minIndex])
                 minIndex = b;
         }
-        cents[a].kGroup = minIndex;
+        cents->kGroup[a] = minIndex;
+        cents->clusterDist[a] = row[minIndex];
     }
 }
 
 /**
-  *@brief Recenter centroid cluster based on coordinates of each centroid in the cluster
+  *@brief Recenter every cluster on the mean position of its centroids.  A cluster left without
+  *         centroids keeps its center.
   *
-  *@param numCents  : Number of centroids.
-  *@param k         : Number of clusters.
-  *@param cents     : Centroid structure containing the centroid coordinates.
+  *@param cents     : Centroid table containing the centroid coordinates and clusters.
   *
   *OUTPUTS
   *@param rCent : Centroid structure containing the centroid cluster coordinates.
   *
   */
-void adjustRandomCentroid(int numCents,int k,Centroid *cents,RandomCentroid *rCent){
+void adjustRandomCentroid(const CentroidTable *cents,RandomCentroid *rCent){
 
-    int i=0, xSum=0, ySum=0, curK=0;
-    int xMean=0, yMean=0;
+    int numCents = cents->count, k = cents->k;
+    int i=0, curK=0;
+    int clusterSize[k];
+    double xSum[k], ySum[k];
 
     for(curK = 0; curK<k; curK++){
-        for(i = 0; i<numCents; i++){
-            if(cents[i].kGroup == curK)
-                xSum += cents[i].x;
-                ySum += cents[i].y;
+        clusterSize[curK] = 0;
+        xSum[curK] = 0.0;
+        ySum[curK] = 0.0;
+    }
+
+    // One pass over the centroids sums every cluster
+    for(i = 0; i<numCents; i++){
+        curK = cents->kGroup[i];
+        clusterSize[curK] += 1;
+        xSum[curK] += cents->x[i];
+        ySum[curK] += cents->y[i];
+    }
+
+    for(curK = 0; curK<k; curK++){
+        if(clusterSize[curK] > 0){
+            rCent[curK].x = xSum[curK] / clusterSize[curK];
+            rCent[curK].y = ySum[curK] / clusterSize[curK];
         }
-            xMean = xSum / numCents;
-            yMean = ySum / numCents;
-            //printf("New X,Y Coordinate: %d %d\n",xMean,yMean);
-            rCent[curK].x = xMean;
-            rCent[curK].y = yMean;
     }
 }
 
 /**
-  *@brief K-Means sorting based on k = sqrt(number of centroids / 2)
-  *         Sorts centroids into k clusters based on their distance from the cluster center.
+  *@brief Measure every centroid against every cluster center into the distance matrix.
+  */
+static void measureDistances(CentroidTable *cents,const RandomCentroid *rCent){
+
+    int i=0, j=0;
+
+    for(j=0; j<cents->count; j++){
+        for(i=0; i<cents->k; i++){
+            CENTDIST(cents, j, i) = calcDist(rCent[i].x,rCent[i].y,cents->x[j],cents->y[j]);
+        }
+    }
+}
+
+/**
+  *@brief Assign one centroid to its closest cluster center by measuring every center.
   *
   *INPUTS
-  *@param image    : PGMIMage structure image to be analyzed.
-  *@param k        : Number of clusters.
-  *@param numCents : Number of centroids.
+  *@param cents : Centroid table.
+  *@param i     : Centroid to be assigned.
+  *@param rCent : Cluster centers.
   *
   *OUTPUTS
-  *none
+  *@param cents : kGroup of centroid i.
+  *@param upper : Distance of centroid i to its closest center.
+  *@param lower : Distance of centroid i to its second closest center.
   */
-void kmeans(PGMImage* image,int k,Centroid *cents,int numCents){
+static void assignCentroid(CentroidTable *cents,int i,const RandomCentroid *rCent,double *upper,double *lower){
+
+    int c=0, best=0;
+    double dist=0.0, bestDist=HUGE_VAL, secondDist=HUGE_VAL;
+
+    // Ties go to the lowest cluster index, as in sortCentroids
+    for(c=0; c<cents->k; c++){
+        dist = calcDist(rCent[c].x,rCent[c].y,cents->x[i],cents->y[i]);
+        if(dist < bestDist){
+            secondDist = bestDist;
+            bestDist = dist;
+            best = c;
+        }
+        else if(dist < secondDist){
+            secondDist = dist;
+        }
+    }
 
-    int i=0, j=0, random=0, loopCount=0;
-    srand ( time(NULL) );
-    int randCentInd[k];
-    bool answer;
-    bool equivilent = false;
-    RandomCentroid *rCent;
-    RandomCentroid *tmpCent;
+    cents->kGroup[i] = best;
+    upper[i] = bestDist;
+    lower[i] = secondDist;
+}
 
-    rCent = malloc(k*sizeof(RandomCentroid));
-    tmpCent = malloc(k*sizeof(RandomCentroid));
+/**
+  *@brief Hamerly assignment step.  upper bounds the distance of every centroid to its own center and
+  *         lower the distance to every other center.  A centroid whose upper bound is below its lower
+  *         bound, or below half the distance from its center to the nearest other center, cannot
+  *         change cluster and is skipped.  Only the remaining centroids are measured against all
+  *         centers, so the result is the same as the exhaustive assignment.
+  *
+  *INPUTS
+  *@param cents   : Centroid table assigned in the previous iteration.
+  *@param rCent   : Cluster centers.
+  *@param upper   : Upper bounds, updated.
+  *@param lower   : Lower bounds, updated.
+  *@param spacing : Scratch array of k elements.
+  *
+  *OUTPUTS
+  *@param cents : kGroup of every centroid set to its closest cluster.
+  */
+static void hamerlyAssign(CentroidTable *cents,const RandomCentroid *rCent,double *upper,double *lower,double *spacing){
 
-    for(i=0; i<k; i++){
-        answer = true;
-        while(answer == true){
-            random = rand() % (k + 1);
-            answer = ValueInArray(random,randCentInd,k);
+    int i=0, a=0, b=0, k=cents->k;
+    double dist=0.0, bound=0.0;
+
+    for(a=0; a<k; a++){
+        spacing[a] = HUGE_VAL;
+    }
+    for(a=0; a<k; a++){
+        for(b=a+1; b<k; b++){
+            dist = 0.5 * calcDist(rCent[a].x,rCent[a].y,rCent[b].x,rCent[b].y);
+            if(dist < spacing[a])
+                spacing[a] = dist;
+            if(dist < spacing[b])
+                spacing[b] = dist;
         }
-        randCentInd[i] = random;
-        //printf("random number: %d\n",randCentInd[i]);
     }
 
-    for(i=0; i<k; i++){
-        rCent[i].x = cents[randCentInd[i]].x;
-        rCent[i].y = cents[randCentInd[i]].y;
-        //printf("Random Centroid Values %d: %d %d\n",j,rCent[i].x,rCent[i].y);
+    for(i=0; i<cents->count; i++){
+        a = cents->kGroup[i];
+        bound = (spacing[a] > lower[i] ? spacing[a] : lower[i]) - KMEANS_BOUND_SLACK;
+        if(upper[i] < bound)
+            continue;
+
+        // Tighten the upper bound before measuring every center
+        upper[i] = calcDist(rCent[a].x,rCent[a].y,cents->x[i],cents->y[i]);
+        if(upper[i] < bound)
+            continue;
+
+        assignCentroid(cents,i,rCent,upper,lower);
     }
+}
 
-    for(i=0; i<k; i++){
-        for(j=0; j<numCents; j++){
-            cents[j].distances[i] = calcDist(rCent[i].x,rCent[i].y,cents[j].x,cents[j].y);
-            //printf("Current Cent Distance: %f\n",cents[j].distances[i]);
+/**
+  *@brief Loosen the Hamerly bounds by how far the cluster centers moved.
+  *
+  *INPUTS
+  *@param cents   : Centroid table.
+  *@param oldCent : Cluster centers before the update.
+  *@param newCent : Cluster centers after the update.
+  *@param upper   : Upper bounds, updated.
+  *@param lower   : Lower bounds, updated.
+  *@param moved   : Scratch array of k elements.
+  *
+  *OUTPUTS
+  *none
+  */
+static void moveBounds(const CentroidTable *cents,const RandomCentroid *oldCent,const RandomCentroid *newCent,
+                       double *upper,double *lower,double *moved){
+
+    int i=0, c=0, farthest=0;
+    double largest=0.0, second=0.0;
+
+    for(c=0; c<cents->k; c++){
+        moved[c] = calcDist(oldCent[c].x,oldCent[c].y,newCent[c].x,newCent[c].y);
+        if(moved[c] > largest){
+            second = largest;
+            largest = moved[c];
+            farthest = c;
+        }
+        else if(moved[c] > second){
+            second = moved[c];
         }
     }
 
-    sortCentroids(numCents,k,cents);
+    // The other centers came at most as close as the farthest moving one of them
+    for(i=0; i<cents->count; i++){
+        c = cents->kGroup[i];
+        upper[i] += moved[c];
+        lower[i] -= c == farthest ? second : largest;
+    }
+}
 
-    for(i=0; i<k; i++){
-        tmpCent[i].x = rCent[i].x;
-        tmpCent[i].y = rCent[i].y;
+/**
+  *@brief Prepare a k-means context.  Buffers are allocated on demand and reused every frame.
+  *
+  *INPUTS
+  *@param ctx     : Context to be initialized.
+  *@param mode    : Assignment algorithm.
+  *@param seeding : How the cluster centers of every frame are initialized.
+  *@param seed    : Random number generator seed, equal seeds give identical clusters.
+  *
+  *OUTPUTS
+  *none
+  */
+void initKMeansContext(KMeansContext* ctx, KMeansMode mode, KMeansSeeding seeding, unsigned int seed){
+
+    memset(ctx, 0, sizeof(KMeansContext));
+    ctx->mode = mode;
+    ctx->seeding = seeding;
+    ctx->seed = seed;
+    ctx->random = seed;
+    initSpatialGrid(&ctx->grid);
+}
+
+/**
+  *@brief Free the buffers of a k-means context, which returns to its freshly seeded state.
+  *
+  *INPUTS
+  *@param ctx : Context to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeKMeansContext(KMeansContext* ctx){
+
+    free(ctx->centers);
+    free(ctx->previous);
+    free(ctx->centerX);
+    free(ctx->centerY);
+    free(ctx->batchCount);
+    free(ctx->upper);
+    free(ctx->lower);
+    freeSpatialGrid(&ctx->grid);
+    initKMeansContext(ctx, ctx->mode, ctx->seeding, ctx->seed);
+}
+
+/**
+  *@brief Next value of the context's random number generator, uniform in [0, 1).
+  */
+static double randomUnit(KMeansContext* ctx){
+
+    // 64 bit linear congruential generator (Knuth MMIX), the top 53 bits form the mantissa
+    ctx->random = ctx->random * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (ctx->random >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+  *@brief Grow an array to a new number of elements, quitting the program when memory runs out.
+  */
+static void* growArray(void* array, int count, size_t size){
+
+    // realloc_growArray k-means context arrays free in freeKMeansContext
+    void* grown = realloc(array, count * size);
+
+    if(grown == NULL){
+        printf("Error: Cannot allocate k-means memory.  Quitting program.");
+        exit(0);
+    }
+    return grown;
+}
+
+/**
+  *@brief Choose the k initial cluster centers with k-means++.  Every center is a centroid drawn
+  *         with probability proportional to its squared distance from the nearest center chosen
+  *         so far.  The first numKept centers are already set and only the rest are drawn.
+  *
+  *INPUTS
+  *@param ctx       : Context providing the random numbers, its lower array is used as scratch.
+  *@param cents     : Centroids of the frame.
+  *@param sample    : Centroids to draw from, NULL for all of them.
+  *@param numSample : Number of centroids in sample.
+  *@param numKept   : Centers already set.
+  *@param k         : Number of clusters.
+  *
+  *OUTPUTS
+  *@param ctx : centers 0 to k-1 set.
+  */
+static void seedCenters(KMeansContext* ctx,const CentroidTable *cents,const int *sample,int numSample,int numKept,int k){
+
+    int i=0, c=0, pick=0, index=0;
+    double dx=0.0, dy=0.0, dist=0.0, total=0.0, target=0.0;
+    double *weight = ctx->lower;
+
+    if(numKept >= k)
+        return;
+
+    for(i=0; i<numSample; i++){
+        weight[i] = HUGE_VAL;
     }
 
-    adjustRandomCentroid(numCents,k,cents,rCent);
+    for(c=0; c<k; c++){
+        if(c >= numKept){
+            if(c == 0 || total == 0.0){
+                pick = (int)(randomUnit(ctx) * numSample);
+            }
+            else{
+                // Centroids sitting on a center have no weight and are never drawn
+                target = randomUnit(ctx) * total;
+                for(i=0; i<numSample; i++){
+                    if(weight[i] > 0.0){
+                        pick = i;
+                        target -= weight[i];
+                        if(target < 0.0)
+                            break;
+                    }
+                }
+            }
+            index = sample != NULL ? sample[pick] : pick;
+            ctx->centers[c].x = cents->x[index];
+            ctx->centers[c].y = cents->y[index];
+        }
+        if(c == k-1)
+            break;
+
+        // Squared distance of every centroid to its nearest center, updated with center c
+        total = 0.0;
+        for(i=0; i<numSample; i++){
+            index = sample != NULL ? sample[i] : i;
+            dx = cents->x[index] - ctx->centers[c].x;
+            dy = cents->y[index] - ctx->centers[c].y;
+            dist = dx*dx + dy*dy;
+            if(dist < weight[i])
+                weight[i] = dist;
+            total += weight[i];
+        }
+    }
+}
 
-    equivilent = compareCents(tmpCent,rCent,k);
+/**
+  *@brief Lloyd or Hamerly k-means over every centroid of the frame, from seeded centers.
+  *
+  *INPUTS
+  *@param ctx   : K-means context holding the seeded centers.
+  *@param cents : Centroid table of the image.
+  *@param k     : Number of clusters.
+  *
+  *OUTPUTS
+  *@param cents     : Cluster of every centroid and its distance to the cluster center.
+  *@param converged : True if the centers converged within KMEANS_MAX_ITERATIONS.
+  *@param Number of iterations.
+  */
+static int fullBatchKMeans(KMeansContext* ctx,CentroidTable *cents,int k,bool *converged){
+
+    int i=0, iterations=0, numCents=cents->count;
+    bool hamerly = ctx->mode != KMEANS_LLOYD;
+    double scratch[k];
+    RandomCentroid *rCent = ctx->centers;
+    RandomCentroid *tmpCent = ctx->previous;
+
+    *converged = false;
+    while(*converged == false && iterations < KMEANS_MAX_ITERATIONS){
+        if(hamerly == false){
+            measureDistances(cents,rCent);
+            sortCentroids(cents);
+        }
+        else if(iterations == 0){
+            for(i=0; i<numCents; i++){
+                assignCentroid(cents,i,rCent,ctx->upper,ctx->lower);
+            }
+        }
+        else{
+            hamerlyAssign(cents,rCent,ctx->upper,ctx->lower,scratch);
+        }
 
-    while(equivilent == false){
-        sortCentroids(numCents,k,cents);
         for(i=0; i<k; i++){
             tmpCent[i].x = rCent[i].x;
             tmpCent[i].y = rCent[i].y;
         }
-        adjustRandomCentroid(numCents,k,cents,rCent);
-        equivilent = compareCents(tmpCent,rCent,k);
-        loopCount += 1;
+        adjustRandomCentroid(cents,rCent);
+        *converged = compareCents(tmpCent,rCent,k);
+
+        if(hamerly && *converged == false)
+            moveBounds(cents,tmpCent,rCent,ctx->upper,ctx->lower,scratch);
+        iterations += 1;
+    }
+
+    // Distance to the centers the final assignment was made with, as sortCentroids records it
+    if(hamerly){
+        for(i=0; i<numCents; i++){
+            cents->clusterDist[i] = calcDist(tmpCent[cents->kGroup[i]].x,tmpCent[cents->kGroup[i]].y,
+                                             cents->x[i],cents->y[i]);
+        }
+    }
+
+    return iterations;
+}
+
+/**
+  *@brief Index the k cluster centers in the context's spatial grid.
+  */
+static void buildCenterGrid(KMeansContext* ctx,int k){
+
+    int c=0;
+    double minX=0.0, minY=0.0, maxX=0.0, maxY=0.0;
+
+    minX = maxX = ctx->centers[0].x;
+    minY = maxY = ctx->centers[0].y;
+    for(c=0; c<k; c++){
+        ctx->centerX[c] = ctx->centers[c].x;
+        ctx->centerY[c] = ctx->centers[c].y;
+        minX = ctx->centerX[c] < minX ? ctx->centerX[c] : minX;
+        maxX = ctx->centerX[c] > maxX ? ctx->centerX[c] : maxX;
+        minY = ctx->centerY[c] < minY ? ctx->centerY[c] : minY;
+        maxY = ctx->centerY[c] > maxY ? ctx->centerY[c] : maxY;
+    }
+
+    // About one center per cell
+    if(buildSpatialGrid(&ctx->grid,ctx->centerX,ctx->centerY,k,sqrt((maxX-minX)*(maxY-minY)/k)) != 1){
+        printf("Error: Cannot allocate k-means memory.  Quitting program.");
+        exit(0);
+    }
+}
+
+/**
+  *@brief Closest cluster center to a point, found in the center grid.  The search radius doubles
+  *         until a center is found, which is then the closest of all centers.  Ties go to the
+  *         lowest cluster index.
+  *
+  *INPUTS
+  *@param ctx : Context with the center grid built.
+  *@param x   : x coordinate of the point.
+  *@param y   : y coordinate of the point.
+  *
+  *OUTPUTS
+  *@param distSq : Squared distance to the closest center.
+  *@param Index of the closest center.
+  */
+static int nearestCenter(const KMeansContext* ctx,double x,double y,double *distSq){
+
+    int c=-1;
+    double radius = ctx->grid.cellSize;
+
+    while(c < 0){
+        c = nearestInGrid(&ctx->grid,x,y,radius,NULL,distSq);
+        radius *= 2.0;
+    }
+    return c;
+}
+
+/**
+  *@brief Mini-batch k-means (Sculley, 2010).  Every iteration assigns a batch of KMEANS_BATCH_SIZE
+  *         centroids drawn at random to their closest centers and moves each center towards its
+  *         batch centroids with a learning rate of one over the number of centroids it has been
+  *         moved by, so centers settle as they see more data.  A final pass assigns every centroid.
+  *         The learning rate keeps the centers moving by more than KMEANS_TOLERANCE long after the
+  *         clusters stop improving, so the centers have converged once the mean squared distance of
+  *         the batch centroids to their centers, smoothed over the last batches, has not reached a
+  *         new low for KMEANS_BATCH_NO_IMPROVEMENT batches (Sculley's early stopping).
+  *         Centers are found through a spatial grid, so the cost of an iteration does not depend
+  *         on the number of centroids or clusters.
+  *
+  *INPUTS
+  *@param ctx     : K-means context.
+  *@param cents   : Centroid table of the image, at least KMEANS_BATCH_SIZE centroids.
+  *@param numKept : Centers kept from the previous frame.
+  *@param k       : Number of clusters.
+  *
+  *OUTPUTS
+  *@param cents     : Cluster of every centroid and its distance to the cluster center.
+  *@param converged : True if the centers converged within KMEANS_BATCH_ITERATIONS.
+  *@param Number of iterations.
+  */
+static int miniBatchKMeans(KMeansContext* ctx,CentroidTable *cents,int numKept,int k,bool *converged){
+
+    int i=0, b=0, c=0, iterations=0, noImprovement=0, numCents=cents->count;
+    int batch[KMEANS_BATCH_SIZE];
+    int batchGroup[KMEANS_BATCH_SIZE];
+    double distSq=0.0, rate=0.0, inertia=0.0, smoothed=0.0, best=HUGE_VAL;
+    double smoothing = 2.0 / (KMEANS_BATCH_SMOOTHING + 1);
+    RandomCentroid *rCent = ctx->centers;
+    RandomCentroid *tmpCent = ctx->previous;
+
+    // Seed from one batch rather than every centroid
+    for(b=0; b<KMEANS_BATCH_SIZE; b++){
+        batch[b] = (int)(randomUnit(ctx) * numCents);
+    }
+    seedCenters(ctx,cents,batch,KMEANS_BATCH_SIZE,numKept,k);
+
+    // The seed of every center counts as one centroid
+    for(c=0; c<k; c++){
+        ctx->batchCount[c] = 1.0;
+    }
+
+    *converged = false;
+    while(*converged == false && iterations < KMEANS_BATCH_ITERATIONS){
+        buildCenterGrid(ctx,k);
+        inertia = 0.0;
+        for(b=0; b<KMEANS_BATCH_SIZE; b++){
+            batch[b] = (int)(randomUnit(ctx) * numCents);
+            batchGroup[b] = nearestCenter(ctx,cents->x[batch[b]],cents->y[batch[b]],&distSq);
+            inertia += distSq;
+        }
+        inertia /= KMEANS_BATCH_SIZE;
+        smoothed = iterations == 0 ? inertia : smoothed + smoothing * (inertia - smoothed);
+        if(smoothed < best){
+            best = smoothed;
+            noImprovement = 0;
+        }
+        else{
+            noImprovement += 1;
+        }
+
+        for(c=0; c<k; c++){
+            tmpCent[c].x = rCent[c].x;
+            tmpCent[c].y = rCent[c].y;
+        }
+        for(b=0; b<KMEANS_BATCH_SIZE; b++){
+            c = batchGroup[b];
+            ctx->batchCount[c] += 1.0;
+            rate = 1.0 / ctx->batchCount[c];
+            rCent[c].x += rate * (cents->x[batch[b]] - rCent[c].x);
+            rCent[c].y += rate * (cents->y[batch[b]] - rCent[c].y);
+        }
+        *converged = compareCents(tmpCent,rCent,k) || noImprovement >= KMEANS_BATCH_NO_IMPROVEMENT;
+        iterations += 1;
+    }
+
+    buildCenterGrid(ctx,k);
+    for(i=0; i<numCents; i++){
+        cents->kGroup[i] = nearestCenter(ctx,cents->x[i],cents->y[i],&distSq);
+        cents->clusterDist[i] = sqrt(distSq);
+    }
+
+    return iterations;
+}
+
+/**
+  *@brief K-Means sorting based on k = sqrt(number of centroids / 2)
+  *         Sorts centroids into k clusters based on their distance from the cluster center.
+  *         KMEANS_LLOYD measures every centroid against every center on every iteration,
+  *         KMEANS_HAMERLY keeps distance bounds per centroid and only measures the centroids
+  *         that may change cluster.  Both produce the same clusters.  KMEANS_MINIBATCH updates
+  *         the centers from random batches of centroids on frames of at least
+  *         KMEANS_BATCH_MIN_CENTROIDS centroids, and clusters smaller frames like KMEANS_HAMERLY.
+  *         Centers are seeded with k-means++ from the context's random number generator.  With
+  *         KMEANS_SEED_WARM the centers the previous call converged to are kept and k-means++
+  *         only adds the ones missing when k has grown.
+  *
+  *INPUTS
+  *@param ctx      : K-means context, reused for every frame of a run.
+  *@param image    : PGMIMage structure image to be analyzed.
+  *@param k        : Number of clusters.
+  *@param cents    : Centroid table of the image.
+  *
+  *OUTPUTS
+  *@param cents : Cluster of every centroid and its distance to the cluster center.
+  *@param ctx   : Converged cluster centers and iteration counts.
+  *@param Number of iterations, the iteration limit if k-means did not converge.
+  */
+int kmeans(KMeansContext* ctx,PGMImage* image,int k,CentroidTable *cents){
+
+    int i=0, iterations=0, numKept=0, numCents=cents->count;
+    bool converged = false;
+
+    if(reserveCentroids(cents,numCents,k) != 1){
+        printf("Error: Cannot allocate centroid memory.  Quitting program.");
+        exit(0);
+    }
+
+    // Fewer than two centroids form no clusters
+    if(k < 1){
+        for(i=0; i<numCents; i++){
+            cents->kGroup[i] = 0;
+            cents->clusterDist[i] = 0.0;
+        }
+        printf("Number of clusters: %d\n",k);
+        return 0;
+    }
 
-        // If cluster centroid has not converged in 500 attempts,
-        // use current cluster centroid
-        if(loopCount >= 500)
-            equivilent = true;
+    if(k > ctx->centerCapacity){
+        ctx->centers = growArray(ctx->centers, k, sizeof(RandomCentroid));
+        ctx->previous = growArray(ctx->previous, k, sizeof(RandomCentroid));
+        ctx->centerX = growArray(ctx->centerX, k, sizeof(double));
+        ctx->centerY = growArray(ctx->centerY, k, sizeof(double));
+        ctx->batchCount = growArray(ctx->batchCount, k, sizeof(double));
+        ctx->centerCapacity = k;
+    }
+    if(numCents > ctx->boundCapacity){
+        ctx->upper = growArray(ctx->upper, numCents, sizeof(double));
+        ctx->lower = growArray(ctx->lower, numCents, sizeof(double));
+        ctx->boundCapacity = numCents;
+    }
+    // Distance matrix sized for k columns, reused from earlier frames when large enough
+    if(ctx->mode == KMEANS_LLOYD && reserveDistances(cents) != 1){
+        printf("Error: Cannot allocate centroid memory.  Quitting program.");
+        exit(0);
     }
 
-    printf("Number of clusters: %d\n",k);
+    if(ctx->seeding == KMEANS_SEED_WARM)
+        numKept = ctx->numCenters < k ? ctx->numCenters : k;
+
+    if(ctx->mode == KMEANS_MINIBATCH && numCents >= KMEANS_BATCH_MIN_CENTROIDS){
+        iterations = miniBatchKMeans(ctx,cents,numKept,k,&converged);
+    }
+    else{
+        seedCenters(ctx,cents,NULL,numCents,numKept,k);
+        iterations = fullBatchKMeans(ctx,cents,k,&converged);
+    }
+
+    ctx->numCenters = k;
+    ctx->iterations = iterations;
+    ctx->totalIterations += iterations;
+    ctx->numClustered += 1;
+    // Not converged within the iteration limit, the current centers are used
+    if(converged == false)
+        ctx->numCapped += 1;
+
+    printf("Number of clusters: %d, %s after %d iterations\n",k,converged ? "converged" : "stopped",iterations);
     for(i=0; i<k; i++){
-        printf("Cluster %d (X,Y) center: %d %d\n",i,rCent[i].x,rCent[i].y);
+        printf("Cluster %d (X,Y) center: %f %f\n",i,ctx->centers[i].x,ctx->centers[i].y);
     }
 
-    free(tmpCent);
-    tmpCent = NULL;
-    free(rCent);
-    rCent = NULL;
+    return iterations;
 }
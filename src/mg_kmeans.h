@@ -17,12 +17,59 @@ Arizona State University
 #include "mg.h"
 #include "mg_centroid.h"
 
+typedef enum KMeansMode {
+  KMEANS_LLOYD,
+  KMEANS_HAMERLY,
+  KMEANS_MINIBATCH
+} KMeansMode;
+
+typedef enum KMeansSeeding {
+  KMEANS_SEED_PLUSPLUS,
+  KMEANS_SEED_WARM
+} KMeansSeeding;
+
+// K-means state kept across the frames of one run.  Each thread clustering frames needs its own
+// context.
+//   random          : random number generator state, started from seed
+//   centers         : cluster centers, after a call the centers it converged to
+//   numCenters      : number of converged centers, the warm start for the next frame
+//   previous        : centers of the previous iteration
+//   centerX/Y, grid : centers indexed for nearest center queries by mini-batch k-means
+//   batchCount      : centroids every center has been moved by, mini-batch learning rate is 1/batchCount
+//   upper/lower     : Hamerly distance bounds of every centroid, lower doubles as k-means++ scratch
+//   iterations      : iterations of the last frame clustered
+//   totalIterations : iterations of all numClustered frames clustered, numCapped of which did not
+//                     converge within the iteration limit
+typedef struct KMeansContext {
+  KMeansMode mode;
+  KMeansSeeding seeding;
+  unsigned int seed;
+  unsigned long long random;
+  int numCenters;
+  int centerCapacity;
+  RandomCentroid* centers;
+  RandomCentroid* previous;
+  double* centerX;
+  double* centerY;
+  double* batchCount;
+  SpatialGrid grid;
+  int boundCapacity;
+  double* upper;
+  double* lower;
+  int iterations;
+  long long totalIterations;
+  int numClustered;
+  int numCapped;
+} KMeansContext;
+
 void createRandomCent(int numCents);
 bool ValueInArray(int val, int *arr, int arrSize);
-double calcDist(int x1,int y1,int x2,int y2);
-bool compareCents(RandomCentroid *rCents1,RandomCentroid *rCents2, int k);
-void adjustRandomCentroid(int numCent,int k,Centroid *cents,RandomCentroid *rCent);
-void sortCentroids(int numCent,int k,Centroid *cents);
-void kmeans(PGMImage* image,int k,Centroid *cents,int numCents);
+double calcDist(double x1,double y1,double x2,double y2);
+bool compareCents(const RandomCentroid *rCents1,const RandomCentroid *rCents2, int k);
+void adjustRandomCentroid(const CentroidTable *cents,RandomCentroid *rCent);
+void sortCentroids(CentroidTable *cents);
+void initKMeansContext(KMeansContext* ctx, KMeansMode mode, KMeansSeeding seeding, unsigned int seed);
+void freeKMeansContext(KMeansContext* ctx);
+int kmeans(KMeansContext* ctx,PGMImage* image,int k,CentroidTable *cents);
 
 #endif // MG_KMEANS_H_INCLUDED
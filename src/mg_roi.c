@@ -0,0 +1,406 @@
+/*
+Primary accretion detection algorithm.
+
+Region of interest cropping for downlink.  The bounding boxes of a frame's connected
+components are grown by a margin and merged into a few rectangles, only those are sent.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mg.h"
+#include "mg_image.h"
+#include "mg_codec.h"
+#include "mg_roi.h"
+
+static long long rectArea(const RoiRect* r)
+{
+    return (long long)(r->maxX - r->minX + 1) * (r->maxY - r->minY + 1);
+}
+
+static RoiRect rectUnion(const RoiRect* a, const RoiRect* b)
+{
+    RoiRect u;
+
+    u.minX = a->minX < b->minX ? a->minX : b->minX;
+    u.minY = a->minY < b->minY ? a->minY : b->minY;
+    u.maxX = a->maxX > b->maxX ? a->maxX : b->maxX;
+    u.maxY = a->maxY > b->maxY ? a->maxY : b->maxY;
+    return u;
+}
+
+/**
+  *@brief Pixels saved by sending rectangles a and b as one rectangle: their areas plus the cost
+  *          of a tile, less the area of their union.  Negative when the union takes in more
+  *          background than a tile costs.
+  */
+static long long mergeGain(const RoiRect* a, const RoiRect* b, int tileCost)
+{
+    RoiRect u = rectUnion(a, b);
+
+    return rectArea(a) + rectArea(b) + tileCost - rectArea(&u);
+}
+
+/**
+  *@brief Find the best merge partner of rectangle i among the first count rectangles.
+  */
+static void findBest(RoiMerger* merger, int i, int count, int tileCost)
+{
+    int j=0;
+    long long gain=0;
+
+    merger->best[i] = -1;
+    for(j = 0; j < count; j++){
+        if(j == i)
+            continue;
+        gain = mergeGain(&merger->rects[i], &merger->rects[j], tileCost);
+        if(merger->best[i] < 0 || gain > merger->gain[i]){
+            merger->best[i] = j;
+            merger->gain[i] = gain;
+        }
+    }
+}
+
+/**
+  *@brief Grown bounding box of a component, clipped to the frame.
+  */
+static RoiRect growBox(const Component* c, int margin, int width, int height)
+{
+    RoiRect r;
+
+    r.minX = c->minX - margin > 0 ? c->minX - margin : 0;
+    r.minY = c->minY - margin > 0 ? c->minY - margin : 0;
+    r.maxX = c->maxX + margin < width ? c->maxX + margin : width - 1;
+    r.maxY = c->maxY + margin < height ? c->maxY + margin : height - 1;
+    return r;
+}
+
+/**
+  *@brief Bin the grown boxes of the components into a grid of at most ROI_MERGE_LIMIT cells,
+  *          each box going to the cell holding its center.  The boxes of a cell are merged into
+  *          one rectangle, so a frame costs O(number of components).
+  *
+  *INPUTS
+  *@param merger     : Workspace holding ROI_MERGE_LIMIT rectangles.
+  *@param components : Components of the frame.
+  *@param margin     : Pixels added around every bounding box.
+  *@param width      : Frame width.
+  *@param height     : Frame height.
+  *
+  *OUTPUTS
+  *@param merger : rects holds the rectangles of the cells that received a box.
+  *@param Number of rectangles.
+  */
+static int binBoxes(RoiMerger* merger, const ComponentTable* components, int margin, int width, int height)
+{
+    int i=0, cell=0, count=0, cols=1, rows=1;
+    RoiRect r;
+
+    // About square cells, cols * rows <= ROI_MERGE_LIMIT
+    while(cols < ROI_MERGE_LIMIT && (long long)(cols + 1) * (cols + 1) * height <= (long long)ROI_MERGE_LIMIT * width){
+        cols++;
+    }
+    rows = ROI_MERGE_LIMIT / cols;
+
+    // An empty cell has minX > maxX
+    for(cell = 0; cell < cols * rows; cell++){
+        merger->rects[cell].minX = 1;
+        merger->rects[cell].maxX = 0;
+    }
+    for(i = 0; i < components->count; i++){
+        r = growBox(&components->items[i], margin, width, height);
+        cell = (int)((long long)((r.minY + r.maxY) / 2) * rows / height) * cols +
+               (int)((long long)((r.minX + r.maxX) / 2) * cols / width);
+        if(merger->rects[cell].minX > merger->rects[cell].maxX)
+            merger->rects[cell] = r;
+        else
+            merger->rects[cell] = rectUnion(&merger->rects[cell], &r);
+    }
+
+    for(cell = 0; cell < cols * rows; cell++){
+        if(merger->rects[cell].minX <= merger->rects[cell].maxX)
+            merger->rects[count++] = merger->rects[cell];
+    }
+    return count;
+}
+
+/**
+  *@brief Prepare an empty merger.
+  *
+  *INPUTS
+  *@param merger : Merger to be initialized.
+  *
+  *OUTPUTS
+  *none
+  */
+void initRoiMerger(RoiMerger* merger)
+{
+    memset(merger, 0, sizeof(RoiMerger));
+}
+
+void freeRoiMerger(RoiMerger* merger)
+{
+    free(merger->rects);
+    free(merger->best);
+    free(merger->gain);
+    initRoiMerger(merger);
+}
+
+/**
+  *@brief Regions of interest of a frame.  Every component's bounding box is grown by margin
+  *          pixels, then the two rectangles whose merge saves the most are merged for as long
+  *          as a merge saves anything or there are more than maxRects of them.  Each rectangle
+  *          is charged tileCost pixels, the downlink overhead of sending it on its own.  The
+  *          best partner of every rectangle is kept and only refreshed for rectangles a merge
+  *          affects, about n^2 gain evaluations for n components.  Frames of more than
+  *          ROI_MERGE_LIMIT components have their boxes binned into a coarse grid first, see
+  *          binBoxes, which bounds the pairwise merge.
+  *
+  *INPUTS
+  *@param merger     : Workspace reused across frames.
+  *@param components : Components of the frame, from ConnectedComponentLabeling.
+  *@param original   : Grayscale frame, sets the background value.
+  *@param margin     : Pixels added around every bounding box.
+  *@param maxRects   : Largest number of rectangles, 1 to ROI_MAX_RECTS.
+  *@param tileCost   : Overhead of a rectangle in pixels.
+  *
+  *OUTPUTS
+  *@param roi : Rectangles to be sent.
+  */
+void findRegions(RoiMerger* merger, const ComponentTable* components, const PGMImage* original,
+                 int margin, int maxRects, int tileCost, FrameRoi* roi)
+{
+    int i=0, j=0, k=0, y=0, x=0, n=components->count, last=0;
+    int width = original->header.width, height = original->header.height;
+    long long histogram[256];
+    const unsigned char* row;
+
+    if(maxRects < 1)
+        maxRects = 1;
+    if(maxRects > ROI_MAX_RECTS)
+        maxRects = ROI_MAX_RECTS;
+
+    roi->width = width;
+    roi->height = height;
+    roi->background = 0;
+    roi->count = 0;
+
+    // Background value, the most common pixel value of the frame
+    if(!PGMIS16BIT(original)){
+        memset(histogram, 0, sizeof(histogram));
+        for(y = 0; y < height; y++){
+            row = PGMROW(original, y);
+            for(x = 0; x < width; x++){
+                histogram[row[x]]++;
+            }
+        }
+        for(i = 1; i < 256; i++){
+            if(histogram[i] > histogram[roi->background])
+                roi->background = i;
+        }
+    }
+
+    if(n == 0)
+        return;
+
+    k = n < ROI_MERGE_LIMIT ? n : ROI_MERGE_LIMIT;
+    if(k > merger->capacity){
+        // malloc_findRegions rects, best, gain free in freeRoiMerger
+        free(merger->rects);
+        free(merger->best);
+        free(merger->gain);
+        merger->rects = malloc(k * sizeof(RoiRect));
+        merger->best = malloc(k * sizeof(int));
+        merger->gain = malloc(k * sizeof(long long));
+        if(merger->rects == NULL || merger->best == NULL || merger->gain == NULL){
+            printf("Error: Cannot allocate region memory.  Quitting program.");
+            exit(0);
+        }
+        merger->capacity = k;
+    }
+
+    if(n > ROI_MERGE_LIMIT){
+        n = binBoxes(merger, components, margin, width, height);
+    }
+    else{
+        for(i = 0; i < n; i++){
+            merger->rects[i] = growBox(&components->items[i], margin, width, height);
+        }
+    }
+    for(i = 0; i < n; i++){
+        findBest(merger, i, n, tileCost);
+    }
+
+    while(n > 1){
+        i = 0;
+        for(k = 1; k < n; k++){
+            if(merger->gain[k] > merger->gain[i])
+                i = k;
+        }
+        if(merger->gain[i] < 0 && n <= maxRects)
+            break;
+
+        // Merge the pair into the lower slot, the last rectangle fills the higher one
+        j = merger->best[i];
+        if(j < i){
+            k = i;
+            i = j;
+            j = k;
+        }
+        merger->rects[i] = rectUnion(&merger->rects[i], &merger->rects[j]);
+        last = n - 1;
+        merger->rects[j] = merger->rects[last];
+        merger->best[j] = merger->best[last];
+        merger->gain[j] = merger->gain[last];
+        n--;
+
+        for(k = 0; k < n; k++){
+            if(merger->best[k] == last)
+                merger->best[k] = j;
+        }
+        findBest(merger, i, n, tileCost);
+        for(k = 0; k < n; k++){
+            if(k == i)
+                continue;
+            // Partners that grew or went away need a full search, the others only the merged one
+            if(merger->best[k] == i || merger->best[k] == j || merger->best[k] < 0){
+                findBest(merger, k, n, tileCost);
+            }
+            else if(mergeGain(&merger->rects[k], &merger->rects[i], tileCost) > merger->gain[k]){
+                merger->best[k] = i;
+                merger->gain[k] = mergeGain(&merger->rects[k], &merger->rects[i], tileCost);
+            }
+        }
+    }
+
+    roi->count = n;
+    memcpy(roi->rects, merger->rects, n * sizeof(RoiRect));
+}
+
+/**
+  *@brief Number of pixels the rectangles of a frame cover, counting overlaps once per rectangle.
+  */
+long long roiArea(const FrameRoi* roi)
+{
+    int i=0;
+    long long area=0;
+
+    for(i = 0; i < roi->count; i++){
+        area += rectArea(&roi->rects[i]);
+    }
+    return area;
+}
+
+/**
+  *@brief Rectangles of a frame in the form encodeRects and decodeRects take.
+  *
+  *INPUTS
+  *@param roi : Regions of the frame.
+  *
+  *OUTPUTS
+  *@param rects : ROI_MAX_RECTS entries.
+  *@param Number of rectangles.
+  */
+int roiCodecRects(const FrameRoi* roi, CodecRect* rects)
+{
+    int i=0;
+
+    for(i = 0; i < roi->count; i++){
+        rects[i].x = roi->rects[i].minX;
+        rects[i].y = roi->rects[i].minY;
+        rects[i].width = roi->rects[i].maxX - roi->rects[i].minX + 1;
+        rects[i].height = roi->rects[i].maxY - roi->rects[i].minY + 1;
+    }
+    return roi->count;
+}
+
+static void putRoi16(unsigned char* p, int value)
+{
+    p[0] = (unsigned char)(value >> 8);
+    p[1] = (unsigned char)value;
+}
+
+static int getRoi16(const unsigned char* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/**
+  *@brief Write the reconstruction header of a cropped frame.
+  *
+  *INPUTS
+  *@param roi : Regions of the frame.
+  *
+  *OUTPUTS
+  *@param header : ROI_HEADER_SIZE(roi->count) bytes.
+  *@param Size of the header in bytes.
+  */
+int writeRoiHeader(const FrameRoi* roi, unsigned char* header)
+{
+    int i=0, size = ROI_HEADER_SIZE(roi->count);
+    unsigned char* r;
+
+    header[0] = 'M';
+    header[1] = 'R';
+    header[2] = ROI_VERSION;
+    header[3] = (unsigned char)roi->background;
+    putRoi16(header + 4, roi->width);
+    putRoi16(header + 6, roi->height);
+    header[8] = (unsigned char)roi->count;
+    for(i = 0; i < roi->count; i++){
+        r = header + 9 + ROI_RECT_SIZE * i;
+        putRoi16(r, roi->rects[i].minX);
+        putRoi16(r + 2, roi->rects[i].minY);
+        putRoi16(r + 4, roi->rects[i].maxX - roi->rects[i].minX + 1);
+        putRoi16(r + 6, roi->rects[i].maxY - roi->rects[i].minY + 1);
+    }
+    putRoi16(header + size - 2, (int)codecCRC(header, size - 2));
+    return size;
+}
+
+/**
+  *@brief Parse and check the reconstruction header of a cropped frame.
+  *
+  *INPUTS
+  *@param header : Header bytes.
+  *@param length : Number of bytes available at header.
+  *
+  *OUTPUTS
+  *@param roi : Regions of the frame.
+  *@param Size of the header in bytes, 0 if it is damaged or not a reconstruction header.
+  */
+int readRoiHeader(const unsigned char* header, long length, FrameRoi* roi)
+{
+    int i=0, size=0;
+    const unsigned char* r;
+    RoiRect* rect;
+
+    if(length < ROI_HEADER_SIZE(0) || header[0] != 'M' || header[1] != 'R' || header[2] != ROI_VERSION ||
+       header[8] > ROI_MAX_RECTS)
+        return 0;
+    size = ROI_HEADER_SIZE(header[8]);
+    if(length < size || codecCRC(header, size - 2) != (unsigned int)getRoi16(header + size - 2))
+        return 0;
+
+    roi->background = header[3];
+    roi->width = getRoi16(header + 4);
+    roi->height = getRoi16(header + 6);
+    roi->count = header[8];
+    for(i = 0; i < roi->count; i++){
+        r = header + 9 + ROI_RECT_SIZE * i;
+        rect = &roi->rects[i];
+        rect->minX = getRoi16(r);
+        rect->minY = getRoi16(r + 2);
+        rect->maxX = rect->minX + getRoi16(r + 4) - 1;
+        rect->maxY = rect->minY + getRoi16(r + 6) - 1;
+        if(rect->maxX < rect->minX || rect->maxY < rect->minY || rect->maxX >= roi->width || rect->maxY >= roi->height)
+            return 0;
+    }
+    return size;
+}
@@ -0,0 +1,82 @@
+/*
+Primary accretion detection algorithm.
+
+Region of interest cropping for downlink.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#ifndef MG_ROI_H_INCLUDED
+#define MG_ROI_H_INCLUDED
+
+#include "mg.h"
+#include "mg_conncomp.h"
+#include "mg_codec.h"
+
+#define ROI_MAX_RECTS 16
+
+// Defaults of findRegions.  A margin of 2 pixels keeps the faint edge of every particle.  The tile
+// cost stands for the header bytes and the prediction restart of a rectangle.  Costs up to 64
+// pixels gave the smallest downlinks on the camera data, larger ones merge in background.
+#define ROI_DEFAULT_MARGIN 2
+#define ROI_TILE_COST 64
+
+// Most rectangles findRegions merges pairwise.  Frames with more components have their boxes
+// binned into a grid of at most this many cells first.
+#define ROI_MERGE_LIMIT 256
+
+// A cropped frame is downlinked as a reconstruction header followed by the packets
+// encodeRects codes from its rectangles.  Multi-byte fields are big endian.
+//    0 : sync, 'M' 'R'               8 : number of rectangles
+//    2 : ROI_VERSION                 9 : rectangles, ROI_RECT_SIZE bytes each: x, y, width
+//    3 : background value                and height (2 bytes each)
+//    4 : width                       9 + ROI_RECT_SIZE * count : CRC-16/CCITT of the bytes
+//    6 : height                          before it
+// Pixels outside every rectangle are rebuilt with the background value.
+#define ROI_VERSION 1
+#define ROI_RECT_SIZE 8
+#define ROI_HEADER_SIZE(count) (9 + ROI_RECT_SIZE * (count) + 2)
+
+// Inclusive pixel rectangle
+typedef struct RoiRect {
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+} RoiRect;
+
+// Regions of interest of one frame
+//   width, height : frame size
+//   background    : most common pixel value, used for everything outside the rectangles
+//   count         : number of rectangles, 0 for a frame without particles
+typedef struct FrameRoi {
+  int width;
+  int height;
+  int background;
+  int count;
+  RoiRect rects[ROI_MAX_RECTS];
+} FrameRoi;
+
+// Workspace of findRegions, reused across frames, at most ROI_MERGE_LIMIT rectangles.  best[i] is
+// the rectangle whose merge with rectangle i saves the most, gain[i] what it saves.
+typedef struct RoiMerger {
+  int capacity;
+  RoiRect* rects;
+  int* best;
+  long long* gain;
+} RoiMerger;
+
+void initRoiMerger(RoiMerger* merger);
+void freeRoiMerger(RoiMerger* merger);
+void findRegions(RoiMerger* merger, const ComponentTable* components, const PGMImage* original,
+                 int margin, int maxRects, int tileCost, FrameRoi* roi);
+long long roiArea(const FrameRoi* roi);
+int roiCodecRects(const FrameRoi* roi, CodecRect* rects);
+int writeRoiHeader(const FrameRoi* roi, unsigned char* header);
+int readRoiHeader(const unsigned char* header, long length, FrameRoi* roi);
+
+#endif // MG_ROI_H_INCLUDED
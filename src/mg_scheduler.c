@@ -0,0 +1,334 @@
+/*
+Primary accretion detection algorithm.
+
+Streaming downlink scheduler.  Images are offered as soon as they are scored and staged during the
+sequence, against the byte budget of the passes of a link model.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "mg.h"
+#include "mg_centroid.h"
+#include "mg_roi.h"
+#include "mg_downlink.h"
+#include "mg_scheduler.h"
+
+// Images recorded in DownlinkScheduler.recent
+#define SCHEDULER_RECENT 64
+
+// Slots kept beyond the capacity of the candidate set for required images
+#define SCHEDULER_REQUIRED 2
+
+/**
+  *@brief True if candidate a is sent before candidate b: required images first, then higher
+  *          scores, ties going to the lower image number.
+  */
+static bool candidateAbove(const DownlinkCandidate* a, const DownlinkCandidate* b){
+
+    if(a->required != b->required)
+        return a->required;
+    return a->score > b->score || (a->score == b->score && a->number < b->number);
+}
+
+/**
+  *@brief Whether image number is staged, as far as the last SCHEDULER_RECENT images go.
+  */
+static bool recentlyStaged(const DownlinkScheduler* scheduler, int number){
+
+    int age = scheduler->newest - number;
+
+    return scheduler->frames > 0 && age >= 0 && age < SCHEDULER_RECENT && ((scheduler->recent >> age) & 1);
+}
+
+static int findCandidate(const DownlinkScheduler* scheduler, int number){
+
+    int i=0;
+
+    for(i = 0; i < scheduler->count; i++){
+        if(scheduler->candidates[i].number == number)
+            return i;
+    }
+    return -1;
+}
+
+/**
+  *@brief Record that image number is staged.  Candidates next to it take note, the image itself
+  *          leaves the candidate set if it was waiting there.
+  */
+static void markStaged(DownlinkScheduler* scheduler, int number){
+
+    int i=0, d=0, age = scheduler->newest - number;
+
+    if(age >= 0 && age < SCHEDULER_RECENT)
+        scheduler->recent |= 1ULL << age;
+
+    while(i < scheduler->count){
+        d = number - scheduler->candidates[i].number;
+        if(d == 0){
+            scheduler->candidates[i] = scheduler->candidates[--scheduler->count];
+            continue;
+        }
+        if(d >= -2 && d <= 1)
+            scheduler->candidates[i].staged[d + 2] = true;
+        i++;
+    }
+}
+
+/**
+  *@brief Stage a candidate taken out of the candidate set.  Scored images go together with the
+  *          neighbours they were scored across, as downlinkData sends them.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *@param pick      : Candidate to be staged.
+  *
+  *OUTPUTS
+  *@param Bytes staged.
+  */
+static long long stageCandidate(DownlinkScheduler* scheduler, DownlinkCandidate* pick){
+
+    int number=0, slot=0, index=0, first = scheduler->newest - scheduler->frames + 1;
+    long long bytes=0;
+    double score=0.0;
+
+    for(number = pick->number - 1; number <= pick->number + 1; number++){
+        slot = number - pick->number + 1;
+        if((pick->required && number != pick->number) || number < first || number > scheduler->newest ||
+           pick->staged[slot + 1])
+            continue;
+
+        score = pick->score;
+        if(number != pick->number){
+            index = findCandidate(scheduler, number);
+            score = index >= 0 ? scheduler->candidates[index].score : 0.0;
+        }
+        bytes += stageImage(scheduler->stage, number == pick->number ? pick->reason : "neighbour", number,
+                            score, pick->staged[slot], &pick->rois[slot]);
+        pick->staged[slot + 1] = true;
+        markStaged(scheduler, number);
+        scheduler->images++;
+    }
+    scheduler->bytes += bytes;
+    return bytes;
+}
+
+/**
+  *@brief Open a pass.  The backlog is sent first, then the best candidates are staged for as
+  *          long as the pass has bytes left.  The packets of the last image staged that do not
+  *          fit are left to the next pass.  Draining stages every candidate, whatever does not
+  *          fit goes to the backlog.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *@param drain     : Whether to stage every candidate.
+  *
+  *OUTPUTS
+  *@param Bytes the pass carries.
+  */
+static long long runPass(DownlinkScheduler* scheduler, bool drain){
+
+    int i=0, best=0, images = scheduler->images;
+    long long budget = scheduler->link.passBytes, carried=0, bytes=0;
+    DownlinkCandidate pick;
+
+    carried = scheduler->backlog < budget ? scheduler->backlog : budget;
+    scheduler->backlog -= carried;
+    budget -= carried;
+
+    while((budget > 0 || drain) && scheduler->count > 0){
+        best = 0;
+        for(i = 1; i < scheduler->count; i++){
+            if(candidateAbove(&scheduler->candidates[i], &scheduler->candidates[best]))
+                best = i;
+        }
+        pick = scheduler->candidates[best];
+        scheduler->candidates[best] = scheduler->candidates[--scheduler->count];
+
+        bytes = stageCandidate(scheduler, &pick);
+        if(bytes > budget){
+            scheduler->backlog += bytes - budget;
+            bytes = budget;
+        }
+        budget -= bytes;
+        carried += bytes;
+    }
+
+    scheduler->passes++;
+    scheduler->sent += carried;
+    scheduler->passBytes = carried;
+    scheduler->passImages = scheduler->images - images;
+    if(scheduler->firstPassImage < 0 && carried > 0)
+        scheduler->firstPassImage = scheduler->newest;
+    return carried;
+}
+
+/**
+  *@brief Prepare an empty scheduler.
+  *
+  *INPUTS
+  *@param link     : Contact windows of the downlink.
+  *@param capacity : Largest number of scored images waiting for a pass.
+  *@param stage    : Open downlink stage the images are staged in.
+  *
+  *OUTPUTS
+  *@param scheduler : Scheduler to be initialized.
+  */
+void initDownlinkScheduler(DownlinkScheduler* scheduler, const LinkModel* link, int capacity, DownlinkStage* stage){
+
+    memset(scheduler, 0, sizeof(DownlinkScheduler));
+    scheduler->stage = stage;
+    scheduler->link = *link;
+    scheduler->capacity = capacity > 0 ? capacity : 1;
+    scheduler->firstPassImage = -1;
+
+    // malloc_initDownlinkScheduler candidates free in freeDownlinkScheduler
+    scheduler->candidates = malloc((scheduler->capacity + SCHEDULER_REQUIRED) * sizeof(DownlinkCandidate));
+    if(scheduler->candidates == NULL){
+        printf("Error: Cannot allocate downlink queue memory.  Quitting program.");
+        exit(0);
+    }
+}
+
+void freeDownlinkScheduler(DownlinkScheduler* scheduler){
+
+    free(scheduler->candidates);
+    scheduler->candidates = NULL;
+    scheduler->count = 0;
+}
+
+/**
+  *@brief Record that the next image of the sequence has been analysed.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *@param number    : Number of the image, one more than the image added before it.
+  *@param roi       : Regions of the image, NULL unless images are staged as DOWNLINK_ROI.
+  *
+  *OUTPUTS
+  *none
+  */
+void addSchedulerImage(DownlinkScheduler* scheduler, int number, const FrameRoi* roi){
+
+    int age = number - scheduler->newest;
+
+    if(scheduler->frames == 0 || age >= SCHEDULER_RECENT)
+        scheduler->recent = 0;
+    else
+        scheduler->recent <<= age;
+    scheduler->newest = number;
+    scheduler->frames++;
+    if(roi != NULL)
+        scheduler->regions[number % 3] = *roi;
+}
+
+/**
+  *@brief Offer an image for downlink once its score is known.  Images already staged and scored
+  *          images not scoring above zero are not queued.  When the candidate set is full the
+  *          lowest ranked candidate is evicted, or the offered image itself if it ranks lower.
+  *          Required images may take up to SCHEDULER_REQUIRED slots beyond the capacity.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *@param number    : Number of the image, at most two images before the last one added.
+  *@param score     : Downlink score of the image, see frameScore.
+  *@param reason    : Why the image is sent, recorded in the manifest.
+  *@param required  : Whether the image is sent regardless of its score.
+  *
+  *OUTPUTS
+  *none
+  */
+void offerSchedulerImage(DownlinkScheduler* scheduler, int number, double score, const char* reason, bool required){
+
+    int i=0, worst=-1, neighbour=0;
+    DownlinkCandidate candidate;
+
+    if(recentlyStaged(scheduler, number) || (!required && score <= 0.0))
+        return;
+
+    candidate.number = number;
+    candidate.score = score;
+    candidate.required = required;
+    candidate.reason = reason;
+    for(i = 0; i < 4; i++){
+        candidate.staged[i] = recentlyStaged(scheduler, number - 2 + i);
+    }
+    for(i = 0; i < 3; i++){
+        neighbour = number - 1 + i;
+        if(neighbour >= 0 && neighbour <= scheduler->newest && scheduler->newest - neighbour < 3)
+            candidate.rois[i] = scheduler->regions[neighbour % 3];
+        else
+            memset(&candidate.rois[i], 0, sizeof(FrameRoi));
+    }
+
+    if(scheduler->count < scheduler->capacity || (required && scheduler->count < scheduler->capacity + SCHEDULER_REQUIRED)){
+        scheduler->candidates[scheduler->count++] = candidate;
+        return;
+    }
+
+    for(i = 0; i < scheduler->count; i++){
+        if(!scheduler->candidates[i].required &&
+           (worst < 0 || candidateAbove(&scheduler->candidates[worst], &scheduler->candidates[i])))
+            worst = i;
+    }
+    scheduler->evicted++;
+    if(worst >= 0 && candidateAbove(&candidate, &scheduler->candidates[worst]))
+        scheduler->candidates[worst] = candidate;
+}
+
+/**
+  *@brief Open a pass if the link model has one after the last image added.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *
+  *OUTPUTS
+  *@param true if a pass was opened.
+  */
+bool advanceScheduler(DownlinkScheduler* scheduler){
+
+    if(scheduler->frames < scheduler->link.firstPass ||
+       (scheduler->frames - scheduler->link.firstPass) % scheduler->link.passInterval != 0)
+        return false;
+
+    runPass(scheduler, false);
+    return true;
+}
+
+/**
+  *@brief Open a pass now, outside the contact windows of the link model.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *
+  *OUTPUTS
+  *@param Bytes the pass carries.
+  */
+long long passScheduler(DownlinkScheduler* scheduler){
+
+    return runPass(scheduler, false);
+}
+
+/**
+  *@brief Open a pass now, outside the contact windows of the link model, and empty the candidate
+  *          set.  Every candidate is staged in order of rank, the bytes the pass cannot carry are
+  *          added to the backlog.  The end of a sequence flushes the scheduler, so no scored image
+  *          is left unstaged.
+  *
+  *INPUTS
+  *@param scheduler : Downlink scheduler.
+  *
+  *OUTPUTS
+  *@param Bytes the pass carries.
+  */
+long long flushScheduler(DownlinkScheduler* scheduler){
+
+    return runPass(scheduler, true);
+}
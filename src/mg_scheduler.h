@@ -0,0 +1,96 @@
+/*
+Primary accretion detection algorithm.
+
+Streaming downlink scheduler.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#ifndef MG_SCHEDULER_H_INCLUDED
+#define MG_SCHEDULER_H_INCLUDED
+
+#include <stdbool.h>
+#include "mg_centroid.h"
+#include "mg_roi.h"
+#include "mg_downlink.h"
+
+// How images are selected for downlink.  SCHEDULE_BATCH ranks the whole sequence with downlinkData
+// once it has been analysed and sends a percentage of its images.  SCHEDULE_STREAM offers every
+// image to a DownlinkScheduler as soon as it is scored and stages images during the sequence,
+// as many as the passes of a LinkModel carry.
+typedef enum DownlinkSchedule{
+    SCHEDULE_BATCH,
+    SCHEDULE_STREAM
+}DownlinkSchedule;
+
+// Defaults of the link model and the candidate set.  A 64 KiB pass every 16 images carries about
+// as many bytes over the camera data as a 25% batch downlink of packets.
+#define LINK_DEFAULT_PASS_BYTES 65536
+#define LINK_DEFAULT_PASS_INTERVAL 16
+#define LINK_DEFAULT_FIRST_PASS 16
+#define SCHEDULER_DEFAULT_CANDIDATES 32
+
+// Contact windows of the downlink.  Counting the images of the sequence from 1, a pass opens after
+// image firstPass and then after every passInterval images, each carrying passBytes.
+typedef struct LinkModel{
+    long long passBytes;
+    int passInterval;
+    int firstPass;
+}LinkModel;
+
+// Image waiting for a pass.
+//   required : sent ahead of every scored image and never evicted, the first and last images
+//   staged   : whether images number - 2 to number + 1 are staged
+//   rois     : regions of images number - 1 to number + 1, for DOWNLINK_ROI
+typedef struct DownlinkCandidate{
+    int number;
+    double score;
+    bool required;
+    const char* reason;
+    bool staged[4];
+    FrameRoi rois[3];
+}DownlinkCandidate;
+
+// Online downlink queue.  At most capacity scored images wait for a pass, a better scoring image
+// evicts the worst of them once it is full, so memory does not grow with the sequence.  Staged
+// bytes a pass cannot carry make up the backlog, sent first by the next pass.
+//   stage      : where images are staged, opened and closed by the caller
+//   newest     : number of the last image analysed
+//   recent     : bit k set when image newest - k is staged
+//   regions    : regions of the last three images, indexed by number % 3
+//   passBytes  : bytes the last pass carried
+//   passImages : images the last pass staged
+typedef struct DownlinkScheduler{
+    DownlinkStage* stage;
+    LinkModel link;
+    int capacity;
+    int count;
+    DownlinkCandidate* candidates;
+    int frames;
+    int newest;
+    unsigned long long recent;
+    FrameRoi regions[3];
+    int passes;
+    int images;
+    int evicted;
+    int firstPassImage;
+    long long bytes;
+    long long sent;
+    long long backlog;
+    long long passBytes;
+    int passImages;
+}DownlinkScheduler;
+
+void initDownlinkScheduler(DownlinkScheduler* scheduler,const LinkModel* link,int capacity,DownlinkStage* stage);
+void freeDownlinkScheduler(DownlinkScheduler* scheduler);
+void addSchedulerImage(DownlinkScheduler* scheduler,int number,const FrameRoi* roi);
+void offerSchedulerImage(DownlinkScheduler* scheduler,int number,double score,const char* reason,bool required);
+bool advanceScheduler(DownlinkScheduler* scheduler);
+long long passScheduler(DownlinkScheduler* scheduler);
+long long flushScheduler(DownlinkScheduler* scheduler);
+
+#endif // MG_SCHEDULER_H_INCLUDED
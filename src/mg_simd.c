@@ -0,0 +1,812 @@
+/*
+Primary accretion detection algorithm.
+
+SIMD pixel kernels with runtime CPU dispatch.
+
+Every kernel has a portable scalar reference.  The SSE2, AVX2 and AVX-512 versions
+accumulate in integers and produce exactly the same output as the reference.  Vector
+code is compiled per function with target attributes, so no special compiler flags are
+needed and the program still runs on CPUs without the wider instruction sets.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mg.h"
+#include "mg_image.h"
+#include "mg_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MG_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MG_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MG_TARGET(isa)
+#endif
+
+// Pixels per 32-bit accumulator flush.  Each 32-bit lane gains at most 2*2*255*255 per
+// vector iteration, 4096 iterations stay well below 2^31.
+#define CORR_FLUSH_ITERATIONS 4096
+
+static void thresholdRowResolve(const unsigned char* src, unsigned char* dst, int width, int thresholdVal);
+static void corrRowResolve(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums);
+static void momentRowResolve(const unsigned char* row, int width, RowMoments* moments);
+static void predictRowResolve(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped);
+static void deltaRowResolve(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped);
+
+ThresholdRowKernel thresholdRow = thresholdRowResolve;
+CorrRowKernel corrRow = corrRowResolve;
+MomentRowKernel momentRow = momentRowResolve;
+PredictRowKernel predictRow = predictRowResolve;
+DeltaRowKernel deltaRow = deltaRowResolve;
+
+// Pixel index within a vector block, read as 16-bit lanes by the moment kernels
+static const short MomentIndex[64] = {
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+    32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+    48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63
+};
+
+/**
+  *@brief Scalar reference threshold kernel.
+  *
+  *INPUTS
+  *@param src          : Row to be thresholded.
+  *@param width        : Number of pixels in the row.
+  *@param thresholdVal : Value to threshold the row at (0-255).
+  *
+  *OUTPUTS
+  *@param dst : WHITEPIX where src > thresholdVal, BLACKPIX elsewhere.
+  */
+void thresholdRowScalar(const unsigned char* src, unsigned char* dst, int width, int thresholdVal){
+
+    int j=0;
+
+    for(j=0; j<width; j++){
+        dst[j] = (src[j] > thresholdVal) ? WHITEPIX : BLACKPIX;
+    }
+}
+
+/**
+  *@brief Scalar reference correlation kernel.  Adds the sum, sum of squares and cross product
+  *          of one pair of rows to sums.
+  *
+  *INPUTS
+  *@param row1  : Row from the first image.
+  *@param row2  : Row from the second image.
+  *@param width : Number of pixels in the rows.
+  *
+  *OUTPUTS
+  *@param sums : Running sums, updated in place.
+  */
+void corrRowScalar(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums){
+
+    int j=0;
+    long long a=0, b=0;
+
+    for(j=0; j<width; j++){
+        a = row1[j];
+        b = row2[j];
+        sums->sum1 += a;
+        sums->sum2 += b;
+        sums->sumSq1 += a*a;
+        sums->sumSq2 += b*b;
+        sums->sumCross += a*b;
+    }
+}
+
+/**
+  *@brief Add the intensity moments of pixels [from, width) of a row segment to moments.
+  */
+static void momentRowRange(const unsigned char* row, int from, int width, RowMoments* moments){
+
+    int j=0;
+
+    for(j=from; j<width; j++){
+        moments->sum += row[j];
+        moments->sumIndex += (long long)j * row[j];
+    }
+}
+
+/**
+  *@brief Scalar reference moment kernel.  Adds the intensity sum and the index weighted
+  *          intensity sum of one row segment to moments.
+  *
+  *INPUTS
+  *@param row   : First pixel of the segment.
+  *@param width : Number of pixels in the segment.
+  *
+  *OUTPUTS
+  *@param moments : Running moments, updated in place.
+  */
+void momentRowScalar(const unsigned char* row, int width, RowMoments* moments){
+    momentRowRange(row, 0, width, moments);
+}
+
+/**
+  *@brief Scalar reference codec prediction kernel.  Predicts pixels 1 to width-1 of a row from
+  *          their left, upper and upper-left neighbours with the median edge detector and maps the
+  *          prediction error modulo 256 from 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+  *
+  *INPUTS
+  *@param row   : Row to be predicted.
+  *@param up    : Row above it.
+  *@param width : Number of pixels in the rows.
+  *
+  *OUTPUTS
+  *@param mapped : Mapped residual of pixels 1 to width-1.
+  */
+void predictRowScalar(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped){
+
+    int j=0, a=0, b=0, c=0, mx=0, mn=0, p=0, e=0;
+
+    for(j=1; j<width; j++){
+        a = row[j-1];
+        b = up[j];
+        c = up[j-1];
+        mx = a > b ? a : b;
+        mn = a > b ? b : a;
+        // Selects rather than branches so the loop vectorizes where the compiler can
+        p = a + b - c;
+        p = (c <= mn) ? mx : p;
+        p = (c >= mx) ? mn : p;
+        e = (signed char)(row[j] - p);
+        mapped[j] = (unsigned char)(e >= 0 ? 2*e : -2*e - 1);
+    }
+}
+
+/**
+  *@brief Scalar reference codec delta kernel.  Predicts every pixel of a row from the pixel at
+  *          the same position in a reference frame and maps the prediction error as
+  *          predictRowScalar does.
+  *
+  *INPUTS
+  *@param row   : Row to be predicted.
+  *@param ref   : Same row of the reference frame.
+  *@param width : Number of pixels in the rows.
+  *
+  *OUTPUTS
+  *@param mapped : Mapped residual of pixels 0 to width-1.
+  */
+void deltaRowScalar(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped){
+
+    int j=0, e=0;
+
+    for(j=0; j<width; j++){
+        e = (signed char)(row[j] - ref[j]);
+        mapped[j] = (unsigned char)(e >= 0 ? 2*e : -2*e - 1);
+    }
+}
+
+#ifdef MG_SIMD_X86
+
+/**
+  *@brief Sum the 32-bit lanes of an accumulator into a 64-bit total.
+  */
+static long long sumLanes32(const int* lanes, int count){
+
+    int i=0;
+    long long total=0;
+
+    for(i=0; i<count; i++){
+        total += lanes[i];
+    }
+    return total;
+}
+
+MG_TARGET("sse2")
+static void thresholdRowSSE2(const unsigned char* src, unsigned char* dst, int width, int thresholdVal){
+
+    int j=0;
+    __m128i v, le;
+    const __m128i tv = _mm_set1_epi8((char)thresholdVal);
+    const __m128i black = _mm_set1_epi8(BLACKPIX);
+    const __m128i white = _mm_set1_epi8(WHITEPIX);
+
+    for(; j+16<=width; j+=16){
+        v = _mm_loadu_si128((const __m128i*)(src + j));
+        // min(v, t) == v exactly where v <= t
+        le = _mm_cmpeq_epi8(_mm_min_epu8(v, tv), v);
+        _mm_storeu_si128((__m128i*)(dst + j),
+                         _mm_or_si128(_mm_and_si128(le, black), _mm_andnot_si128(le, white)));
+    }
+    thresholdRowScalar(src + j, dst + j, width - j, thresholdVal);
+}
+
+MG_TARGET("sse2")
+static void corrRowSSE2(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums){
+
+    int j=0, n=0;
+    int lanes[4];
+    long long totals[2];
+    __m128i a, b, alo, ahi, blo, bhi;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i s1 = zero, s2 = zero, sq1, sq2, cross;
+
+    while(j+16<=width){
+        sq1 = zero;
+        sq2 = zero;
+        cross = zero;
+        for(n=0; n<CORR_FLUSH_ITERATIONS && j+16<=width; n++, j+=16){
+            a = _mm_loadu_si128((const __m128i*)(row1 + j));
+            b = _mm_loadu_si128((const __m128i*)(row2 + j));
+            s1 = _mm_add_epi64(s1, _mm_sad_epu8(a, zero));
+            s2 = _mm_add_epi64(s2, _mm_sad_epu8(b, zero));
+            alo = _mm_unpacklo_epi8(a, zero);
+            ahi = _mm_unpackhi_epi8(a, zero);
+            blo = _mm_unpacklo_epi8(b, zero);
+            bhi = _mm_unpackhi_epi8(b, zero);
+            sq1 = _mm_add_epi32(sq1, _mm_add_epi32(_mm_madd_epi16(alo, alo), _mm_madd_epi16(ahi, ahi)));
+            sq2 = _mm_add_epi32(sq2, _mm_add_epi32(_mm_madd_epi16(blo, blo), _mm_madd_epi16(bhi, bhi)));
+            cross = _mm_add_epi32(cross, _mm_add_epi32(_mm_madd_epi16(alo, blo), _mm_madd_epi16(ahi, bhi)));
+        }
+        _mm_storeu_si128((__m128i*)lanes, sq1);
+        sums->sumSq1 += sumLanes32(lanes, 4);
+        _mm_storeu_si128((__m128i*)lanes, sq2);
+        sums->sumSq2 += sumLanes32(lanes, 4);
+        _mm_storeu_si128((__m128i*)lanes, cross);
+        sums->sumCross += sumLanes32(lanes, 4);
+    }
+
+    _mm_storeu_si128((__m128i*)totals, s1);
+    sums->sum1 += totals[0] + totals[1];
+    _mm_storeu_si128((__m128i*)totals, s2);
+    sums->sum2 += totals[0] + totals[1];
+
+    corrRowScalar(row1 + j, row2 + j, width - j, sums);
+}
+
+MG_TARGET("sse2")
+static void momentRowSSE2(const unsigned char* row, int width, RowMoments* moments){
+
+    int j=0, n=0;
+    int lanes[4];
+    long long totals[2];
+    __m128i v, s;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i idxLo = _mm_loadu_si128((const __m128i*)MomentIndex);
+    const __m128i idxHi = _mm_loadu_si128((const __m128i*)(MomentIndex + 8));
+    __m128i sum = zero, blockSum = zero, local;
+
+    // j * p[j] is split into block start * block sum (64-bit) plus lane index * p[j] (32-bit)
+    while(j+16<=width){
+        local = zero;
+        for(n=0; n<CORR_FLUSH_ITERATIONS && j+16<=width; n++, j+=16){
+            v = _mm_loadu_si128((const __m128i*)(row + j));
+            s = _mm_sad_epu8(v, zero);
+            sum = _mm_add_epi64(sum, s);
+            blockSum = _mm_add_epi64(blockSum, _mm_mul_epu32(s, _mm_set1_epi32(j)));
+            local = _mm_add_epi32(local, _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(v, zero), idxLo),
+                                                       _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), idxHi)));
+        }
+        _mm_storeu_si128((__m128i*)lanes, local);
+        moments->sumIndex += sumLanes32(lanes, 4);
+    }
+
+    _mm_storeu_si128((__m128i*)totals, sum);
+    moments->sum += totals[0] + totals[1];
+    _mm_storeu_si128((__m128i*)totals, blockSum);
+    moments->sumIndex += totals[0] + totals[1];
+
+    momentRowRange(row, j, width, moments);
+}
+
+MG_TARGET("sse2")
+static void predictRowSSE2(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped){
+
+    int j=1;
+    __m128i a, b, c, mx, mn, p, le, ge, e;
+    const __m128i zero = _mm_setzero_si128();
+
+    for(; j<width && width>16; j+=16){
+        // The last vector overlaps the one before it instead of leaving a scalar tail
+        if(j+16>width)
+            j = width-16;
+        a = _mm_loadu_si128((const __m128i*)(row + j - 1));
+        b = _mm_loadu_si128((const __m128i*)(up + j));
+        c = _mm_loadu_si128((const __m128i*)(up + j - 1));
+        mx = _mm_max_epu8(a, b);
+        mn = _mm_min_epu8(a, b);
+        // a + b - c lies between a and b whenever it is selected, so it cannot wrap
+        p = _mm_sub_epi8(_mm_add_epi8(a, b), c);
+        le = _mm_cmpeq_epi8(_mm_min_epu8(c, mn), c);
+        ge = _mm_cmpeq_epi8(_mm_max_epu8(c, mx), c);
+        p = _mm_or_si128(_mm_and_si128(le, mx), _mm_andnot_si128(le, p));
+        p = _mm_or_si128(_mm_and_si128(ge, mn), _mm_andnot_si128(ge, p));
+        e = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(row + j)), p);
+        _mm_storeu_si128((__m128i*)(mapped + j), _mm_xor_si128(_mm_add_epi8(e, e), _mm_cmpgt_epi8(zero, e)));
+    }
+    predictRowScalar(row + j - 1, up + j - 1, width - j + 1, mapped + j - 1);
+}
+
+MG_TARGET("sse2")
+static void deltaRowSSE2(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped){
+
+    int j=0;
+    __m128i e;
+    const __m128i zero = _mm_setzero_si128();
+
+    for(; j<width && width>=16; j+=16){
+        // The last vector overlaps the one before it instead of leaving a scalar tail
+        if(j+16>width)
+            j = width-16;
+        e = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(row + j)), _mm_loadu_si128((const __m128i*)(ref + j)));
+        _mm_storeu_si128((__m128i*)(mapped + j), _mm_xor_si128(_mm_add_epi8(e, e), _mm_cmpgt_epi8(zero, e)));
+    }
+    deltaRowScalar(row + j, ref + j, width - j, mapped + j);
+}
+
+MG_TARGET("avx2")
+static void thresholdRowAVX2(const unsigned char* src, unsigned char* dst, int width, int thresholdVal){
+
+    int j=0;
+    __m256i v, le;
+    const __m256i tv = _mm256_set1_epi8((char)thresholdVal);
+    const __m256i black = _mm256_set1_epi8(BLACKPIX);
+    const __m256i white = _mm256_set1_epi8(WHITEPIX);
+
+    for(; j+32<=width; j+=32){
+        v = _mm256_loadu_si256((const __m256i*)(src + j));
+        le = _mm256_cmpeq_epi8(_mm256_min_epu8(v, tv), v);
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_blendv_epi8(white, black, le));
+    }
+    thresholdRowScalar(src + j, dst + j, width - j, thresholdVal);
+}
+
+MG_TARGET("avx2")
+static void corrRowAVX2(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums){
+
+    int j=0, n=0;
+    int lanes[8];
+    long long totals[4];
+    __m256i a, b, alo, ahi, blo, bhi;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i s1 = zero, s2 = zero, sq1, sq2, cross;
+
+    while(j+32<=width){
+        sq1 = zero;
+        sq2 = zero;
+        cross = zero;
+        for(n=0; n<CORR_FLUSH_ITERATIONS && j+32<=width; n++, j+=32){
+            a = _mm256_loadu_si256((const __m256i*)(row1 + j));
+            b = _mm256_loadu_si256((const __m256i*)(row2 + j));
+            s1 = _mm256_add_epi64(s1, _mm256_sad_epu8(a, zero));
+            s2 = _mm256_add_epi64(s2, _mm256_sad_epu8(b, zero));
+            alo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(a));
+            ahi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1));
+            blo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b));
+            bhi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1));
+            sq1 = _mm256_add_epi32(sq1, _mm256_add_epi32(_mm256_madd_epi16(alo, alo), _mm256_madd_epi16(ahi, ahi)));
+            sq2 = _mm256_add_epi32(sq2, _mm256_add_epi32(_mm256_madd_epi16(blo, blo), _mm256_madd_epi16(bhi, bhi)));
+            cross = _mm256_add_epi32(cross, _mm256_add_epi32(_mm256_madd_epi16(alo, blo), _mm256_madd_epi16(ahi, bhi)));
+        }
+        _mm256_storeu_si256((__m256i*)lanes, sq1);
+        sums->sumSq1 += sumLanes32(lanes, 8);
+        _mm256_storeu_si256((__m256i*)lanes, sq2);
+        sums->sumSq2 += sumLanes32(lanes, 8);
+        _mm256_storeu_si256((__m256i*)lanes, cross);
+        sums->sumCross += sumLanes32(lanes, 8);
+    }
+
+    _mm256_storeu_si256((__m256i*)totals, s1);
+    sums->sum1 += totals[0] + totals[1] + totals[2] + totals[3];
+    _mm256_storeu_si256((__m256i*)totals, s2);
+    sums->sum2 += totals[0] + totals[1] + totals[2] + totals[3];
+
+    corrRowScalar(row1 + j, row2 + j, width - j, sums);
+}
+
+MG_TARGET("avx2")
+static void momentRowAVX2(const unsigned char* row, int width, RowMoments* moments){
+
+    int j=0, n=0;
+    int lanes[8];
+    long long totals[4];
+    __m256i v, s;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i idxLo = _mm256_loadu_si256((const __m256i*)MomentIndex);
+    const __m256i idxHi = _mm256_loadu_si256((const __m256i*)(MomentIndex + 16));
+    __m256i sum = zero, blockSum = zero, local;
+
+    while(j+32<=width){
+        local = zero;
+        for(n=0; n<CORR_FLUSH_ITERATIONS && j+32<=width; n++, j+=32){
+            v = _mm256_loadu_si256((const __m256i*)(row + j));
+            s = _mm256_sad_epu8(v, zero);
+            sum = _mm256_add_epi64(sum, s);
+            blockSum = _mm256_add_epi64(blockSum, _mm256_mul_epu32(s, _mm256_set1_epi32(j)));
+            local = _mm256_add_epi32(local,
+                        _mm256_add_epi32(_mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)), idxLo),
+                                         _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)), idxHi)));
+        }
+        _mm256_storeu_si256((__m256i*)lanes, local);
+        moments->sumIndex += sumLanes32(lanes, 8);
+    }
+
+    _mm256_storeu_si256((__m256i*)totals, sum);
+    moments->sum += totals[0] + totals[1] + totals[2] + totals[3];
+    _mm256_storeu_si256((__m256i*)totals, blockSum);
+    moments->sumIndex += totals[0] + totals[1] + totals[2] + totals[3];
+
+    momentRowRange(row, j, width, moments);
+}
+
+MG_TARGET("avx2")
+static void predictRowAVX2(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped){
+
+    int j=1;
+    __m256i a, b, c, mx, mn, p, le, ge, e;
+    const __m256i zero = _mm256_setzero_si256();
+
+    for(; j<width && width>32; j+=32){
+        // The last vector overlaps the one before it instead of leaving a scalar tail
+        if(j+32>width)
+            j = width-32;
+        a = _mm256_loadu_si256((const __m256i*)(row + j - 1));
+        b = _mm256_loadu_si256((const __m256i*)(up + j));
+        c = _mm256_loadu_si256((const __m256i*)(up + j - 1));
+        mx = _mm256_max_epu8(a, b);
+        mn = _mm256_min_epu8(a, b);
+        p = _mm256_sub_epi8(_mm256_add_epi8(a, b), c);
+        le = _mm256_cmpeq_epi8(_mm256_min_epu8(c, mn), c);
+        ge = _mm256_cmpeq_epi8(_mm256_max_epu8(c, mx), c);
+        p = _mm256_blendv_epi8(p, mx, le);
+        p = _mm256_blendv_epi8(p, mn, ge);
+        e = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(row + j)), p);
+        _mm256_storeu_si256((__m256i*)(mapped + j), _mm256_xor_si256(_mm256_add_epi8(e, e), _mm256_cmpgt_epi8(zero, e)));
+    }
+    predictRowScalar(row + j - 1, up + j - 1, width - j + 1, mapped + j - 1);
+}
+
+MG_TARGET("avx2")
+static void deltaRowAVX2(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped){
+
+    int j=0;
+    __m256i e;
+    const __m256i zero = _mm256_setzero_si256();
+
+    for(; j<width && width>=32; j+=32){
+        // The last vector overlaps the one before it instead of leaving a scalar tail
+        if(j+32>width)
+            j = width-32;
+        e = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(row + j)), _mm256_loadu_si256((const __m256i*)(ref + j)));
+        _mm256_storeu_si256((__m256i*)(mapped + j), _mm256_xor_si256(_mm256_add_epi8(e, e), _mm256_cmpgt_epi8(zero, e)));
+    }
+    deltaRowScalar(row + j, ref + j, width - j, mapped + j);
+}
+
+MG_TARGET("avx512f,avx512bw")
+static void thresholdRowAVX512(const unsigned char* src, unsigned char* dst, int width, int thresholdVal){
+
+    int j=0;
+    __m512i v;
+    __mmask64 le, tail;
+    const __m512i tv = _mm512_set1_epi8((char)thresholdVal);
+    const __m512i black = _mm512_set1_epi8(BLACKPIX);
+    const __m512i white = _mm512_set1_epi8(WHITEPIX);
+
+    for(; j+64<=width; j+=64){
+        v = _mm512_loadu_si512((const void*)(src + j));
+        le = _mm512_cmple_epu8_mask(v, tv);
+        _mm512_storeu_si512((void*)(dst + j), _mm512_mask_blend_epi8(le, white, black));
+    }
+    if(j < width){
+        // Masked tail, lanes past the end are neither loaded nor stored
+        tail = (__mmask64)((~0ULL) >> (64 - (width - j)));
+        v = _mm512_maskz_loadu_epi8(tail, src + j);
+        le = _mm512_cmple_epu8_mask(v, tv);
+        _mm512_mask_storeu_epi8(dst + j, tail, _mm512_mask_blend_epi8(le, white, black));
+    }
+}
+
+MG_TARGET("avx512f,avx512bw")
+static void corrRowAVX512(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums){
+
+    int j=0, n=0, i=0;
+    int lanes[16];
+    long long totals[8];
+    __mmask64 tail;
+    __m512i a, b, alo, ahi, blo, bhi;
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i s1 = zero, s2 = zero, sq1, sq2, cross;
+
+    while(j<width){
+        sq1 = zero;
+        sq2 = zero;
+        cross = zero;
+        for(n=0; n<CORR_FLUSH_ITERATIONS && j<width; n++, j+=64){
+            if(j+64<=width){
+                a = _mm512_loadu_si512((const void*)(row1 + j));
+                b = _mm512_loadu_si512((const void*)(row2 + j));
+            }
+            else{
+                // Zero filled tail lanes add nothing to any of the sums
+                tail = (__mmask64)((~0ULL) >> (64 - (width - j)));
+                a = _mm512_maskz_loadu_epi8(tail, row1 + j);
+                b = _mm512_maskz_loadu_epi8(tail, row2 + j);
+            }
+            s1 = _mm512_add_epi64(s1, _mm512_sad_epu8(a, zero));
+            s2 = _mm512_add_epi64(s2, _mm512_sad_epu8(b, zero));
+            alo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(a));
+            ahi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(a, 1));
+            blo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(b));
+            bhi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(b, 1));
+            sq1 = _mm512_add_epi32(sq1, _mm512_add_epi32(_mm512_madd_epi16(alo, alo), _mm512_madd_epi16(ahi, ahi)));
+            sq2 = _mm512_add_epi32(sq2, _mm512_add_epi32(_mm512_madd_epi16(blo, blo), _mm512_madd_epi16(bhi, bhi)));
+            cross = _mm512_add_epi32(cross, _mm512_add_epi32(_mm512_madd_epi16(alo, blo), _mm512_madd_epi16(ahi, bhi)));
+        }
+        _mm512_storeu_si512((void*)lanes, sq1);
+        sums->sumSq1 += sumLanes32(lanes, 16);
+        _mm512_storeu_si512((void*)lanes, sq2);
+        sums->sumSq2 += sumLanes32(lanes, 16);
+        _mm512_storeu_si512((void*)lanes, cross);
+        sums->sumCross += sumLanes32(lanes, 16);
+    }
+
+    _mm512_storeu_si512((void*)totals, s1);
+    for(i=0; i<8; i++){
+        sums->sum1 += totals[i];
+    }
+    _mm512_storeu_si512((void*)totals, s2);
+    for(i=0; i<8; i++){
+        sums->sum2 += totals[i];
+    }
+}
+
+MG_TARGET("avx512f,avx512bw")
+static void momentRowAVX512(const unsigned char* row, int width, RowMoments* moments){
+
+    int j=0, n=0, i=0;
+    int lanes[16];
+    long long totals[8];
+    __mmask64 tail;
+    __m512i v, s;
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i idxLo = _mm512_loadu_si512((const void*)MomentIndex);
+    const __m512i idxHi = _mm512_loadu_si512((const void*)(MomentIndex + 32));
+    __m512i sum = zero, blockSum = zero, local;
+
+    while(j<width){
+        local = zero;
+        for(n=0; n<CORR_FLUSH_ITERATIONS && j<width; n++, j+=64){
+            if(j+64<=width){
+                v = _mm512_loadu_si512((const void*)(row + j));
+            }
+            else{
+                // Zero filled tail lanes add nothing to either moment
+                tail = (__mmask64)((~0ULL) >> (64 - (width - j)));
+                v = _mm512_maskz_loadu_epi8(tail, row + j);
+            }
+            s = _mm512_sad_epu8(v, zero);
+            sum = _mm512_add_epi64(sum, s);
+            blockSum = _mm512_add_epi64(blockSum, _mm512_mul_epu32(s, _mm512_set1_epi32(j)));
+            local = _mm512_add_epi32(local,
+                        _mm512_add_epi32(_mm512_madd_epi16(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(v)), idxLo),
+                                         _mm512_madd_epi16(_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(v, 1)), idxHi)));
+        }
+        _mm512_storeu_si512((void*)lanes, local);
+        moments->sumIndex += sumLanes32(lanes, 16);
+    }
+
+    _mm512_storeu_si512((void*)totals, sum);
+    for(i=0; i<8; i++){
+        moments->sum += totals[i];
+    }
+    _mm512_storeu_si512((void*)totals, blockSum);
+    for(i=0; i<8; i++){
+        moments->sumIndex += totals[i];
+    }
+}
+
+MG_TARGET("avx512f,avx512bw")
+static void predictRowAVX512(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped){
+
+    int j=1;
+    __mmask64 lanes;
+    __m512i a, b, c, mx, mn, p, e;
+
+    for(; j<width; j+=64){
+        // Masked loads and stores cover the tail
+        lanes = (width-j >= 64) ? ~(__mmask64)0 : (__mmask64)((~0ULL) >> (64 - (width - j)));
+        a = _mm512_maskz_loadu_epi8(lanes, row + j - 1);
+        b = _mm512_maskz_loadu_epi8(lanes, up + j);
+        c = _mm512_maskz_loadu_epi8(lanes, up + j - 1);
+        mx = _mm512_max_epu8(a, b);
+        mn = _mm512_min_epu8(a, b);
+        p = _mm512_sub_epi8(_mm512_add_epi8(a, b), c);
+        p = _mm512_mask_blend_epi8(_mm512_cmple_epu8_mask(c, mn), p, mx);
+        p = _mm512_mask_blend_epi8(_mm512_cmpge_epu8_mask(c, mx), p, mn);
+        e = _mm512_sub_epi8(_mm512_maskz_loadu_epi8(lanes, row + j), p);
+        _mm512_mask_storeu_epi8(mapped + j, lanes, _mm512_xor_si512(_mm512_add_epi8(e, e), _mm512_movm_epi8(_mm512_movepi8_mask(e))));
+    }
+}
+
+MG_TARGET("avx512f,avx512bw")
+static void deltaRowAVX512(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped){
+
+    int j=0;
+    __mmask64 lanes;
+    __m512i e;
+
+    for(; j<width; j+=64){
+        // Masked loads and stores cover the tail
+        lanes = (width-j >= 64) ? ~(__mmask64)0 : (__mmask64)((~0ULL) >> (64 - (width - j)));
+        e = _mm512_sub_epi8(_mm512_maskz_loadu_epi8(lanes, row + j), _mm512_maskz_loadu_epi8(lanes, ref + j));
+        _mm512_mask_storeu_epi8(mapped + j, lanes, _mm512_xor_si512(_mm512_add_epi8(e, e), _mm512_movm_epi8(_mm512_movepi8_mask(e))));
+    }
+}
+
+#endif // MG_SIMD_X86
+
+/**
+  *@brief Determine the widest kernel set supported by the CPU and operating system.
+  *
+  *INPUTS
+  *none
+  *
+  *OUTPUTS
+  *@param Widest supported KernelLevel.
+  */
+KernelLevel detectKernelLevel(void){
+
+    KernelLevel level = KERNEL_SCALAR;
+
+#if defined(MG_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))
+        level = KERNEL_SSE2;
+    if(__builtin_cpu_supports("avx2"))
+        level = KERNEL_AVX2;
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        level = KERNEL_AVX512;
+#elif defined(MG_SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    unsigned long long xcr0 = 0;
+
+    __cpuid(info, 1);
+    if(info[3] & (1 << 26))
+        level = KERNEL_SSE2;
+    // AVX state must be enabled by the OS (OSXSAVE + XCR0) before AVX2/AVX-512 can be used
+    if(info[2] & (1 << 27)) {
+        xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)))
+            level = KERNEL_AVX2;
+        if((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) && (info[1] & (1 << 30)))
+            level = KERNEL_AVX512;
+    }
+#endif
+
+    return level;
+}
+
+/**
+  *@brief Select the kernels used by thresholdRow, corrRow, momentRow, predictRow and deltaRow.  Requests above what the CPU
+  *          supports are lowered to the widest supported level.
+  *
+  *INPUTS
+  *@param level : Requested kernel level.
+  *
+  *OUTPUTS
+  *@param Kernel level actually selected.
+  */
+KernelLevel setKernelLevel(KernelLevel level){
+
+    KernelLevel supported = detectKernelLevel();
+
+    if(level > supported)
+        level = supported;
+
+    thresholdRow = thresholdRowScalar;
+    corrRow = corrRowScalar;
+    momentRow = momentRowScalar;
+    predictRow = predictRowScalar;
+    deltaRow = deltaRowScalar;
+
+#ifdef MG_SIMD_X86
+    switch(level) {
+    case KERNEL_AVX512:
+      thresholdRow = thresholdRowAVX512;
+      corrRow = corrRowAVX512;
+      momentRow = momentRowAVX512;
+      predictRow = predictRowAVX512;
+      deltaRow = deltaRowAVX512;
+      break;
+    case KERNEL_AVX2:
+      thresholdRow = thresholdRowAVX2;
+      corrRow = corrRowAVX2;
+      momentRow = momentRowAVX2;
+      predictRow = predictRowAVX2;
+      deltaRow = deltaRowAVX2;
+      break;
+    case KERNEL_SSE2:
+      thresholdRow = thresholdRowSSE2;
+      corrRow = corrRowSSE2;
+      momentRow = momentRowSSE2;
+      predictRow = predictRowSSE2;
+      deltaRow = deltaRowSSE2;
+      break;
+    case KERNEL_SCALAR:
+      break;
+    }
+#else
+    level = KERNEL_SCALAR;
+#endif
+
+    return level;
+}
+
+/**
+  *@brief Select the widest kernels supported by the CPU.  Call once at startup.
+  *
+  *INPUTS
+  *none
+  *
+  *OUTPUTS
+  *@param Kernel level selected.
+  */
+KernelLevel initKernels(void){
+    return setKernelLevel(detectKernelLevel());
+}
+
+/**
+  *@brief Printable name of a kernel level.
+  *
+  *INPUTS
+  *@param level : Kernel level.
+  *
+  *OUTPUTS
+  *@param Name of the level.
+  */
+const char* kernelLevelName(KernelLevel level){
+
+    switch(level) {
+    case KERNEL_AVX512:
+      return "AVX-512";
+    case KERNEL_AVX2:
+      return "AVX2";
+    case KERNEL_SSE2:
+      return "SSE2";
+    case KERNEL_SCALAR:
+      break;
+    }
+    return "scalar";
+}
+
+// First call through an unresolved kernel pointer selects the kernels and forwards the call
+static void thresholdRowResolve(const unsigned char* src, unsigned char* dst, int width, int thresholdVal){
+    initKernels();
+    thresholdRow(src, dst, width, thresholdVal);
+}
+
+static void corrRowResolve(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums){
+    initKernels();
+    corrRow(row1, row2, width, sums);
+}
+
+static void momentRowResolve(const unsigned char* row, int width, RowMoments* moments){
+    initKernels();
+    momentRow(row, width, moments);
+}
+
+static void predictRowResolve(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped){
+    initKernels();
+    predictRow(row, up, width, mapped);
+}
+
+static void deltaRowResolve(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped){
+    initKernels();
+    deltaRow(row, ref, width, mapped);
+}
@@ -0,0 +1,66 @@
+/*
+Primary accretion detection algorithm.
+
+SIMD pixel kernels with runtime CPU dispatch.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#ifndef MG_SIMD_H_INCLUDED
+#define MG_SIMD_H_INCLUDED
+
+typedef enum KernelLevel {
+  KERNEL_SCALAR,
+  KERNEL_SSE2,
+  KERNEL_AVX2,
+  KERNEL_AVX512
+} KernelLevel;
+
+// Integer sums gathered by the fused correlation pass
+typedef struct CorrSums {
+  long long sum1;
+  long long sum2;
+  long long sumSq1;
+  long long sumSq2;
+  long long sumCross;
+} CorrSums;
+
+// Intensity moments of one 8-bit row segment, pixel index j runs from 0 at the segment start
+typedef struct RowMoments {
+  long long sum;       // sum of p[j]
+  long long sumIndex;  // sum of j * p[j]
+} RowMoments;
+
+// Threshold one 8-bit row, thresholdVal must be in 0-255
+typedef void (*ThresholdRowKernel)(const unsigned char* src, unsigned char* dst, int width, int thresholdVal);
+// Add the sums of one pair of 8-bit rows to sums
+typedef void (*CorrRowKernel)(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums);
+// Add the intensity moments of one 8-bit row segment to moments
+typedef void (*MomentRowKernel)(const unsigned char* row, int width, RowMoments* moments);
+// Mapped MED prediction residuals of pixels 1 to width-1 of an 8-bit row below up, see mg_codec.c
+typedef void (*PredictRowKernel)(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped);
+// Mapped residuals of pixels 0 to width-1 of an 8-bit row against the same row of a reference frame
+typedef void (*DeltaRowKernel)(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped);
+
+// Kernels selected by initKernels.  Resolve themselves on first use if initKernels was not called.
+extern ThresholdRowKernel thresholdRow;
+extern CorrRowKernel corrRow;
+extern MomentRowKernel momentRow;
+extern PredictRowKernel predictRow;
+extern DeltaRowKernel deltaRow;
+
+void thresholdRowScalar(const unsigned char* src, unsigned char* dst, int width, int thresholdVal);
+void corrRowScalar(const unsigned char* row1, const unsigned char* row2, int width, CorrSums* sums);
+void momentRowScalar(const unsigned char* row, int width, RowMoments* moments);
+void predictRowScalar(const unsigned char* row, const unsigned char* up, int width, unsigned char* mapped);
+void deltaRowScalar(const unsigned char* row, const unsigned char* ref, int width, unsigned char* mapped);
+KernelLevel detectKernelLevel(void);
+KernelLevel setKernelLevel(KernelLevel level);
+KernelLevel initKernels(void);
+const char* kernelLevelName(KernelLevel level);
+
+#endif // MG_SIMD_H_INCLUDED
@@ -13,7 +13,18 @@ Arizona State University
 #ifndef MG_THRESHOLD_H_INCLUDED
 #define MG_THRESHOLD_H_INCLUDED
 
+#define NUMGRAYLEVELS   256
+#define NUMGRAYLEVELS16 65536
+
+typedef enum ThresholdSearchMode {
+  THRESHOLD_SEARCH_EXHAUSTIVE,
+  THRESHOLD_SEARCH_HISTOGRAM
+} ThresholdSearchMode;
+
 void thresholdImage(PGMImage* image,PGMImage* result, int threshold_val);
 int thresholdImageSequence(PGMImage* image);
+void buildHistogram(PGMImage* image, long long* histogram, int numLevels);
+int thresholdImageHistogram(PGMImage* image);
+int findOptimalThreshold(PGMImage* image, ThresholdSearchMode mode);
 
 #endif // MG_THRESHOLD_H_INCLUDED
@@ -0,0 +1,314 @@
+/*
+Primary accretion detection algorithm.
+
+Multi-frame particle tracking.  Keeps the identity of every particle across the whole frame
+sequence and records its trajectory.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mg.h"
+#include "mg_centroid.h"
+#include "mg_tracker.h"
+
+// Alpha-beta filter gains.  Alpha weighs the measured position against the prediction, beta
+// the velocity correction.
+#define TRACKER_ALPHA 0.85
+#define TRACKER_BETA  0.5
+
+/**
+  *@brief Prepare an empty tracker.  Buffers are allocated on demand and reused every frame.
+  *
+  *INPUTS
+  *@param tracker         : Tracker to be initialized.
+  *@param acquisitionGate : Search radius of tracks without a velocity estimate, in pixels.
+  *@param predictionGate  : Search radius around the prediction of established tracks, in pixels.
+  *@param maxMissed       : Frames a track may go undetected before it is ended.
+  *
+  *OUTPUTS
+  *none
+  */
+void initTracker(Tracker* tracker, double acquisitionGate, double predictionGate, int maxMissed)
+{
+    memset(tracker, 0, sizeof(Tracker));
+    tracker->alpha = TRACKER_ALPHA;
+    tracker->beta = TRACKER_BETA;
+    tracker->acquisitionGate = acquisitionGate;
+    tracker->predictionGate = predictionGate;
+    tracker->maxMissed = maxMissed;
+    tracker->nextId = 1;
+    initSpatialGrid(&tracker->grid);
+}
+
+/**
+  *@brief Free every buffer owned by a tracker, including its trajectory store.
+  *
+  *INPUTS
+  *@param tracker : Tracker to be released.
+  *
+  *OUTPUTS
+  *none
+  */
+void freeTracker(Tracker* tracker)
+{
+    free(tracker->id);
+    free(tracker->x);
+    free(tracker->y);
+    free(tracker->vx);
+    free(tracker->vy);
+    free(tracker->age);
+    free(tracker->missed);
+    free(tracker->predX);
+    free(tracker->predY);
+    free(tracker->taken);
+    free(tracker->trajectories.trackId);
+    free(tracker->trajectories.frame);
+    free(tracker->trajectories.x);
+    free(tracker->trajectories.y);
+    freeSpatialGrid(&tracker->grid);
+    initTracker(tracker, tracker->acquisitionGate, tracker->predictionGate, tracker->maxMissed);
+}
+
+/**
+  *@brief Grow an array to a new number of elements, quitting the program when memory runs out.
+  */
+static void* growArray(void* array, int count, size_t size)
+{
+    // realloc_growArray tracker arrays free in freeTracker
+    void* grown = realloc(array, count * size);
+
+    if(grown == NULL)
+    {
+        printf("Error: Cannot allocate tracking memory.  Quitting program.");
+        exit(0);
+    }
+    return grown;
+}
+
+/**
+  *@brief Make room for at least numTracks active tracks.
+  */
+static void reserveTracks(Tracker* tracker, int numTracks)
+{
+    int capacity = 0;
+
+    if(numTracks <= tracker->trackCapacity)
+        return;
+
+    capacity = tracker->trackCapacity > 0 ? tracker->trackCapacity : 256;
+    while(capacity < numTracks)
+    {
+        capacity *= 2;
+    }
+
+    tracker->id = growArray(tracker->id, capacity, sizeof(int));
+    tracker->x = growArray(tracker->x, capacity, sizeof(double));
+    tracker->y = growArray(tracker->y, capacity, sizeof(double));
+    tracker->vx = growArray(tracker->vx, capacity, sizeof(double));
+    tracker->vy = growArray(tracker->vy, capacity, sizeof(double));
+    tracker->age = growArray(tracker->age, capacity, sizeof(int));
+    tracker->missed = growArray(tracker->missed, capacity, sizeof(int));
+    tracker->predX = growArray(tracker->predX, capacity, sizeof(double));
+    tracker->predY = growArray(tracker->predY, capacity, sizeof(double));
+    tracker->trackCapacity = capacity;
+}
+
+/**
+  *@brief Append one observation to a trajectory store.
+  */
+static void recordObservation(TrajectoryStore* store, int trackId, int frame, double x, double y)
+{
+    int capacity = 0;
+
+    if(store->count == store->capacity)
+    {
+        capacity = store->capacity > 0 ? store->capacity * 2 : 1024;
+        store->trackId = growArray(store->trackId, capacity, sizeof(int));
+        store->frame = growArray(store->frame, capacity, sizeof(int));
+        store->x = growArray(store->x, capacity, sizeof(double));
+        store->y = growArray(store->y, capacity, sizeof(double));
+        store->capacity = capacity;
+    }
+
+    store->trackId[store->count] = trackId;
+    store->frame[store->count] = frame;
+    store->x[store->count] = x;
+    store->y[store->count] = y;
+    store->count++;
+}
+
+/**
+  *@brief Move the track in slot from to slot to.
+  */
+static void moveTrack(Tracker* tracker, int to, int from)
+{
+    tracker->id[to] = tracker->id[from];
+    tracker->x[to] = tracker->x[from];
+    tracker->y[to] = tracker->y[from];
+    tracker->vx[to] = tracker->vx[from];
+    tracker->vy[to] = tracker->vy[from];
+    tracker->age[to] = tracker->age[from];
+    tracker->missed[to] = tracker->missed[from];
+}
+
+/**
+  *@brief Advance the tracker by one frame.  Every active track is predicted into the frame and
+  *          matched to the nearest free detection within its gate, established tracks first.
+  *          Matched tracks are corrected with the alpha-beta filter, unmatched established tracks
+  *          coast on their prediction and tracks missing more than maxMissed frames end.  Every
+  *          detection left over starts a new track.  Detections are indexed in a uniform grid,
+  *          so a frame costs O(tracks + detections) expected time.
+  *
+  *INPUTS
+  *@param tracker  : Tracker holding the tracks of the previous frames.
+  *@param frame    : Frame number, stored with every observation.
+  *@param cents    : Particle centroids detected in the frame.
+  *
+  *OUTPUTS
+  *@param acceleration : Mean absolute x and y acceleration, in pixels per frame squared, of the
+  *                      established tracks matched in this frame, 0 if there are none.
+  *@param Number of tracks the acceleration was measured on.
+  */
+int updateTracker(Tracker* tracker, int frame, const CentroidTable* cents, Shift* acceleration)
+{
+    int i=0, j=0, pass=0, numAcc=0, numDrift=0, numCents=cents->count;
+    double gate=0.0, rx=0.0, ry=0.0, ax=0.0, ay=0.0;
+    double sumAx=0.0, sumAy=0.0, sumVx=0.0, sumVy=0.0;
+
+    if(numCents > tracker->detectionCapacity)
+    {
+        tracker->taken = growArray(tracker->taken, numCents, sizeof(unsigned char));
+        tracker->detectionCapacity = numCents;
+    }
+    if(numCents > 0)
+        memset(tracker->taken, 0, numCents);
+    if(buildSpatialGrid(&tracker->grid, cents->x, cents->y, numCents, tracker->acquisitionGate) != 1)
+    {
+        printf("Error: Cannot allocate tracking memory.  Quitting program.");
+        exit(0);
+    }
+
+    // Established tracks follow their own velocity, young ones the mean drift of the field.
+    // Young tracks keep their last observed position while they are missing.
+    for(i=0; i<tracker->numTracks; i++)
+    {
+        if(tracker->age[i] >= 2)
+        {
+            tracker->predX[i] = tracker->x[i] + tracker->vx[i];
+            tracker->predY[i] = tracker->y[i] + tracker->vy[i];
+        }
+        else
+        {
+            tracker->predX[i] = tracker->x[i] + tracker->driftX * (tracker->missed[i] + 1);
+            tracker->predY[i] = tracker->y[i] + tracker->driftY * (tracker->missed[i] + 1);
+        }
+    }
+
+    for(pass=0; pass<2; pass++)
+    {
+        gate = pass == 0 ? tracker->predictionGate : tracker->acquisitionGate;
+        for(i=0; i<tracker->numTracks; i++)
+        {
+            if((tracker->age[i] >= 2) != (pass == 0))
+                continue;
+
+            j = nearestInGrid(&tracker->grid, tracker->predX[i], tracker->predY[i], gate, tracker->taken, NULL);
+            if(j < 0)
+            {
+                if(tracker->age[i] >= 2)
+                {
+                    tracker->x[i] = tracker->predX[i];
+                    tracker->y[i] = tracker->predY[i];
+                }
+                tracker->missed[i]++;
+                continue;
+            }
+            tracker->taken[j] = 1;
+
+            if(tracker->age[i] >= 2)
+            {
+                rx = cents->x[j] - tracker->predX[i];
+                ry = cents->y[j] - tracker->predY[i];
+                ax = tracker->beta * rx;
+                ay = tracker->beta * ry;
+                tracker->x[i] = tracker->predX[i] + tracker->alpha * rx;
+                tracker->y[i] = tracker->predY[i] + tracker->alpha * ry;
+                tracker->vx[i] += ax;
+                tracker->vy[i] += ay;
+                sumAx += fabs(ax);
+                sumAy += fabs(ay);
+                numAcc++;
+            }
+            else
+            {
+                // Second observation, the velocity estimate starts from the measured displacement
+                tracker->vx[i] = (cents->x[j] - tracker->x[i]) / (tracker->missed[i] + 1);
+                tracker->vy[i] = (cents->y[j] - tracker->y[i]) / (tracker->missed[i] + 1);
+                tracker->x[i] = cents->x[j];
+                tracker->y[i] = cents->y[j];
+            }
+            sumVx += tracker->vx[i];
+            sumVy += tracker->vy[i];
+            numDrift++;
+            tracker->age[i]++;
+            tracker->missed[i] = 0;
+            recordObservation(&tracker->trajectories, tracker->id[i], frame, cents->x[j], cents->y[j]);
+        }
+    }
+
+    // Deaths, the last track fills the slot of an ended one
+    tracker->deaths = 0;
+    i = 0;
+    while(i < tracker->numTracks)
+    {
+        if(tracker->missed[i] > tracker->maxMissed)
+        {
+            tracker->numTracks--;
+            moveTrack(tracker, i, tracker->numTracks);
+            tracker->deaths++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    // Births
+    tracker->births = 0;
+    for(j=0; j<numCents; j++)
+    {
+        if(tracker->taken[j])
+            continue;
+
+        reserveTracks(tracker, tracker->numTracks + 1);
+        i = tracker->numTracks++;
+        tracker->id[i] = tracker->nextId++;
+        tracker->x[i] = cents->x[j];
+        tracker->y[i] = cents->y[j];
+        tracker->vx[i] = 0.0;
+        tracker->vy[i] = 0.0;
+        tracker->age[i] = 1;
+        tracker->missed[i] = 0;
+        recordObservation(&tracker->trajectories, tracker->id[i], frame, cents->x[j], cents->y[j]);
+        tracker->births++;
+    }
+
+    if(numDrift > 0)
+    {
+        tracker->driftX = sumVx / numDrift;
+        tracker->driftY = sumVy / numDrift;
+    }
+
+    acceleration->x = numAcc > 0 ? sumAx / numAcc : 0.0;
+    acceleration->y = numAcc > 0 ? sumAy / numAcc : 0.0;
+
+    return numAcc;
+}
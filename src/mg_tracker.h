@@ -0,0 +1,72 @@
+/*
+Primary accretion detection algorithm.
+
+Multi-frame particle tracking.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#ifndef MG_TRACKER_H_INCLUDED
+#define MG_TRACKER_H_INCLUDED
+
+#include "mg_centroid.h"
+
+// Every observation of every track, in the order they were made.  Stored as parallel arrays,
+// entry i is track trackId[i] seen at (x[i], y[i]) in frame frame[i].
+typedef struct TrajectoryStore {
+  int count;
+  int capacity;
+  int* trackId;
+  int* frame;
+  double* x;
+  double* y;
+} TrajectoryStore;
+
+// Particles tracked across a frame sequence with an alpha-beta (steady state Kalman) filter on a
+// constant velocity model.  Active tracks are stored as parallel arrays indexed by slot:
+//   id         : persistent track id, never reused
+//   x, y       : filtered position in the last frame
+//   vx, vy     : filtered velocity in pixels per frame
+//   age        : number of frames the track has been observed in
+//   missed     : consecutive frames without a matching detection
+//   predX/Y    : position predicted for the frame being associated
+// Tracks observed at least twice are searched for within predictionGate of their prediction,
+// younger tracks within acquisitionGate of their position moved by the mean particle drift.
+// A track missing more than maxMissed frames in a row is ended.
+typedef struct Tracker {
+  double alpha;
+  double beta;
+  double acquisitionGate;
+  double predictionGate;
+  int maxMissed;
+  int nextId;
+  int numTracks;
+  int trackCapacity;
+  int* id;
+  double* x;
+  double* y;
+  double* vx;
+  double* vy;
+  int* age;
+  int* missed;
+  double* predX;
+  double* predY;
+  double driftX;
+  double driftY;
+  int births;
+  int deaths;
+  int detectionCapacity;
+  unsigned char* taken;
+  SpatialGrid grid;
+  TrajectoryStore trajectories;
+} Tracker;
+
+void initTracker(Tracker* tracker, double acquisitionGate, double predictionGate, int maxMissed);
+void freeTracker(Tracker* tracker);
+int updateTracker(Tracker* tracker, int frame, const CentroidTable* cents, Shift* acceleration);
+
+#endif // MG_TRACKER_H_INCLUDED
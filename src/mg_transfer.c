@@ -0,0 +1,227 @@
+/*
+Primary accretion detection algorithm.
+
+File transfer functions for staging images without decoding them.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#if defined(__linux__)
+// copy_file_range
+#define _GNU_SOURCE
+#elif !defined(_WIN32)
+// link and fstat in strict C modes
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
+#include "mg_transfer.h"
+
+// copy_file_range is available from glibc 2.27
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define MG_HAVE_COPY_FILE_RANGE
+#endif
+
+#define TRANSFER_BUFFER_SIZE 65536
+
+/**
+  *@brief Copy a file through a user space buffer, the fallback of every other method.
+  *
+  *INPUTS
+  *@param source : Path of the file to be copied.
+  *@param dest   : Path of the copy, replaced if it exists.
+  *
+  *OUTPUTS
+  *@param bytes : Number of bytes copied.
+  *@param 1 on success, 0 on failure.
+  */
+static int bufferedCopy(const char* source, const char* dest, long long* bytes){
+
+    int ok = 1;
+    size_t n = 0;
+    FILE* in = NULL;
+    FILE* out = NULL;
+    unsigned char* buffer = NULL;
+
+    *bytes = 0;
+    in = fopen(source, "rb");
+    if(in == NULL)
+        return 0;
+    out = fopen(dest, "wb");
+    // malloc_bufferedCopy buffer free at the end of bufferedCopy
+    buffer = malloc(TRANSFER_BUFFER_SIZE);
+    if(out == NULL || buffer == NULL){
+        ok = 0;
+    }
+    else {
+        while((n = fread(buffer, 1, TRANSFER_BUFFER_SIZE, in)) > 0){
+            if(fwrite(buffer, 1, n, out) != n){
+                ok = 0;
+                break;
+            }
+            *bytes += n;
+        }
+        if(ferror(in))
+            ok = 0;
+    }
+
+    free(buffer);
+    if(out != NULL && fclose(out) != 0)
+        ok = 0;
+    fclose(in);
+    return ok;
+}
+
+#ifdef __linux__
+/**
+  *@brief Copy length bytes between two open files inside the kernel.  copy_file_range lets the
+  *          file system share or offload the data, sendfile takes over on kernels and file
+  *          systems without it.
+  *
+  *INPUTS
+  *@param in     : Descriptor of the source, read from offset 0.
+  *@param out    : Descriptor of the empty destination.
+  *@param length : Size of the source in bytes.
+  *
+  *OUTPUTS
+  *@param 1 when all length bytes were copied, 0 otherwise.
+  */
+static int kernelCopy(int in, int out, long long length){
+
+    long long copied = 0;
+    ssize_t n = 0;
+    off_t inOffset = 0;
+
+#ifdef MG_HAVE_COPY_FILE_RANGE
+    off_t outOffset = 0;
+
+    while(copied < length){
+        n = copy_file_range(in, &inOffset, out, &outOffset, (size_t)(length - copied), 0);
+        if(n <= 0)
+            break;
+        copied += n;
+    }
+    if(copied == length)
+        return 1;
+#endif
+
+    // sendfile writes at the file position of out, carry on from where copy_file_range stopped
+    inOffset = (off_t)copied;
+    if(lseek(out, (off_t)copied, SEEK_SET) < 0)
+        return 0;
+    while(copied < length){
+        n = sendfile(out, in, &inOffset, (size_t)(length - copied));
+        if(n <= 0)
+            return 0;
+        copied += n;
+    }
+    return 1;
+}
+#endif
+
+/**
+  *@brief Stage a file at a new path without decoding it.  The cheapest method the platform
+  *          and file system allow is used: a hard link (TRANSFER_LINK only), then a copy-on-write
+  *          clone, then an in-kernel copy and finally a buffered copy.  An existing destination
+  *          is removed first, so a staged hard link never lets a copy write through to its source.
+  *
+  *INPUTS
+  *@param source : Path of the file to be staged.
+  *@param dest   : Path of the staged file.
+  *@param mode   : Whether the staged file may share the source's directory entry.
+  *
+  *OUTPUTS
+  *@param bytes : Size of the staged file in bytes.
+  *@param Method used, TRANSFER_FAILED if the file could not be staged.
+  */
+TransferMethod transferFile(const char* source, const char* dest, TransferMode mode, long long* bytes){
+
+    *bytes = 0;
+    remove(dest);
+
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+
+    if(GetFileAttributesExA(source, GetFileExInfoStandard, &info)){
+        *bytes = ((long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+        if(mode == TRANSFER_LINK && CreateHardLinkA(dest, source, NULL))
+            return TRANSFER_HARDLINK;
+        // CopyFile clones blocks itself where the file system supports it
+        if(CopyFileA(source, dest, FALSE))
+            return TRANSFER_KERNEL_COPY;
+    }
+#else
+    int in = -1, out = -1;
+    struct stat st;
+    TransferMethod method = TRANSFER_BUFFERED;
+
+    if(mode == TRANSFER_LINK && link(source, dest) == 0){
+        if(stat(dest, &st) == 0)
+            *bytes = (long long)st.st_size;
+        return TRANSFER_HARDLINK;
+    }
+
+    in = open(source, O_RDONLY);
+    if(in >= 0 && fstat(in, &st) == 0){
+        *bytes = (long long)st.st_size;
+        out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if(out >= 0){
+#ifdef FICLONE
+        if(ioctl(out, FICLONE, in) == 0)
+            method = TRANSFER_REFLINK;
+#endif
+#ifdef __linux__
+        if(method == TRANSFER_BUFFERED && kernelCopy(in, out, *bytes))
+            method = TRANSFER_KERNEL_COPY;
+#endif
+        if(close(out) != 0)
+            method = TRANSFER_BUFFERED;
+    }
+    if(in >= 0)
+        close(in);
+    if(method != TRANSFER_BUFFERED)
+        return method;
+#endif
+
+    if(bufferedCopy(source, dest, bytes))
+        return TRANSFER_BUFFERED;
+    return TRANSFER_FAILED;
+}
+
+/**
+  *@brief Name of a transfer method, as written to the downlink manifest.
+  *
+  *INPUTS
+  *@param method : Method returned by transferFile.
+  *
+  *OUTPUTS
+  *@param Lower case method name.
+  */
+const char* transferMethodName(TransferMethod method){
+
+    switch(method){
+        case TRANSFER_HARDLINK:    return "hardlink";
+        case TRANSFER_REFLINK:     return "reflink";
+        case TRANSFER_KERNEL_COPY: return "kernel";
+        case TRANSFER_BUFFERED:    return "buffered";
+        default:                   return "failed";
+    }
+}
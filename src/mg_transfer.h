@@ -0,0 +1,41 @@
+/*
+Primary accretion detection algorithm.
+
+File transfer functions for staging images without decoding them.
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#ifndef MG_TRANSFER_H_INCLUDED
+#define MG_TRANSFER_H_INCLUDED
+
+// How staged files relate to their source.  TRANSFER_LINK hard links the staged file to the source
+// image when both are on the same file system, TRANSFER_COPY always writes an independent copy.
+// Either falls back to the next cheaper method the platform and file system support.
+typedef enum TransferMode{
+    TRANSFER_LINK,
+    TRANSFER_COPY
+}TransferMode;
+
+// Method transferFile actually used
+//   TRANSFER_FAILED      : the source could not be read or the destination written
+//   TRANSFER_HARDLINK    : new directory entry for the source file, no data moved
+//   TRANSFER_REFLINK     : copy-on-write clone sharing the source's blocks
+//   TRANSFER_KERNEL_COPY : copied inside the kernel (copy_file_range, sendfile or CopyFile)
+//   TRANSFER_BUFFERED    : read and written through a user space buffer
+typedef enum TransferMethod{
+    TRANSFER_FAILED = -1,
+    TRANSFER_HARDLINK,
+    TRANSFER_REFLINK,
+    TRANSFER_KERNEL_COPY,
+    TRANSFER_BUFFERED
+}TransferMethod;
+
+TransferMethod transferFile(const char* source, const char* dest, TransferMode mode, long long* bytes);
+const char* transferMethodName(TransferMethod method);
+
+#endif // MG_TRANSFER_H_INCLUDED
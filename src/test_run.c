@@ -24,7 +24,8 @@
  * 4.) Shift between images is determined by returning the mean value of the difference in location between a given centroid in the first and
  *     second frame.  Frame shift calculated in both the x and y plane to return an (x,y) shift pair. Roughly equivalent to particle velocities.
  *
- * 5.) Difference between shifts returned in step 5 are calculated and stored.  Roughly equivalent to particle accelerations.
+ * 5.) Particles are tracked across the whole sequence with persistent track ids.  The mean per-particle acceleration of the
+ *     tracks in each frame is calculated and stored.
  *
  * 6.) Data is sorted based on data collected in step 5 (rough acceleration data) and K-Means grouping density collected in step 3.
  *     Sorted based on value = (acceleration * weighted classifier 1)*(k-Means density * weighted classifier 2).  Data queued in value
@@ -44,89 +45,164 @@
 #include "mg_conncomp.h"
 #include "mg_kmeans.h"
 #include "mg_centroid.h"
+#include "mg_transfer.h"
 #include "mg_downlink.h"
+#include "mg_scheduler.h"
+#include "mg_roi.h"
+#include "mg_simd.h"
+#include "mg_tracker.h"
 
 char sourceImageDir[] = "C:\\work\\AOSAT\\data\\camera_data\\";
 char destImageDir[]   = "C:\\work\\AOSAT\\data\\threshold\\";
 char downlinkDir[]    = "C:\\work\\AOSAT\\data\\downlink\\";
 
+// Optimal threshold search.  THRESHOLD_SEARCH_EXHAUSTIVE is the original 0-255 sweep,
+// THRESHOLD_SEARCH_HISTOGRAM returns the same value from a single histogram pass per frame.
+ThresholdSearchMode thresholdSearchMode = THRESHOLD_SEARCH_HISTOGRAM;
+
+// Connected component labeler.  Both produce the same components, LABELER_RUN_UNION_FIND scans
+// the thresholded image directly instead of tracing contours on a copy of it.
+LabelerMode labelerMode = LABELER_RUN_UNION_FIND;
+
+// Component positions.  CENTROID_GEOMETRIC uses the mean pixel position of each component,
+// CENTROID_INTENSITY_WEIGHTED refines it to the intensity weighted sub-pixel position in the
+// grayscale frame.
+CentroidMode centroidMode = CENTROID_INTENSITY_WEIGHTED;
+
+// K-means assignment.  KMEANS_LLOYD and KMEANS_HAMERLY produce the same clusters, KMEANS_HAMERLY
+// skips the distance evaluations that cannot change a centroid's cluster instead of measuring all
+// of them.  KMEANS_MINIBATCH approximates the clusters from random batches of centroids on frames
+// with many thousands of particles, for a per-frame cost that stays flat as counts grow.
+KMeansMode kmeansMode = KMEANS_HAMERLY;
+
+// K-means initialization.  KMEANS_SEED_PLUSPLUS seeds every frame with k-means++,
+// KMEANS_SEED_WARM starts from the centers of the previous frame.  Runs with the same seed
+// give identical clusters.
+KMeansSeeding kmeansSeeding = KMEANS_SEED_WARM;
+unsigned int kmeansSeed = 1;
+
+// Density score of every frame for the downlink queue.  DENSITY_NEAREST_NEIGHBOUR skips k-means
+// and scores frames by the mean nearest neighbour distance of their particles.
+DensityMode densityMode = DENSITY_KMEANS;
+
+// Largest frame to frame particle displacement, in pixels, accepted when matching particles
+double shiftGateRadius = 8.0;
+
+// Particle tracking.  Established tracks are searched for within trackGateRadius pixels of their
+// predicted position and end after trackMaxMissed frames without a detection.
+double trackGateRadius = 3.0;
+int trackMaxMissed = 2;
+
+// Downlink staging.  TRANSFER_LINK hard links the selected images into the downlink folder where
+// the file system allows it, TRANSFER_COPY always writes independent copies.  Neither decodes them.
+TransferMode transferMode = TRANSFER_LINK;
+
+// Downlink format.  DOWNLINK_PACKETS losslessly codes the selected images into fixed size packets
+// of downlinkPacketSize bytes, DOWNLINK_ROI codes only the particle bounding boxes of each image,
+// grown by roiMargin pixels and merged into at most roiMaxRects rectangles.  DOWNLINK_DELTA codes
+// the images after the first of every run of consecutive images against the image before them.
+// DOWNLINK_RAW stages the PGM files as they are.
+DownlinkFormat downlinkFormat = DOWNLINK_PACKETS;
+int downlinkPacketSize = CODEC_DEFAULT_PACKET_SIZE;
+int roiMargin = ROI_DEFAULT_MARGIN;
+int roiMaxRects = ROI_MAX_RECTS;
+
+// Downlink selection.  SCHEDULE_BATCH ranks the whole sequence once it is analysed and sends
+// downlinkPercentage of it.  SCHEDULE_STREAM queues every image as soon as it is scored, keeping
+// at most schedulerCandidates of them, and stages images during the sequence as the passes of
+// linkModel allow.  Streaming keeps the regions of the last three images only, the scores and
+// sizes of every image are still kept for scores.csv and the mean threshold still reads every
+// image before the first one is analysed.
+DownlinkSchedule downlinkSchedule = SCHEDULE_BATCH;
+LinkModel linkModel = {LINK_DEFAULT_PASS_BYTES, LINK_DEFAULT_PASS_INTERVAL, LINK_DEFAULT_FIRST_PASS};
+int schedulerCandidates = SCHEDULER_DEFAULT_CANDIDATES;
+
+// Weights of the cluster distance and the acceleration in the downlink score.  The scoring
+// inputs of every image are written to scores.csv in the downlink folder, tools/downlink_sim
+// replays them through a modeled link to tune the weights and the downlink percentage.
+ScoreWeights scoreWeights = {SCORE_DEFAULT_C1, SCORE_DEFAULT_C2};
+
+// Widest SIMD kernels to use, lowered to what the CPU supports
+KernelLevel kernelLevel = KERNEL_AVX512;
+
 /**
   *@brief Data processing sequence.  Reads image, thresholds, conducts connected component
-  *           analysis and determines centroids.
+  *           analysis and determines centroids, optionally refined on the grayscale image.
   *
   *INPUTS
+  *@param labeler      : Connected component labeling context reused for every frame
+  *@param clusterer    : K-means context reused for every frame
+  *@param density      : Nearest neighbour density workspace reused for every frame
+  *@param merger       : Region of interest workspace reused for every frame
   *@param original     : Grayscale image direct from camera
   *@param result       : Original image after thresholding
   *@param thresholdVal : Value to threshold all images in the data set at
   *@param imageIndex   : Image index in the data set
   *@param numImages    : Number of total images in the data set
-  *@param distance     : Mean value of each centroid and it's cluster center
+  *@param distance     : Density score, mean value of each centroid and it's cluster center or
+  *                       nearest neighbour depending on densityMode
   *
   *OUTPUTS
-  *@param centroids : List of image centroid coordinates
-  *@param ccCount   : Number of connected components
+  *@param centroids : Table of image centroid coordinates, its buffers are reused across frames
+  *@param roi       : Regions of interest of the image, only found for DOWNLINK_ROI
   *
   */
-Centroid* ProcessImage(PGMImage* original,
-                       PGMImage* result,
-                       Centroid* centroids,
-                       int thresholdVal,
-                       int* ccCount,
-                       int imageIndex,
-                       int numImages,
-                       double* distance)
+void ProcessImage(LabelContext* labeler,
+                  KMeansContext* clusterer,
+                  NeighbourDensity* density,
+                  RoiMerger* merger,
+                  PGMImage* original,
+                  PGMImage* result,
+                  CentroidTable* centroids,
+                  int thresholdVal,
+                  int imageIndex,
+                  int numImages,
+                  double* distance,
+                  FrameRoi* roi)
 {
     char readPath[MAXSTRINGLENGTH];
     char writePath[MAXSTRINGLENGTH];
 
-    int k = 0;
+    int k = 0, ccCount = 0;
 
     sprintf(readPath, "%s%03d.pgm", sourceImageDir,imageIndex);
-    readPGM(readPath,original);
+    mapPGM(readPath,original);
     copyPGM(original,result);
     thresholdImage(original,result,thresholdVal);
 
-    centroids = ConnectedComponentLabeling(result,ccCount, &k);
+    ConnectedComponentLabeling(labeler,result,centroids,&ccCount,&k);
 
-    if(centroids == NULL)
+    if(centroidMode == CENTROID_INTENSITY_WEIGHTED)
     {
-        printf("Error: Connected Components Labeling did not return centroids.  Quitting program.");
-        exit(0);
+        refineCentroids(labeler,original,thresholdVal,centroids);
+    }
+
+    if(downlinkFormat == DOWNLINK_ROI)
+    {
+        findRegions(merger,&labeler->components,original,roiMargin,roiMaxRects,ROI_TILE_COST,roi);
     }
 
-    kmeans(result,k,centroids,*ccCount);
-    *distance = calcClusterDensity(*ccCount, centroids);
+    if(densityMode == DENSITY_NEAREST_NEIGHBOUR)
+    {
+        *distance = calcNeighbourDensity(density,centroids);
+    }
+    else
+    {
+        kmeans(clusterer,result,k,centroids);
+        *distance = calcClusterDensity(centroids);
+    }
     sprintf(writePath, "%s%03d.pgm", destImageDir,imageIndex);
     writePGM(writePath,result);
-
-    return centroids;
 }
 
 /**
-  * @brief Process to free an allocated centroid array.
-  *
-  * INPUTS
-  * @param c    : The Centroid* array that is to be freed
-  * @param cLen : The length of the Centroid* array
-  *
-  * OUTPUTS
-  * none
-  *
-  * @post The Centroid* array has had all of its distance elements and the main array itself
-  *         freed and set to NULL
-  *
+  *@brief Report the pass the downlink scheduler just opened.
   */
-void freeCentroidArray(Centroid* c, int cLen) {
-
-  int i = 0;
-  if(c != NULL) {
-    for(i = 0; i < cLen; i++) {
-      free(c[i].distances);
-      c[i].distances = NULL;
-    }
-    free(c);
-    c = NULL;
-  }
+void printPass(const DownlinkScheduler* scheduler)
+{
+    printf("Pass %d after image %03d: %lld bytes, %d images staged, %lld bytes waiting, %d candidates\n",
+           scheduler->passes,scheduler->newest,scheduler->passBytes,scheduler->passImages,scheduler->backlog,
+           scheduler->count);
 }
 
 /**
@@ -144,6 +220,7 @@ void freeCentroidArray(Centroid* c, int cLen) {
 int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
 {
     char pathImage[MAXSTRINGLENGTH];
+    char pathScores[MAXSTRINGLENGTH];
     PGMImage workingImage1;
     PGMImage result1;
     PGMImage workingImage2;
@@ -152,19 +229,37 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
     int i=0, sum=0, numImages=0;
     int thresholdVal=0, index=0;
     int shiftIndex=0, distIndex=0;
-    int accIndex=0;
-    int centList1Len=0,centList2Len=0;
-    int corrMatrix[endImg-startImg+1];
+    int accIndex=0, numRois=0;
+    int *corrMatrix = NULL;
     double mean=0.0, distance=0.0;
-    Centroid *centList1=NULL;
-    Centroid *centList2=NULL;
+    CentroidTable centList1;
+    CentroidTable centList2;
     Shift *shiftList = NULL;
     Shift *accList = NULL;
+    long long *sizes = NULL;
+    double *kDistances = NULL;
     Shift *shift;
-    Shift *shiftPrev = NULL;
+    Shift acceleration;
+    ShiftMatch match;
+    ShiftDetector shifter;
+    LabelContext labeler;
+    KMeansContext clusterer;
+    NeighbourDensity density;
+    RoiMerger merger;
+    FrameRoi *rois = NULL;
+    Tracker tracker;
+    DownlinkStage stage;
+    DownlinkScheduler scheduler;
+    PacketStream sizer;
 
     numImages = endImg - startImg + 1;
-    double kDistances[numImages];
+    corrMatrix = malloc(numImages*sizeof(int));
+    kDistances = malloc(numImages*sizeof(double));
+    if(corrMatrix == NULL || kDistances == NULL)
+    {
+        printf("Error: Cannot allocate image list memory.  Quitting program.");
+        exit(0);
+    }
 
     // initialize memory to zero
     memset(kDistances, 0, sizeof(double)*numImages);
@@ -176,11 +271,11 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
     {
         sprintf(pathImage, "%s%03d.pgm", sourceImageDir,index);
         puts(pathImage);
-        readPGM(pathImage,&workingImage1);
-        corrMatrix[i] = thresholdImageSequence(&workingImage1);
+        mapPGM(pathImage,&workingImage1);
+        corrMatrix[i] = findOptimalThreshold(&workingImage1, thresholdSearchMode);
         index++;
 
-        // free memory created from the readPGM call
+        // release the mapping created by the mapPGM call
         freePGMImage(&workingImage1);
     }
 
@@ -191,24 +286,62 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
     }
 
     mean = sum/(double)numImages;
+    free(corrMatrix);
+    corrMatrix = NULL;
     thresholdVal = (int)mean;
     printf("Mean thresholding value for the given dataset: %d\n",thresholdVal);
 
     shiftList = malloc((numImages-1)*(sizeof(Shift)));
     accList = malloc((numImages-2)*(sizeof(Shift)));
-    shiftPrev = malloc(sizeof(Shift));
+    // Batch selection crops every image once the sequence ends, streaming only the last three
+    numRois = downlinkSchedule == SCHEDULE_STREAM ? 3 : numImages;
+    rois = malloc(numRois*sizeof(FrameRoi));
+    sizes = malloc(numImages*sizeof(long long));
+    if((shiftList == NULL && numImages > 1) || (accList == NULL && numImages > 2) || rois == NULL || sizes == NULL)
+    {
+        printf("Error: Cannot allocate image list memory.  Quitting program.");
+        exit(0);
+    }
+    memset(sizes, 0, sizeof(long long)*numImages);
+    initLabelContext(&labeler, labelerMode);
+    initKMeansContext(&clusterer, kmeansMode, kmeansSeeding, kmeansSeed);
+    initNeighbourDensity(&density);
+    initShiftDetector(&shifter);
+    initRoiMerger(&merger);
+    initCentroidTable(&centList1);
+    initCentroidTable(&centList2);
+    initTracker(&tracker, shiftGateRadius, trackGateRadius, trackMaxMissed);
+    initPacketStream(&sizer, downlinkPacketSize);
+    if(downlinkSchedule == SCHEDULE_STREAM)
+    {
+        openDownlinkStage(&stage, downlinkFormat, transferMode, downlinkPacketSize, NULL);
+        initDownlinkScheduler(&scheduler, &linkModel, schedulerCandidates, &stage);
+    }
 
     // Modulus logic to reduce number of necessary image reads. Fills opposite image structure on each incremental call
     //  and reverses comparison order to retain cohesion.  Allows for since image read on every iteration.
     if(startImg % 2 == 0)
     {
-        centList1 = ProcessImage(&workingImage1,&result1,centList1,thresholdVal,&centList1Len,startImg,numImages,&distance);
+        ProcessImage(&labeler,&clusterer,&density,&merger,&workingImage1,&result1,&centList1,thresholdVal,startImg,numImages,&distance,&rois[distIndex % numRois]);
     }
     else
     {
-        centList2 = ProcessImage(&workingImage2,&result2,centList2,thresholdVal,&centList2Len,startImg,numImages,&distance);
+        ProcessImage(&labeler,&clusterer,&density,&merger,&workingImage2,&result2,&centList2,thresholdVal,startImg,numImages,&distance,&rois[distIndex % numRois]);
     }
+    if(startImg % 2 == 0)
+        updateTracker(&tracker,startImg,&centList1,&acceleration);
+    else
+        updateTracker(&tracker,startImg,&centList2,&acceleration);
     kDistances[distIndex] = distance;
+    sizes[distIndex] = downlinkSize(&sizer,downlinkFormat,startImg % 2 == 0 ? &workingImage1 : &workingImage2,
+                                    &rois[distIndex % numRois],startImg);
+    if(downlinkSchedule == SCHEDULE_STREAM)
+    {
+        addSchedulerImage(&scheduler,startImg,downlinkFormat == DOWNLINK_ROI ? &rois[distIndex % numRois] : NULL);
+        offerSchedulerImage(&scheduler,startImg,0.0,"first",true);
+        if(advanceScheduler(&scheduler))
+            printPass(&scheduler);
+    }
     distIndex++;
 
 
@@ -218,79 +351,117 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
         //  and reverses comparison order to retain cohesion.  Allows for since image read on every iteration.
         if(i % 2 == 0)
         {
-            centList1 = ProcessImage(&workingImage1,&result1,centList1,thresholdVal,&centList1Len,i,numImages,&distance);
+            ProcessImage(&labeler,&clusterer,&density,&merger,&workingImage1,&result1,&centList1,thresholdVal,i,numImages,&distance,&rois[distIndex % numRois]);
         }
         else
         {
-            centList2 = ProcessImage(&workingImage2,&result2,centList2,thresholdVal,&centList2Len,i,numImages,&distance);
+            ProcessImage(&labeler,&clusterer,&density,&merger,&workingImage2,&result2,&centList2,thresholdVal,i,numImages,&distance,&rois[distIndex % numRois]);
         }
 
         kDistances[distIndex] = distance;
+        sizes[distIndex] = downlinkSize(&sizer,downlinkFormat,i % 2 == 0 ? &workingImage1 : &workingImage2,
+                                        &rois[distIndex % numRois],i);
         distIndex++;
 
-        shift = detectShift(centList1,centList1Len,centList2,centList2Len);
+        // Always measure from the previous frame to the frame just processed
+        if(i % 2 == 0)
+            shift = detectShift(&shifter,&centList2,&centList1,shiftGateRadius,&match);
+        else
+            shift = detectShift(&shifter,&centList1,&centList2,shiftGateRadius,&match);
+        printf("Shift %03d-%03d: %f %f, matched %d of %d particles (%.2f)\n",i-1,i,
+               shift->x,shift->y,match.numMatched,match.numParticles,match.matchRate);
+        freeShiftMatch(&match);
         shiftList[shiftIndex].x = shift->x;
         shiftList[shiftIndex].y = shift->y;
         shiftIndex++;
 
+        // Per-particle accelerations of the tracks followed through the last three frames
+        if(i % 2 == 0)
+            updateTracker(&tracker,i,&centList1,&acceleration);
+        else
+            updateTracker(&tracker,i,&centList2,&acceleration);
+        printf("Tracks %03d: %d active, %d born, %d ended, acceleration %f %f\n",i,tracker.numTracks,
+               tracker.births,tracker.deaths,acceleration.x,acceleration.y);
+
         if(i > startImg+1 && (accIndex < (numImages-2))){
-            accList[accIndex].x = shiftPrev->x - shift->x;
-            accList[accIndex].y = shiftPrev->y - shift->y;
+            accList[accIndex].x = acceleration.x;
+            accList[accIndex].y = acceleration.y;
             accIndex++;
         }
-        shiftPrev->x = shift->x;
-        shiftPrev->y = shift->y;
+
+        // Image i-1 can be scored now that the acceleration across it is known
+        if(downlinkSchedule == SCHEDULE_STREAM)
+        {
+            addSchedulerImage(&scheduler,i,downlinkFormat == DOWNLINK_ROI ? &rois[(distIndex-1) % numRois] : NULL);
+            if(i > startImg+1)
+                offerSchedulerImage(&scheduler,i-1,frameScore(&scoreWeights,kDistances[distIndex-2],&acceleration),"score",false);
+            if(i == endImg)
+                offerSchedulerImage(&scheduler,i,0.0,"last",true);
+            if(advanceScheduler(&scheduler))
+                printPass(&scheduler);
+        }
 
         free(shift);
         shift = NULL;
 
-        // After performing the shift detection, free the memory on the image and centroid array we are about to overwrite in
+        // After performing the shift detection, free the memory on the image we are about to overwrite in
         // the next iteration through this loop.
         if((i+1) % 2 == 0)
         {
-          freeCentroidArray(centList1, centList1Len);
           freePGMImage(&workingImage1);
           freePGMImage(&result1);
-          centList1 = NULL;
         }
         else
         {
-          freeCentroidArray(centList2, centList2Len);
           freePGMImage(&workingImage2);
           freePGMImage(&result2);
-          centList2 = NULL;
         }
     }
 
-    //Determine which images to queue for downlink from the spacecraft based on acceleration & K-means distance data.
-    downlinkData(downlinkPercentage,accList,kDistances,startImg,numImages);
+    printf("Trajectories: %d tracks, %d observations\n",tracker.nextId-1,tracker.trajectories.count);
+    if(clusterer.numClustered > 0)
+        printf("K-means: %d frames, %.2f iterations per frame, %d stopped at the iteration limit\n",
+               clusterer.numClustered,(double)clusterer.totalIterations/clusterer.numClustered,clusterer.numCapped);
 
-    // Free the final memory for centroid arrays
-    if(centList1 != NULL) {
-      freeCentroidArray(centList1, centList1Len);
-      centList1 = NULL;
+    //Determine which images to queue for downlink from the spacecraft based on acceleration & K-means distance data.
+    if(downlinkSchedule == SCHEDULE_STREAM)
+    {
+        flushScheduler(&scheduler);
+        printPass(&scheduler);
+        printf("Streamed %d images, %lld bytes in %d passes, first data after image %03d, %lld bytes waiting\n",
+               scheduler.images,scheduler.bytes,scheduler.passes,scheduler.firstPassImage,scheduler.backlog);
+        printf("Candidates: %d left queued, %d evicted\n",scheduler.count,scheduler.evicted);
+        freeDownlinkScheduler(&scheduler);
+        closeDownlinkStage(&stage);
     }
-    if(centList2 != NULL) {
-      freeCentroidArray(centList2, centList2Len);
-      centList2 = NULL;
+    else
+    {
+        downlinkData(downlinkPercentage,&scoreWeights,accList,kDistances,rois,startImg,numImages,downlinkFormat,transferMode,downlinkPacketSize);
     }
+    sprintf(pathScores, "%sscores.csv", downlinkDir);
+    writeScores(pathScores,kDistances,accList,sizes,startImg,numImages);
+    freePacketStream(&sizer);
+
+    // Free the final memory for centroid tables
+    freeCentroidTable(&centList1);
+    freeCentroidTable(&centList2);
 
     // Free the final memory for working and resulting images
-    if(workingImage1.image != NULL) {
+    if(workingImage1.pixels != NULL) {
         freePGMImage(&workingImage1);
-        workingImage1.image = NULL;
+        workingImage1.pixels = NULL;
     }
-    if(workingImage2.image != NULL) {
+    if(workingImage2.pixels != NULL) {
         freePGMImage(&workingImage2);
-        workingImage2.image = NULL;
+        workingImage2.pixels = NULL;
     }
-    if(result1.image != NULL) {
+    if(result1.pixels != NULL) {
         freePGMImage(&result1);
-        result1.image = NULL;
+        result1.pixels = NULL;
     }
-    if(result2.image != NULL) {
+    if(result2.pixels != NULL) {
         freePGMImage(&result2);
-        result2.image = NULL;
+        result2.pixels = NULL;
     }
 
     // Free the final memory for the shift array
@@ -305,10 +476,168 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
       accList = NULL;
     }
 
-    // Free the final memory for the previous shift pointer
-    if(shiftPrev != NULL) {
-      free(shiftPrev);
-      shiftPrev = NULL;
+    // Free the downlink size and cluster density of every image
+    if(sizes != NULL) {
+      free(sizes);
+      sizes = NULL;
+    }
+    if(kDistances != NULL) {
+      free(kDistances);
+      kDistances = NULL;
+    }
+
+    // Free the regions of interest
+    if(rois != NULL) {
+      free(rois);
+      rois = NULL;
+    }
+    freeRoiMerger(&merger);
+
+    // Free the labeling workspace
+    freeLabelContext(&labeler);
+
+    // Free the clustering workspace
+    freeKMeansContext(&clusterer);
+    freeNeighbourDensity(&density);
+
+    // Free the shift detection workspace
+    freeShiftDetector(&shifter);
+
+    // Free the tracks and trajectories
+    freeTracker(&tracker);
+
+    return 0;
+}
+
+/**
+  *@brief Parse command line options selecting the algorithms used by the science sequence.
+  *          Options have the form --name=value:
+  *            --threshold=exhaustive|histogram
+  *            --labeler=trace|runs
+  *            --centroids=geometric|weighted
+  *            --kmeans=lloyd|hamerly|minibatch
+  *            --kmeans-init=plusplus|warm
+  *            --seed=<number>
+  *            --density=kmeans|neighbour
+  *            --gate=<pixels>
+  *            --track-gate=<pixels>
+  *            --kernels=scalar|sse2|avx2|avx512
+  *            --transfer=link|copy
+  *            --downlink=raw|packets|roi|delta
+  *            --packet-size=<bytes>
+  *            --roi-margin=<pixels>
+  *            --roi-rects=<number>
+  *            --schedule=batch|stream
+  *            --candidates=<number>
+  *            --pass-bytes=<bytes>
+  *            --pass-interval=<images>
+  *            --first-pass=<images>
+  *            --c1=<weight>
+  *            --c2=<weight>
+  *
+  *INPUTS
+  *@param argc : Number of arguments.
+  *@param argv : Argument strings.
+  *
+  *OUTPUTS
+  *@param 0 if every option was understood, -1 otherwise.
+  */
+int parseOptions(int argc, char* argv[])
+{
+    int i=0;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--threshold=exhaustive") == 0)
+            thresholdSearchMode = THRESHOLD_SEARCH_EXHAUSTIVE;
+        else if(strcmp(argv[i], "--threshold=histogram") == 0)
+            thresholdSearchMode = THRESHOLD_SEARCH_HISTOGRAM;
+        else if(strcmp(argv[i], "--labeler=trace") == 0)
+            labelerMode = LABELER_CONTOUR_TRACING;
+        else if(strcmp(argv[i], "--labeler=runs") == 0)
+            labelerMode = LABELER_RUN_UNION_FIND;
+        else if(strcmp(argv[i], "--centroids=geometric") == 0)
+            centroidMode = CENTROID_GEOMETRIC;
+        else if(strcmp(argv[i], "--centroids=weighted") == 0)
+            centroidMode = CENTROID_INTENSITY_WEIGHTED;
+        else if(strcmp(argv[i], "--kmeans=lloyd") == 0)
+            kmeansMode = KMEANS_LLOYD;
+        else if(strcmp(argv[i], "--kmeans=hamerly") == 0)
+            kmeansMode = KMEANS_HAMERLY;
+        else if(strcmp(argv[i], "--kmeans=minibatch") == 0)
+            kmeansMode = KMEANS_MINIBATCH;
+        else if(strcmp(argv[i], "--kmeans-init=plusplus") == 0)
+            kmeansSeeding = KMEANS_SEED_PLUSPLUS;
+        else if(strcmp(argv[i], "--kmeans-init=warm") == 0)
+            kmeansSeeding = KMEANS_SEED_WARM;
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+            kmeansSeed = (unsigned int)strtoul(argv[i] + 7, NULL, 10);
+        else if(strcmp(argv[i], "--density=kmeans") == 0)
+            densityMode = DENSITY_KMEANS;
+        else if(strcmp(argv[i], "--density=neighbour") == 0)
+            densityMode = DENSITY_NEAREST_NEIGHBOUR;
+        else if(strncmp(argv[i], "--gate=", 7) == 0 && atof(argv[i] + 7) > 0.0)
+            shiftGateRadius = atof(argv[i] + 7);
+        else if(strncmp(argv[i], "--track-gate=", 13) == 0 && atof(argv[i] + 13) > 0.0)
+            trackGateRadius = atof(argv[i] + 13);
+        else if(strcmp(argv[i], "--kernels=scalar") == 0)
+            kernelLevel = KERNEL_SCALAR;
+        else if(strcmp(argv[i], "--kernels=sse2") == 0)
+            kernelLevel = KERNEL_SSE2;
+        else if(strcmp(argv[i], "--kernels=avx2") == 0)
+            kernelLevel = KERNEL_AVX2;
+        else if(strcmp(argv[i], "--kernels=avx512") == 0)
+            kernelLevel = KERNEL_AVX512;
+        else if(strcmp(argv[i], "--transfer=link") == 0)
+            transferMode = TRANSFER_LINK;
+        else if(strcmp(argv[i], "--transfer=copy") == 0)
+            transferMode = TRANSFER_COPY;
+        else if(strcmp(argv[i], "--downlink=raw") == 0)
+            downlinkFormat = DOWNLINK_RAW;
+        else if(strcmp(argv[i], "--downlink=packets") == 0)
+            downlinkFormat = DOWNLINK_PACKETS;
+        else if(strcmp(argv[i], "--downlink=roi") == 0)
+            downlinkFormat = DOWNLINK_ROI;
+        else if(strcmp(argv[i], "--downlink=delta") == 0)
+            downlinkFormat = DOWNLINK_DELTA;
+        else if(strncmp(argv[i], "--packet-size=", 14) == 0 && atoi(argv[i] + 14) >= CODEC_MIN_PACKET_SIZE &&
+                atoi(argv[i] + 14) <= CODEC_MAX_PACKET_SIZE)
+            downlinkPacketSize = atoi(argv[i] + 14);
+        else if(strncmp(argv[i], "--roi-margin=", 13) == 0 && atoi(argv[i] + 13) >= 0)
+            roiMargin = atoi(argv[i] + 13);
+        else if(strncmp(argv[i], "--roi-rects=", 12) == 0 && atoi(argv[i] + 12) >= 1 &&
+                atoi(argv[i] + 12) <= ROI_MAX_RECTS)
+            roiMaxRects = atoi(argv[i] + 12);
+        else if(strcmp(argv[i], "--schedule=batch") == 0)
+            downlinkSchedule = SCHEDULE_BATCH;
+        else if(strcmp(argv[i], "--schedule=stream") == 0)
+            downlinkSchedule = SCHEDULE_STREAM;
+        else if(strncmp(argv[i], "--candidates=", 13) == 0 && atoi(argv[i] + 13) >= 1)
+            schedulerCandidates = atoi(argv[i] + 13);
+        else if(strncmp(argv[i], "--pass-bytes=", 13) == 0 && atoll(argv[i] + 13) >= 1)
+            linkModel.passBytes = atoll(argv[i] + 13);
+        else if(strncmp(argv[i], "--pass-interval=", 16) == 0 && atoi(argv[i] + 16) >= 1)
+            linkModel.passInterval = atoi(argv[i] + 16);
+        else if(strncmp(argv[i], "--first-pass=", 13) == 0 && atoi(argv[i] + 13) >= 1)
+            linkModel.firstPass = atoi(argv[i] + 13);
+        else if(strncmp(argv[i], "--c1=", 5) == 0)
+            scoreWeights.c1 = atof(argv[i] + 5);
+        else if(strncmp(argv[i], "--c2=", 5) == 0)
+            scoreWeights.c2 = atof(argv[i] + 5);
+        else
+        {
+            printf("Error: Unknown option %s\n", argv[i]);
+            printf("Options: --threshold=exhaustive|histogram --labeler=trace|runs\n");
+            printf("         --centroids=geometric|weighted --kmeans=lloyd|hamerly|minibatch\n");
+            printf("         --kmeans-init=plusplus|warm --seed=<number> --density=kmeans|neighbour\n");
+            printf("         --gate=<pixels> --track-gate=<pixels>\n");
+            printf("         --kernels=scalar|sse2|avx2|avx512 --transfer=link|copy\n");
+            printf("         --downlink=raw|packets|roi|delta --packet-size=<bytes>\n");
+            printf("         --roi-margin=<pixels> --roi-rects=<number>\n");
+            printf("         --schedule=batch|stream --candidates=<number> --pass-bytes=<bytes>\n");
+            printf("         --pass-interval=<images> --first-pass=<images> --c1=<weight> --c2=<weight>\n");
+            return -1;
+        }
     }
 
     return 0;
@@ -318,7 +647,8 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
   *@brief Program main().  Currently tests science analysis and downlink queue creation algorithms.
   *
   *INPUTS
-  *none
+  *@param argc : Number of arguments.
+  *@param argv : Algorithm selection options, see parseOptions.
   *
   *OUTPUTS
   *none
@@ -326,10 +656,14 @@ int SciAnalysis(int startImg, int endImg, int downlinkPercentage)
   *@post Downlink queue established.  Currently located in \data\downlink\.  Represents all data
   *         which needs to be downlinked from spacecraft from a given science routine.
   */
-int main()
+int main(int argc, char* argv[])
 {
 
+    if(parseOptions(argc, argv) != 0)
+        return 1;
+
     printf("\nBeginning the ASP accretion RFS test...\n\n");
+    printf("Pixel kernels: %s\n", kernelLevelName(setKernelLevel(kernelLevel)));
 
     int startImg = 1;
     int endImg = 135;
@@ -0,0 +1,189 @@
+/*
+Primary accretion detection algorithm.
+
+Connected component labeler benchmark.  Times contour tracing against run-length
+union-find labeling on synthetic sparse and dense frames and on any PGM files given on
+the command line (thresholded at their optimal threshold), and checks that both
+labelers return the same components.
+
+Build from the src directory:
+  gcc -O2 -I. tools/bench_conncomp.c mg_conncomp.c mg_centroid.c mg_image.c mg_threshold.c mg_simd.c -lm -o bench_conncomp
+
+Usage:
+  bench_conncomp [image.pgm ...]
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mg.h"
+#include "mg_image.h"
+#include "mg_threshold.h"
+#include "mg_conncomp.h"
+#include "mg_centroid.h"
+
+#define BENCH_MIN_SECONDS 0.5
+
+static unsigned int benchSeed = 12345;
+
+static int benchRand(void){
+    benchSeed = benchSeed * 1103515245u + 12345u;
+    return (int)((benchSeed >> 16) & 0x7FFF);
+}
+
+/**
+  *@brief Create a binary frame of WHITEPIX background with numDisks BLACKPIX disks.
+  *
+  *INPUTS
+  *@param width     : Frame width.
+  *@param height    : Frame height.
+  *@param numDisks  : Number of disks to draw.
+  *@param maxRadius : Largest disk radius.
+  *
+  *OUTPUTS
+  *@param image : Allocated binary frame.
+  */
+static void makeDiskFrame(PGMImage* image, int width, int height, int numDisks, int maxRadius){
+
+    int i=0, x=0, y=0, cx=0, cy=0, r=0;
+
+    image->header.type[0] = 'P';
+    image->header.type[1] = '5';
+    image->header.width = width;
+    image->header.height = height;
+    image->header.grayscale = 1;
+    allocatePGMImageArray(image);
+
+    for(y = 0; y < height; y++){
+        memset(PGMROW(image, y), WHITEPIX, width);
+    }
+
+    for(i = 0; i < numDisks; i++){
+        cx = benchRand() % width;
+        cy = benchRand() % height;
+        r = 1 + benchRand() % maxRadius;
+        for(y = cy - r; y <= cy + r; y++){
+            for(x = cx - r; x <= cx + r; x++){
+                if(y >= 0 && y < height && x >= 0 && x < width &&
+                   (x-cx)*(x-cx) + (y-cy)*(y-cy) <= r*r){
+                    PGMPIXEL(image, y, x) = BLACKPIX;
+                }
+            }
+        }
+    }
+}
+
+/**
+  *@brief Time one labeler on one frame.
+  *
+  *INPUTS
+  *@param ctx   : Labeling context selecting the labeler.
+  *@param image : Binary frame.
+  *
+  *OUTPUTS
+  *@param count : Number of components found.
+  *@param cents : Component centroids, reused by every run.
+  *@param Milliseconds per frame.
+  */
+static double timeLabeler(LabelContext* ctx, PGMImage* image, int* count, CentroidTable* cents){
+
+    int runs=0, k=0;
+    clock_t start, elapsed;
+
+    ConnectedComponentLabeling(ctx, image, cents, count, &k);
+    start = clock();
+    do {
+        ConnectedComponentLabeling(ctx, image, cents, count, &k);
+        runs++;
+        elapsed = clock() - start;
+    } while(elapsed < BENCH_MIN_SECONDS * CLOCKS_PER_SEC);
+
+    return 1000.0 * elapsed / CLOCKS_PER_SEC / runs;
+}
+
+/**
+  *@brief Benchmark both labelers on one frame and print the result.
+  *
+  *INPUTS
+  *@param name  : Frame description.
+  *@param image : Binary frame.
+  *
+  *OUTPUTS
+  *@param 0 if both labelers agree, 1 otherwise.
+  */
+static int benchFrame(const char* name, PGMImage* image){
+
+    int i=0, traceCount=0, runCount=0, mismatch=0;
+    double traceMs=0.0, runMs=0.0;
+    CentroidTable traceCents, runCents;
+    const Component *a, *b;
+    LabelContext tracer, runs;
+
+    initLabelContext(&tracer, LABELER_CONTOUR_TRACING);
+    initLabelContext(&runs, LABELER_RUN_UNION_FIND);
+    initCentroidTable(&traceCents);
+    initCentroidTable(&runCents);
+
+    traceMs = timeLabeler(&tracer, image, &traceCount, &traceCents);
+    runMs = timeLabeler(&runs, image, &runCount, &runCents);
+
+    mismatch = traceCount != runCount;
+    for(i = 0; i < traceCount && !mismatch; i++){
+        a = &tracer.components.items[i];
+        b = &runs.components.items[i];
+        mismatch = traceCents.x[i] != runCents.x[i] || traceCents.y[i] != runCents.y[i] ||
+                   a->area != b->area || a->seedX != b->seedX || a->seedY != b->seedY ||
+                   a->minX != b->minX || a->minY != b->minY ||
+                   a->maxX != b->maxX || a->maxY != b->maxY ||
+                   a->mxx != b->mxx || a->myy != b->myy || a->mxy != b->mxy;
+    }
+
+    printf("%-28s %5dx%-5d %7d %10.3f %10.3f %7.2fx %s\n", name, image->header.width,
+           image->header.height, traceCount, traceMs, runMs, traceMs / runMs,
+           mismatch ? "MISMATCH" : "ok");
+
+    freeCentroidTable(&traceCents);
+    freeCentroidTable(&runCents);
+    freeLabelContext(&tracer);
+    freeLabelContext(&runs);
+
+    return mismatch;
+}
+
+int main(int argc, char* argv[]){
+
+    int i=0, failures=0;
+    PGMImage frame, binary;
+
+    printf("%-28s %11s %7s %10s %10s %8s\n", "frame", "size", "comps", "trace ms", "runs ms", "speedup");
+
+    makeDiskFrame(&frame, 1024, 1024, 150, 6);
+    failures += benchFrame("synthetic sparse", &frame);
+    freePGMImage(&frame);
+
+    makeDiskFrame(&frame, 1024, 1024, 900, 24);
+    failures += benchFrame("synthetic dense", &frame);
+    freePGMImage(&frame);
+
+    makeDiskFrame(&frame, 1024, 1024, 40000, 1);
+    failures += benchFrame("synthetic high density", &frame);
+    freePGMImage(&frame);
+
+    for(i = 1; i < argc; i++){
+        mapPGM(argv[i], &frame);
+        copyPGM(&frame, &binary);
+        thresholdImage(&frame, &binary, thresholdImageHistogram(&frame));
+        failures += benchFrame(argv[i], &binary);
+        freePGMImage(&binary);
+        freePGMImage(&frame);
+    }
+
+    return failures != 0;
+}
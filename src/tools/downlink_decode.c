@@ -0,0 +1,214 @@
+/*
+Primary accretion detection algorithm.
+
+Downlink packet decoder.  Rebuilds an image from the fixed size packets encodePackets
+writes to the downlink folder, or from a cropped frame: the reconstruction header and the
+packets of its regions of interest.  Pixels outside the regions take the background value.
+Delta packets also need the rebuilt image before them as a reference.  Packets are checked
+and decoded independently, so damaged or missing packets only blank their own pixels; they
+are listed so they can be requested again and the decoder exits with status 1.
+
+Build from the src directory:
+  gcc -O2 -I. tools/downlink_decode.c mg_codec.c mg_roi.c mg_image.c mg_threshold.c mg_simd.c -lm -o downlink_decode
+
+Usage:
+  downlink_decode packets.pkt|regions.roi image.pgm [reference.pgm]
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "mg.h"
+#include "mg_image.h"
+#include "mg_codec.h"
+#include "mg_roi.h"
+
+/**
+  *@brief Read a whole file into memory.
+  *
+  *INPUTS
+  *@param filename : File to be read.
+  *
+  *OUTPUTS
+  *@param length : Number of bytes read.
+  *@param File contents, NULL if the file cannot be read.
+  */
+static unsigned char* readFile(const char* filename, long* length){
+
+    long size = 0;
+    unsigned char* data = NULL;
+    FILE* file = fopen(filename, "rb");
+
+    *length = 0;
+    if(file == NULL)
+        return NULL;
+    if(fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0){
+        // malloc_readFile data free at the end of main
+        data = malloc(size);
+        if(data != NULL && fread(data, 1, size, file) != (size_t)size){
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    if(data != NULL)
+        *length = size;
+    return data;
+}
+
+/**
+  *@brief Header of the first intact packet.  The packet size is taken from the first packet,
+  *          the packets after it are tried in turn if its header is damaged.
+  */
+static int findHeader(const unsigned char* data, long length, PacketHeader* header){
+
+    long offset = 0;
+    int packetSize = 0;
+
+    if(length < CODEC_HEADER_SIZE)
+        return 0;
+    packetSize = (data[4] << 8) | data[5];
+    if(packetSize < CODEC_MIN_PACKET_SIZE)
+        return 0;
+    for(offset = 0; offset + packetSize <= length; offset += packetSize){
+        if(readPacketHeader(data + offset, packetSize, header) && header->packetSize == packetSize)
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+
+    int i=0, decoded=0, damaged=0, missing=0, numPackets=0, numRects=0, headerSize=0, background=0;
+    long length=0, offset=0;
+    unsigned char* data;
+    unsigned char* packets;
+    bool* received;
+    PacketHeader first, header;
+    PGMImage image, reference;
+    FrameRoi roi;
+    CodecRect rects[ROI_MAX_RECTS];
+
+    if(argc != 3 && argc != 4){
+        printf("Usage: downlink_decode packets.pkt|regions.roi image.pgm [reference.pgm]\n");
+        return 1;
+    }
+
+    data = readFile(argv[1], &length);
+    if(data == NULL){
+        printf("Error: Cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    // A cropped frame starts with its reconstruction header, the packets follow it
+    if(length >= 2 && data[0] == 'M' && data[1] == 'R'){
+        headerSize = readRoiHeader(data, length, &roi);
+        if(headerSize == 0){
+            printf("Error: Damaged region header in %s\n", argv[1]);
+            free(data);
+            return 1;
+        }
+        numRects = roiCodecRects(&roi, rects);
+        background = roi.background;
+    }
+    packets = data + headerSize;
+    length -= headerSize;
+
+    if(!findHeader(packets, length, &first)){
+        if(headerSize == 0 || length > 0){
+            printf("Error: No intact packet in %s\n", argv[1]);
+            free(data);
+            return 1;
+        }
+        // A frame without regions is sent as its header alone
+        memset(&first, 0, sizeof(first));
+        first.maxval = 255;
+        first.packetSize = 1;
+    }
+    if(first.delta && (headerSize > 0 || argc != 4)){
+        printf("Error: %s holds delta packets, decoding needs the image before it as reference.pgm\n", argv[1]);
+        free(data);
+        return 1;
+    }
+    if(first.delta){
+        mapPGM(argv[3], &reference);
+        if(PGMIS16BIT(&reference) || reference.header.width != first.width || reference.header.height != first.height){
+            printf("Error: %s is not a %dx%d 8-bit reference image\n", argv[3], first.width, first.height);
+            freePGMImage(&reference);
+            free(data);
+            return 1;
+        }
+    }
+    if(headerSize == 0){
+        rects[0].x = 0;
+        rects[0].y = 0;
+        rects[0].width = first.width;
+        rects[0].height = first.height;
+        numRects = 1;
+    }
+    else{
+        first.width = roi.width;
+        first.height = roi.height;
+    }
+
+    image.header.type[0] = 'P';
+    image.header.type[1] = '5';
+    image.header.width = first.width;
+    image.header.height = first.height;
+    image.header.grayscale = first.maxval;
+    allocatePGMImageArray(&image);
+    for(i = 0; i < image.header.height; i++){
+        memset(PGMROW(&image, i), background, image.header.width);
+    }
+
+    // malloc_main received free at the end of main
+    received = calloc(first.count > 0 ? first.count : 1, sizeof(bool));
+    if(received == NULL){
+        printf("Error: Cannot allocate packet memory.  Quitting program.");
+        exit(0);
+    }
+
+    for(offset = 0; offset + first.packetSize <= length; offset += first.packetSize){
+        if(readPacketHeader(packets + offset, first.packetSize, &header) != 1 || header.image != first.image ||
+           header.count != first.count || header.delta != first.delta ||
+           !(first.delta ? decodeDelta(packets + offset, first.packetSize, &image, &reference) :
+                           decodeRects(packets + offset, first.packetSize, &image, rects, numRects))){
+            printf("Packet at byte %ld damaged\n", offset + headerSize);
+            damaged++;
+            continue;
+        }
+        if(!received[header.index])
+            decoded++;
+        received[header.index] = true;
+    }
+    numPackets = (int)(length / first.packetSize);
+    if(length % first.packetSize != 0)
+        printf("Ignoring %ld trailing bytes\n", length % first.packetSize);
+
+    for(i = 0; i < first.count; i++){
+        if(!received[i]){
+            printf("Packet %d missing\n", i);
+            missing++;
+        }
+    }
+
+    writePGM(argv[2], &image);
+    printf("Image %d, %dx%d%s: decoded %d of %d packets (%d read, %d damaged, %d missing), wrote %s\n",
+           first.image, first.width, first.height, first.delta ? " delta" : headerSize > 0 ? " cropped" : "",
+           decoded, first.count, numPackets, damaged, missing, argv[2]);
+
+    free(received);
+    if(first.delta)
+        freePGMImage(&reference);
+    freePGMImage(&image);
+    free(data);
+
+    return missing != 0 || damaged != 0;
+}
@@ -0,0 +1,634 @@
+/*
+Primary accretion detection algorithm.
+
+Downlink link budget simulator.  Replays the scores.csv a science run writes to the downlink
+folder through a modeled link: contact windows, the bandwidth of a contact and packet loss with
+retransmission.  Images are chosen by the same code the science run uses, frameScore and
+selectDownlink for the batch schedule, a DownlinkScheduler for the streaming one, so the score
+weights, downlink percentage and candidate set can be swept without analysing the images again.
+
+For every configuration it reports
+  first_science_s    : seconds from the start of the sequence until a relevant image is received
+  bytes_per_relevant : bytes transmitted, retransmissions included, per relevant image received
+  peak_queue, mean_queue : bytes staged and not yet received, sampled at contact starts and ends
+Relevant images are the ones listed in the labels file, or without one the top --relevant
+percent of the images by the score with the default weights.
+
+Build from the src directory:
+  gcc -O2 -I. tools/downlink_sim.c mg_downlink.c mg_scheduler.c mg_codec.c mg_roi.c mg_transfer.c mg_image.c mg_threshold.c mg_simd.c -lm -o downlink_sim
+
+Usage:
+  downlink_sim scores.csv [options]
+Options take comma separated lists where noted, every combination of them is simulated:
+  --schedule=batch|stream (list)   --percent=<percent> (list)    --candidates=<number> (list)
+  --c1=<weight> (list)             --c2=<weight> (list)          --loss=<probability> (list)
+  --bandwidth=<bytes/s> (list)     --packet-size=<bytes>         --frame-seconds=<s>
+  --first-contact=<s>              --contact-period=<s>          --contact-length=<s>
+  --relevant=<percent>             --labels=<file>               --runs=<number>
+  --seed=<number>                  --trace=<file>
+
+Jack Lightholder
+lightholder.jack16@gmail.com
+
+Space and Terrestrial Robotic Exploration Laboratory (SpaceTREx)
+Arizona State University
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "mg.h"
+#include "mg_centroid.h"
+#include "mg_codec.h"
+#include "mg_downlink.h"
+#include "mg_scheduler.h"
+
+// mg_downlink.c stages from and to these folders, the simulator stages nothing
+char sourceImageDir[] = "";
+char downlinkDir[] = "";
+
+#define SIM_MAX_VALUES 64
+#define SIM_MAX_CONTACTS 1000000
+
+// Swept options
+typedef enum SimSweep{
+    SWEEP_SCHEDULE,
+    SWEEP_PERCENT,
+    SWEEP_CANDIDATES,
+    SWEEP_C1,
+    SWEEP_C2,
+    SWEEP_LOSS,
+    SWEEP_BANDWIDTH,
+    SWEEP_COUNT
+}SimSweep;
+
+// Values of a swept option
+typedef struct SweepList{
+    int count;
+    double values[SIM_MAX_VALUES];
+}SweepList;
+
+// Modeled link.  Contacts start firstContact seconds after the start of the sequence and then
+// every contactPeriod seconds, each lasting contactLength seconds at bandwidth bytes per second.
+// Every packet is lost with probability loss and sent again until it is received.
+typedef struct SimLink{
+    double bandwidth;
+    double firstContact;
+    double contactPeriod;
+    double contactLength;
+    double loss;
+    int packetSize;
+}SimLink;
+
+// Staged image waiting in the transmit queue, packets still to be received
+typedef struct SimItem{
+    int index;
+    int packets;
+    double staged;
+}SimItem;
+
+// One simulated run.  now is the time images handed to queueImage are staged at.
+typedef struct Simulation{
+    int numImages;
+    int startImg;
+    int packetSize;
+    const long long* sizes;
+    const bool* relevant;
+    SimItem* queue;
+    int head;
+    int tail;
+    long long queued;
+    double now;
+    unsigned long long random;
+    FILE* trace;
+    int config;
+    int run;
+    // Results
+    int passes;
+    int delivered;
+    int relevantDelivered;
+    long long attempts;
+    double firstScience;
+    double complete;
+    long long peakQueue;
+    double queueSum;
+    int queueSamples;
+}Simulation;
+
+// Scoring inputs of the replayed sequence
+typedef struct SimInput{
+    int numImages;
+    int startImg;
+    double* kDistances;
+    Shift* acceleration;
+    long long* sizes;
+    bool* relevant;
+    int numRelevant;
+}SimInput;
+
+/**
+  *@brief Uniform random number in [0,1), xorshift64*.
+  */
+static double nextRandom(Simulation* sim){
+
+    sim->random ^= sim->random >> 12;
+    sim->random ^= sim->random << 25;
+    sim->random ^= sim->random >> 27;
+    return (double)((sim->random * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+/**
+  *@brief Stage hook of the simulated downlink: queue the packets of the image for transmission.
+  */
+static long long queueImage(void* context, const char* reason, int number, double score, bool previousStaged){
+
+    Simulation* sim = context;
+    SimItem* item = &sim->queue[sim->tail++];
+    long long bytes = sim->sizes[number - sim->startImg];
+
+    (void)reason;
+    (void)score;
+    (void)previousStaged;
+    item->index = number - sim->startImg;
+    item->packets = (int)((bytes + sim->packetSize - 1) / sim->packetSize);
+    if(item->packets < 1)
+        item->packets = 1;
+    item->staged = sim->now;
+    sim->queued += (long long)item->packets * sim->packetSize;
+    return bytes;
+}
+
+static void sampleQueue(Simulation* sim, double time){
+
+    if(sim->queued > sim->peakQueue)
+        sim->peakQueue = sim->queued;
+    sim->queueSum += (double)sim->queued;
+    sim->queueSamples++;
+    if(sim->trace != NULL)
+        fprintf(sim->trace, "%d,%d,%.3f,%lld\n", sim->config, sim->run, time, sim->queued);
+}
+
+/**
+  *@brief Send queued packets during a contact, in the order their images were staged.  A lost
+  *          packet is sent again straight away.
+  */
+static void transmit(Simulation* sim, const SimLink* link, double start, double end){
+
+    double time = start, packetTime = link->packetSize / link->bandwidth;
+    SimItem* item;
+
+    while(sim->head < sim->tail){
+        item = &sim->queue[sim->head];
+        if(item->staged > time)
+            time = item->staged;
+        if(time + packetTime > end)
+            break;
+        time += packetTime;
+        sim->attempts++;
+        if(link->loss > 0.0 && nextRandom(sim) < link->loss)
+            continue;
+
+        sim->queued -= link->packetSize;
+        if(--item->packets == 0){
+            sim->head++;
+            sim->delivered++;
+            sim->complete = time;
+            if(sim->relevant[item->index]){
+                sim->relevantDelivered++;
+                if(sim->firstScience < 0.0)
+                    sim->firstScience = time;
+            }
+        }
+    }
+}
+
+/**
+  *@brief Hand an analysed image to the streaming scheduler, as SciAnalysis does: image f-1 is
+  *          scored once image f is analysed, the first and last images are required.
+  */
+static void streamImage(const SimInput* in, const ScoreWeights* weights, DownlinkScheduler* scheduler, int f){
+
+    addSchedulerImage(scheduler, in->startImg + f, NULL);
+    if(f == 0)
+        offerSchedulerImage(scheduler, in->startImg, 0.0, "first", true);
+    if(f >= 2)
+        offerSchedulerImage(scheduler, in->startImg + f - 1,
+                            frameScore(weights, in->kDistances[f-1], &in->acceleration[f-2]), "score", false);
+    if(f == in->numImages - 1 && f > 0)
+        offerSchedulerImage(scheduler, in->startImg + f, 0.0, "last", true);
+}
+
+/**
+  *@brief Stage the images downlinkData would choose once the sequence is analysed.
+  */
+static void stageBatch(const SimInput* in, const ScoreWeights* weights, int percent, double* score,
+                       DownlinkPick* picks, DownlinkStage* stage){
+
+    int i=0, numPicks=0, n = in->numImages;
+
+    for(i = 0; i < n; i++){
+        score[i] = 0.0;
+        if(i > 0 && i < n - 1)
+            score[i] = frameScore(weights, in->kDistances[i], &in->acceleration[i-1]);
+    }
+    numPicks = selectDownlink(score, n, (int)(n * (percent * .01)), picks);
+    for(i = 0; i < numPicks; i++){
+        stageImage(stage, picks[i].reason, in->startImg + picks[i].index, score[picks[i].index], false, NULL);
+    }
+}
+
+/**
+  *@brief Simulate one configuration.
+  *
+  *INPUTS
+  *@param in            : Replayed sequence.
+  *@param link          : Modeled link.
+  *@param stream        : Streaming schedule instead of the batch one.
+  *@param percent       : Downlink percentage of the batch schedule.
+  *@param candidates    : Candidate set of the streaming schedule.
+  *@param weights       : Score weights.
+  *@param frameSeconds  : Time between two images.
+  *@param score, picks  : numImages entries of workspace.
+  *
+  *OUTPUTS
+  *@param sim : Results, its queue holds numImages entries.
+  */
+static void simulate(const SimInput* in, const SimLink* link, bool stream, int percent, int candidates,
+                     const ScoreWeights* weights, double frameSeconds, double* score, DownlinkPick* picks,
+                     Simulation* sim){
+
+    int i=0, f=0, k=0, n = in->numImages;
+    double start=0.0, end=0.0, sequenceEnd = n * frameSeconds;
+    bool ended = false;
+    DownlinkStage stage;
+    DownlinkScheduler scheduler;
+    LinkModel model;
+
+    sim->head = sim->tail = 0;
+    sim->queued = 0;
+    sim->passes = sim->delivered = sim->relevantDelivered = sim->queueSamples = 0;
+    sim->attempts = sim->peakQueue = 0;
+    sim->firstScience = -1.0;
+    sim->complete = 0.0;
+    sim->queueSum = 0.0;
+
+    openHookedStage(&stage, queueImage, sim);
+    if(stream){
+        // Each pass stages what a contact carries without losses
+        model.passBytes = (long long)(link->bandwidth * link->contactLength / link->packetSize) * link->packetSize;
+        model.passInterval = 1;
+        model.firstPass = 1;
+        initDownlinkScheduler(&scheduler, &model, candidates, &stage);
+    }
+
+    // Contacts go on after the sequence until the transmit queue is empty and, streaming, the
+    // scheduler has nothing left to pass
+    for(k = 0; k < SIM_MAX_CONTACTS && !(ended && sim->head == sim->tail &&
+                                         !(stream && (scheduler.count > 0 || scheduler.backlog > 0))); k++){
+        start = link->firstContact + k * link->contactPeriod;
+        end = start + link->contactLength;
+
+        // Images analysed by the start of the contact, then a pass opens on it.  Images analysed
+        // during the contact follow.  The batch schedule stages its images when the sequence
+        // ends, the streaming one keeps opening a pass on every contact until its candidate set
+        // and backlog are empty.
+        for(i = 0; i < 2; i++){
+            while(f < n && (f + 1) * frameSeconds <= (i == 0 ? start : end)){
+                if(stream)
+                    streamImage(in, weights, &scheduler, f);
+                f++;
+                if(f == n){
+                    ended = true;
+                    sim->now = sequenceEnd;
+                    if(!stream)
+                        stageBatch(in, weights, percent, score, picks, &stage);
+                }
+            }
+            if(i == 0 && stream && (!ended || scheduler.count > 0 || scheduler.backlog > 0)){
+                sim->now = start;
+                passScheduler(&scheduler);
+            }
+        }
+
+        sampleQueue(sim, start);
+        transmit(sim, link, start, end);
+        sampleQueue(sim, end);
+        sim->passes++;
+    }
+
+    if(stream)
+        freeDownlinkScheduler(&scheduler);
+    closeDownlinkStage(&stage);
+}
+
+/**
+  *@brief Parse a comma separated list of numbers.
+  */
+static int parseList(const char* text, SweepList* list){
+
+    char* next;
+
+    list->count = 0;
+    while(*text != '\0' && list->count < SIM_MAX_VALUES){
+        list->values[list->count++] = strtod(text, &next);
+        if(next == text || (*next != ',' && *next != '\0'))
+            return 0;
+        text = *next == ',' ? next + 1 : next;
+    }
+    return list->count > 0 && *text == '\0';
+}
+
+static int parseSchedules(const char* text, SweepList* list){
+
+    const char* comma;
+    size_t length=0;
+
+    list->count = 0;
+    while(list->count < SIM_MAX_VALUES){
+        comma = strchr(text, ',');
+        length = comma != NULL ? (size_t)(comma - text) : strlen(text);
+        if(length == 5 && strncmp(text, "batch", 5) == 0)
+            list->values[list->count++] = SCHEDULE_BATCH;
+        else if(length == 6 && strncmp(text, "stream", 6) == 0)
+            list->values[list->count++] = SCHEDULE_STREAM;
+        else
+            return 0;
+        if(comma == NULL)
+            return 1;
+        text = comma + 1;
+    }
+    return 0;
+}
+
+static int compareScores(const void* a, const void* b){
+
+    const double* x = a;
+    const double* y = b;
+
+    // Descending score, ties to the lower image, which is stored after the score
+    if(x[0] != y[0])
+        return x[0] < y[0] ? 1 : -1;
+    return x[1] < y[1] ? -1 : (x[1] > y[1]);
+}
+
+/**
+  *@brief Mark the relevant images, from a labels file of image numbers or as the top percent of
+  *          the images between the first and last one by the default score.
+  */
+static int findRelevant(SimInput* in, const char* labels, double percent){
+
+    int i=0, number=0, count=0;
+    double* ranked;
+    ScoreWeights defaults = {SCORE_DEFAULT_C1, SCORE_DEFAULT_C2};
+    FILE* file;
+
+    for(i = 0; i < in->numImages; i++){
+        in->relevant[i] = false;
+    }
+    in->numRelevant = 0;
+
+    if(labels != NULL){
+        file = fopen(labels, "r");
+        if(file == NULL)
+            return 0;
+        while(fscanf(file, "%d", &number) == 1){
+            if(number >= in->startImg && number < in->startImg + in->numImages && !in->relevant[number - in->startImg]){
+                in->relevant[number - in->startImg] = true;
+                in->numRelevant++;
+            }
+        }
+        fclose(file);
+        return 1;
+    }
+
+    if(in->numImages < 3)
+        return 1;
+    // malloc_findRelevant ranked free at the end of findRelevant
+    ranked = malloc(2 * (in->numImages - 2) * sizeof(double));
+    if(ranked == NULL)
+        return 0;
+    for(i = 1; i < in->numImages - 1; i++){
+        ranked[2*(i-1)] = frameScore(&defaults, in->kDistances[i], &in->acceleration[i-1]);
+        ranked[2*(i-1)+1] = i;
+    }
+    qsort(ranked, in->numImages - 2, 2 * sizeof(double), compareScores);
+    count = (int)((in->numImages - 2) * percent * .01 + 0.5);
+    for(i = 0; i < count && i < in->numImages - 2; i++){
+        in->relevant[(int)ranked[2*i+1]] = true;
+        in->numRelevant++;
+    }
+    free(ranked);
+    return 1;
+}
+
+int main(int argc, char* argv[]){
+
+    int i=0, j=0, run=0, config=0, numConfigs=1, rest=0, runs=1, delivered=0, relevantDelivered=0, scienceRuns=0;
+    int index[SWEEP_COUNT];
+    long long passes=0, attempts=0, peakQueue=0;
+    unsigned long long seed=1;
+    double frameSeconds=1.0, relevantPercent=10.0, firstScience=0.0, complete=0.0, meanQueue=0.0, seconds=0.0;
+    double value[SWEEP_COUNT];
+    const char* labels=NULL;
+    const char* tracePath=NULL;
+    double* score;
+    DownlinkPick* picks;
+    clock_t begin;
+    ScoreWeights weights;
+    SweepList sweeps[SWEEP_COUNT];
+    SimLink link;
+    SimInput in;
+    Simulation sim;
+
+    link.firstContact = LINK_DEFAULT_FIRST_PASS;
+    link.contactPeriod = LINK_DEFAULT_PASS_INTERVAL;
+    link.contactLength = 4.0;
+    link.packetSize = CODEC_DEFAULT_PACKET_SIZE;
+    parseSchedules("batch", &sweeps[SWEEP_SCHEDULE]);
+    parseList("25", &sweeps[SWEEP_PERCENT]);
+    parseList("32", &sweeps[SWEEP_CANDIDATES]);
+    parseList("0.5", &sweeps[SWEEP_C1]);
+    parseList("0.5", &sweeps[SWEEP_C2]);
+    parseList("0", &sweeps[SWEEP_LOSS]);
+    parseList("16384", &sweeps[SWEEP_BANDWIDTH]);
+
+    if(argc < 2){
+        printf("Usage: downlink_sim scores.csv [options], see the top of tools/downlink_sim.c\n");
+        return 1;
+    }
+    for(i = 2; i < argc; i++){
+        if(strncmp(argv[i], "--schedule=", 11) == 0 && parseSchedules(argv[i] + 11, &sweeps[SWEEP_SCHEDULE]))
+            continue;
+        else if(strncmp(argv[i], "--percent=", 10) == 0 && parseList(argv[i] + 10, &sweeps[SWEEP_PERCENT]))
+            continue;
+        else if(strncmp(argv[i], "--candidates=", 13) == 0 && parseList(argv[i] + 13, &sweeps[SWEEP_CANDIDATES]))
+            continue;
+        else if(strncmp(argv[i], "--c1=", 5) == 0 && parseList(argv[i] + 5, &sweeps[SWEEP_C1]))
+            continue;
+        else if(strncmp(argv[i], "--c2=", 5) == 0 && parseList(argv[i] + 5, &sweeps[SWEEP_C2]))
+            continue;
+        else if(strncmp(argv[i], "--loss=", 7) == 0 && parseList(argv[i] + 7, &sweeps[SWEEP_LOSS]))
+            continue;
+        else if(strncmp(argv[i], "--bandwidth=", 12) == 0 && parseList(argv[i] + 12, &sweeps[SWEEP_BANDWIDTH]))
+            continue;
+        else if(strncmp(argv[i], "--packet-size=", 14) == 0 && atoi(argv[i] + 14) >= 1)
+            link.packetSize = atoi(argv[i] + 14);
+        else if(strncmp(argv[i], "--frame-seconds=", 16) == 0 && atof(argv[i] + 16) > 0.0)
+            frameSeconds = atof(argv[i] + 16);
+        else if(strncmp(argv[i], "--first-contact=", 16) == 0 && atof(argv[i] + 16) >= 0.0)
+            link.firstContact = atof(argv[i] + 16);
+        else if(strncmp(argv[i], "--contact-period=", 17) == 0 && atof(argv[i] + 17) > 0.0)
+            link.contactPeriod = atof(argv[i] + 17);
+        else if(strncmp(argv[i], "--contact-length=", 17) == 0 && atof(argv[i] + 17) > 0.0)
+            link.contactLength = atof(argv[i] + 17);
+        else if(strncmp(argv[i], "--relevant=", 11) == 0 && atof(argv[i] + 11) >= 0.0)
+            relevantPercent = atof(argv[i] + 11);
+        else if(strncmp(argv[i], "--labels=", 9) == 0)
+            labels = argv[i] + 9;
+        else if(strncmp(argv[i], "--runs=", 7) == 0 && atoi(argv[i] + 7) >= 1)
+            runs = atoi(argv[i] + 7);
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        else if(strncmp(argv[i], "--trace=", 8) == 0)
+            tracePath = argv[i] + 8;
+        else{
+            printf("Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    for(j = 0; j < sweeps[SWEEP_LOSS].count; j++){
+        if(sweeps[SWEEP_LOSS].values[j] < 0.0 || sweeps[SWEEP_LOSS].values[j] >= 1.0){
+            printf("Error: Packet loss must be at least 0 and below 1\n");
+            return 1;
+        }
+    }
+    for(j = 0; j < sweeps[SWEEP_BANDWIDTH].count; j++){
+        if(sweeps[SWEEP_BANDWIDTH].values[j] <= 0.0){
+            printf("Error: Bandwidth must be above 0\n");
+            return 1;
+        }
+    }
+    if(link.contactLength > link.contactPeriod){
+        printf("Error: Contacts cannot be longer than their period\n");
+        return 1;
+    }
+
+    in.numImages = readScores(argv[1], &in.kDistances, &in.acceleration, &in.sizes, &in.startImg);
+    if(in.numImages < 1){
+        printf("Error: Cannot read scores from %s\n", argv[1]);
+        return 1;
+    }
+
+    // malloc_main relevant, score, picks, queue free at the end of main
+    in.relevant = malloc(in.numImages * sizeof(bool));
+    score = malloc(in.numImages * sizeof(double));
+    picks = malloc(in.numImages * sizeof(DownlinkPick));
+    sim.queue = malloc(in.numImages * sizeof(SimItem));
+    if(in.relevant == NULL || score == NULL || picks == NULL || sim.queue == NULL){
+        printf("Error: Cannot allocate simulation memory.\n");
+        return 1;
+    }
+    if(!findRelevant(&in, labels, relevantPercent)){
+        printf("Error: Cannot read labels from %s\n", labels);
+        return 1;
+    }
+
+    sim.numImages = in.numImages;
+    sim.startImg = in.startImg;
+    sim.packetSize = link.packetSize;
+    sim.sizes = in.sizes;
+    sim.relevant = in.relevant;
+    sim.trace = NULL;
+    if(tracePath != NULL){
+        sim.trace = fopen(tracePath, "w");
+        if(sim.trace == NULL){
+            printf("Error opening file for write: %s\n", tracePath);
+            return 1;
+        }
+        fprintf(sim.trace, "config,run,time,queue\n");
+    }
+
+    for(j = 0; j < SWEEP_COUNT; j++){
+        numConfigs *= sweeps[j].count;
+    }
+
+    printf("config,schedule,percent,candidates,c1,c2,loss,bandwidth,images,relevant,first_science_s,"
+           "bytes_per_relevant,complete_s,peak_queue,mean_queue\n");
+    begin = clock();
+    for(config = 0; config < numConfigs; config++){
+        rest = config;
+        for(j = SWEEP_COUNT - 1; j >= 0; j--){
+            index[j] = rest % sweeps[j].count;
+            value[j] = sweeps[j].values[index[j]];
+            rest /= sweeps[j].count;
+        }
+        // The percentage only applies to the batch schedule, the candidate set to the streaming one
+        if((value[SWEEP_SCHEDULE] == SCHEDULE_BATCH && index[SWEEP_CANDIDATES] > 0) ||
+           (value[SWEEP_SCHEDULE] == SCHEDULE_STREAM && index[SWEEP_PERCENT] > 0))
+            continue;
+
+        weights.c1 = value[SWEEP_C1];
+        weights.c2 = value[SWEEP_C2];
+        link.loss = value[SWEEP_LOSS];
+        link.bandwidth = value[SWEEP_BANDWIDTH];
+        delivered = relevantDelivered = scienceRuns = 0;
+        attempts = peakQueue = 0;
+        firstScience = complete = meanQueue = 0.0;
+
+        for(run = 0; run < runs; run++){
+            sim.config = config;
+            sim.run = run;
+            sim.random = (seed + 0x9E3779B97F4A7C15ULL * (unsigned long long)(run + 1)) | 1;
+            simulate(&in, &link, value[SWEEP_SCHEDULE] == SCHEDULE_STREAM, (int)value[SWEEP_PERCENT],
+                     (int)value[SWEEP_CANDIDATES], &weights, frameSeconds, score, picks, &sim);
+
+            passes += sim.passes;
+            delivered += sim.delivered;
+            relevantDelivered += sim.relevantDelivered;
+            attempts += sim.attempts;
+            complete += sim.complete;
+            meanQueue += sim.queueSamples > 0 ? sim.queueSum / sim.queueSamples : 0.0;
+            if(sim.peakQueue > peakQueue)
+                peakQueue = sim.peakQueue;
+            if(sim.firstScience >= 0.0){
+                firstScience += sim.firstScience;
+                scienceRuns++;
+            }
+        }
+
+        printf("%d,%s,", config, value[SWEEP_SCHEDULE] == SCHEDULE_STREAM ? "stream" : "batch");
+        if(value[SWEEP_SCHEDULE] == SCHEDULE_STREAM)
+            printf("-,%d,", (int)value[SWEEP_CANDIDATES]);
+        else
+            printf("%d,-,", (int)value[SWEEP_PERCENT]);
+        printf("%g,%g,%g,%g,%.1f,%.1f/%d,", weights.c1, weights.c2, link.loss, link.bandwidth,
+               (double)delivered / runs, (double)relevantDelivered / runs, in.numRelevant);
+        if(scienceRuns > 0)
+            printf("%.1f,", firstScience / scienceRuns);
+        else
+            printf("-,");
+        if(relevantDelivered > 0)
+            printf("%.0f,", (double)attempts * link.packetSize / relevantDelivered);
+        else
+            printf("-,");
+        printf("%.1f,%lld,%.0f\n", complete / runs, peakQueue, meanQueue / runs);
+    }
+    seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    printf("# %d images, %d relevant, %lld passes simulated in %.3f s", in.numImages, in.numRelevant, passes, seconds);
+    if(seconds > 0.0)
+        printf(", %.0f passes per second", passes / seconds);
+    printf("\n");
+
+    if(sim.trace != NULL)
+        fclose(sim.trace);
+    free(in.kDistances);
+    free(in.acceleration);
+    free(in.sizes);
+    free(in.relevant);
+    free(score);
+    free(picks);
+    free(sim.queue);
+    return 0;
+}